@@ -0,0 +1,175 @@
+#include "builtin.h"
+#include "config.h"
+#include "tempfile.h"
+#include "parse-options.h"
+#include "rerere.h"
+
+#ifndef NO_UNIX_SOCKETS
+#include "unix-socket.h"
+
+/*
+ * What is only kept in memory (when the clusters were last matched) is
+ * written back once this many seconds passed, and the daemon goes away
+ * when no request came for IDLE_TIMEOUT seconds.
+ */
+#define FLUSH_INTERVAL 5
+#define IDLE_TIMEOUT 600
+
+static const char * const rerere_cache_daemon_usage[] = {
+	N_("git rerere-cache--daemon [--debug] [<socket-path>]"),
+	N_("git rerere-cache--daemon --exit [<socket-path>]"),
+	NULL
+};
+
+static void serve_one_client(int client)
+{
+	struct strbuf request = STRBUF_INIT, reply = STRBUF_INIT;
+
+	if (strbuf_read(&request, client, 0) < 0)
+		warning_errno("unable to read the request");
+	else if (!strcmp(request.buf, "exit")) {
+		/*
+		 * As credential-cache--daemon does, let the atexit()
+		 * handler remove the socket before the client gets EOF.
+		 */
+		rerere_cache_flush();
+		exit(0);
+	} else {
+		rerere_cache_serve(&request, &reply);
+		if (write_in_full(client, reply.buf, reply.len) < 0)
+			warning_errno("unable to write the reply");
+	}
+	strbuf_release(&request);
+	strbuf_release(&reply);
+}
+
+static void serve_cache(const char *socket_path, int debug)
+{
+	timestamp_t last_request = time(NULL), last_flush = last_request;
+	int fd;
+
+	fd = unix_stream_listen(socket_path);
+	if (fd < 0)
+		die_errno("unable to bind to '%s'", socket_path);
+
+	printf("ok\n");
+	fclose(stdout);
+	if (!debug) {
+		if (!freopen("/dev/null", "w", stderr))
+			die_errno("unable to point stderr to /dev/null");
+	}
+
+	while (1) {
+		timestamp_t now = time(NULL);
+		struct pollfd pfd;
+
+		if (now - last_flush >= FLUSH_INTERVAL) {
+			rerere_cache_flush();
+			last_flush = now;
+		}
+		if (now - last_request >= IDLE_TIMEOUT)
+			break;
+
+		pfd.fd = fd;
+		pfd.events = POLLIN;
+		if (poll(&pfd, 1, 1000 * FLUSH_INTERVAL) < 0) {
+			if (errno != EINTR)
+				die_errno("poll failed");
+			continue;
+		}
+		if (pfd.revents & POLLIN) {
+			int client = accept(fd, NULL, NULL);
+
+			if (client < 0) {
+				warning_errno("accept failed");
+				continue;
+			}
+			serve_one_client(client);
+			close(client);
+			last_request = time(NULL);
+		}
+	}
+	rerere_cache_flush();
+	close(fd);
+}
+
+static int stop_daemon(const char *socket_path)
+{
+	char c;
+	int fd = unix_stream_connect(socket_path);
+
+	if (fd < 0)
+		return 0;
+	if (write_in_full(fd, "exit", 5) < 0)
+		return error_errno("unable to write to the rerere cache daemon");
+	shutdown(fd, SHUT_WR);
+	/* EOF once it removed its socket */
+	while (xread(fd, &c, 1) > 0)
+		; /* nothing */
+	close(fd);
+	return 0;
+}
+
+/*
+ * Unlike credential-cache--daemon, we do not chdir to the socket
+ * directory: the paths of the rr-cache may be relative to where we were
+ * started.
+ */
+static void init_socket_directory(const char *path)
+{
+	struct stat st;
+	char *path_copy = xstrdup(path);
+	char *dir = dirname(path_copy);
+
+	if (stat(dir, &st)) {
+		if (safe_create_leading_directories_const(dir) < 0)
+			die_errno("unable to create directories for '%s'", dir);
+		if (mkdir(dir, 0700) < 0)
+			die_errno("unable to mkdir '%s'", dir);
+	}
+	free(path_copy);
+}
+
+int cmd_rerere_cache__daemon(int argc, const char **argv, const char *prefix)
+{
+	struct tempfile *socket_file;
+	const char *socket_path;
+	int debug = 0, exit_daemon = 0;
+	struct option options[] = {
+		OPT_BOOL(0, "debug", &debug,
+			 N_("print debugging messages to stderr")),
+		OPT_BOOL(0, "exit", &exit_daemon,
+			 N_("stop the daemon serving the socket")),
+		OPT_END()
+	};
+
+	argc = parse_options(argc, argv, prefix, options,
+			     rerere_cache_daemon_usage, 0);
+	if (argc > 1)
+		usage_with_options(rerere_cache_daemon_usage, options);
+	socket_path = argc ? argv[0] :
+		absolute_path(git_path_rerere_cache_socket());
+	if (!is_absolute_path(socket_path))
+		die("socket path must be an absolute path");
+
+	if (exit_daemon)
+		return stop_daemon(socket_path);
+
+	init_socket_directory(socket_path);
+	socket_file = register_tempfile(socket_path);
+	signal(SIGHUP, SIG_IGN);
+
+	serve_cache(socket_path, debug);
+	delete_tempfile(&socket_file);
+
+	return 0;
+}
+
+#else
+
+int cmd_rerere_cache__daemon(int argc, const char **argv, const char *prefix)
+{
+	die(_("rerere-cache--daemon needs unix sockets"));
+}
+
+#endif
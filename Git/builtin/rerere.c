@@ -10,7 +10,7 @@
 #include "pathspec.h"
 
 static const char * const rerere_usage[] = {
-	N_("git rerere [clear | forget <path>... | status | remaining | diff | gc]"),
+	N_("git rerere [clear | forget <path>... | status | remaining | diff | gc | suggest]"),
 	NULL,
 };
 
@@ -53,11 +53,15 @@ static int diff_two(const char *file1, const char *label1,
 int cmd_rerere(int argc, const char **argv, const char *prefix)
 {
 	struct string_list merge_rr = STRING_LIST_INIT_DUP;
-	int i, autoupdate = -1, flags = 0;
+	int i, autoupdate = -1, flags = 0, process = 0, detach = 1;
 
 	struct option options[] = {
 		OPT_SET_INT(0, "rerere-autoupdate", &autoupdate,
 			N_("register clean resolutions in index"), 1),
+		OPT_HIDDEN_BOOL(0, "process", &process,
+			N_("compute the queued suggestions in the background")),
+		OPT_HIDDEN_BOOL(0, "detach", &detach,
+			N_("detach from the terminal while computing them")),
 		OPT_END(),
 	};
 
@@ -86,6 +90,8 @@ int cmd_rerere(int argc, const char **argv, const char *prefix)
 		rerere_clear(the_repository, &merge_rr);
 	} else if (!strcmp(argv[0], "gc"))
 		rerere_gc(the_repository, &merge_rr);
+	else if (!strcmp(argv[0], "suggest"))
+		return rerere_suggest(the_repository, process, detach);
 	else if (!strcmp(argv[0], "status")) {
 		if (setup_rerere(the_repository, &merge_rr,
 				 flags | RERERE_READONLY) < 0)
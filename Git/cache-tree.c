@@ -609,6 +609,69 @@ static struct cache_tree *cache_tree_find(struct cache_tree *it, const char *pat
 	return it;
 }
 
+/*
+ * Return the position past the "nr" entries below "prefix" (of "len"
+ * bytes, with its trailing slash) that start at "pos", or "pos" if they
+ * do not start or end there.
+ */
+static int subtree_end(const struct index_state *istate, int pos, int nr,
+		       const char *prefix, int len)
+{
+	int end = pos + nr;
+
+	if (nr <= 0 || end > istate->cache_nr)
+		return pos;
+	if (pos && !strncmp(istate->cache[pos - 1]->name, prefix, len))
+		return pos;
+	if (strncmp(istate->cache[end - 1]->name, prefix, len))
+		return pos;
+	if (end < istate->cache_nr && !strncmp(istate->cache[end]->name, prefix, len))
+		return pos;
+	return end;
+}
+
+/*
+ * If the entry at "pos" is the first one below a valid cache-tree node,
+ * return the position past the entries below the outermost such node,
+ * or "pos" otherwise.
+ */
+static int skip_valid_subtree(const struct index_state *istate, int pos)
+{
+	const char *name = istate->cache[pos]->name, *component = name, *slash;
+	struct cache_tree *it = istate->cache_tree;
+
+	if (!it)
+		return pos;
+	if (0 <= it->entry_count)
+		return subtree_end(istate, pos, it->entry_count, "", 0);
+	while ((slash = strchr(component, '/'))) {
+		struct cache_tree_sub *sub;
+
+		sub = find_subtree(it, component, slash - component, 0);
+		if (!sub || !sub->cache_tree)
+			break;
+		it = sub->cache_tree;
+		if (0 <= it->entry_count)
+			return subtree_end(istate, pos, it->entry_count,
+					   name, slash - name + 1);
+		component = slash + 1;
+	}
+	return pos;
+}
+
+int cache_tree_next_unmerged(const struct index_state *istate, int pos)
+{
+	while (pos < istate->cache_nr) {
+		int end;
+
+		if (ce_stage(istate->cache[pos]))
+			return pos;
+		end = skip_valid_subtree(istate, pos);
+		pos = end > pos ? end : pos + 1;
+	}
+	return istate->cache_nr;
+}
+
 int write_index_as_tree(struct object_id *oid, struct index_state *index_state, const char *index_path, int flags, const char *prefix)
 {
 	int entries, was_valid;
@@ -34,6 +34,16 @@ int cache_tree_fully_valid(struct cache_tree *);
 int cache_tree_update(struct index_state *, int);
 void cache_tree_verify(struct repository *, struct index_state *);
 
+/*
+ * Return the position of the first unmerged entry at or after "pos", or
+ * istate->cache_nr if there is none.  unpack_trees() and
+ * add_index_entry() invalidate the cache-tree along the path of each
+ * stage they add, so the entries below a valid cache-tree node are all
+ * merged and are skipped without being looked at; finding the conflicts
+ * of a merge costs about as much as there are conflicts, not entries.
+ */
+int cache_tree_next_unmerged(const struct index_state *, int pos);
+
 /* bitmasks to write_cache_as_tree flags */
 #define WRITE_TREE_MISSING_OK 1
 #define WRITE_TREE_IGNORE_CACHE_TREE 2
@@ -4,6 +4,8 @@
 #include "help.h"
 #include "run-command.h"
 #include "alias.h"
+#include "ll-merge.h"
+#include "rerere.h"
 
 #define RUN_SETUP		(1<<0)
 #define RUN_SETUP_GENTLY	(1<<1)
@@ -561,6 +563,7 @@ static struct cmd_struct commands[] = {
 	{ "repack", cmd_repack, RUN_SETUP },
 	{ "replace", cmd_replace, RUN_SETUP },
 	{ "rerere", cmd_rerere, RUN_SETUP },
+	{ "rerere-cache--daemon", cmd_rerere_cache__daemon, RUN_SETUP },
 	{ "reset", cmd_reset, RUN_SETUP },
 	{ "restore", cmd_restore, RUN_SETUP | NEED_WORK_TREE },
 	{ "rev-list", cmd_rev_list, RUN_SETUP | NO_PARSEOPT },
@@ -827,6 +830,9 @@ int cmd_main(int argc, const char **argv)
 
 	trace_command_performance(argv);
 
+	/* the "almost-rerere" merge driver resolves with what rerere recorded */
+	ll_set_conflict_resolver(rerere_resolve_conflicts);
+
 	/*
 	 * "git-xxxx" is the same as "git xxxx", but we obviously:
 	 *
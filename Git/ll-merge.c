@@ -94,14 +94,14 @@ static int ll_binary_merge(const struct ll_merge_driver *drv_unused,
 	return (opts->variant ? 0 : 1);
 }
 
-static int ll_xdl_merge(const struct ll_merge_driver *drv_unused,
-			mmbuffer_t *result,
-			const char *path,
-			mmfile_t *orig, const char *orig_name,
-			mmfile_t *src1, const char *name1,
-			mmfile_t *src2, const char *name2,
-			const struct ll_merge_options *opts,
-			int marker_size)
+static int xdl_merge_conflicts(const struct ll_merge_driver *drv_unused,
+			       mmbuffer_t *result,
+			       const char *path,
+			       mmfile_t *orig, const char *orig_name,
+			       mmfile_t *src1, const char *name1,
+			       mmfile_t *src2, const char *name2,
+			       const struct ll_merge_options *opts,
+			       int marker_size, xmconflicts_t *conflicts)
 {
 	xmparam_t xmp;
 	assert(opts);
@@ -131,9 +131,24 @@ static int ll_xdl_merge(const struct ll_merge_driver *drv_unused,
 	xmp.ancestor = orig_name;
 	xmp.file1 = name1;
 	xmp.file2 = name2;
+	xmp.conflicts = conflicts;
 	return xdl_merge(orig, src1, src2, &xmp, result);
 }
 
+static int ll_xdl_merge(const struct ll_merge_driver *drv_unused,
+			mmbuffer_t *result,
+			const char *path,
+			mmfile_t *orig, const char *orig_name,
+			mmfile_t *src1, const char *name1,
+			mmfile_t *src2, const char *name2,
+			const struct ll_merge_options *opts,
+			int marker_size)
+{
+	return xdl_merge_conflicts(drv_unused, result, path,
+				   orig, orig_name, src1, name1, src2, name2,
+				   opts, marker_size, NULL);
+}
+
 static int ll_union_merge(const struct ll_merge_driver *drv_unused,
 			  mmbuffer_t *result,
 			  const char *path_unused,
@@ -153,13 +168,63 @@ static int ll_union_merge(const struct ll_merge_driver *drv_unused,
 			    &o, marker_size);
 }
 
+static ll_conflict_resolver_fn conflict_resolver;
+
+void ll_set_conflict_resolver(ll_conflict_resolver_fn fn)
+{
+	conflict_resolver = fn;
+}
+
+static int ll_almost_rerere_merge(const struct ll_merge_driver *drv_unused,
+				  mmbuffer_t *result,
+				  const char *path,
+				  mmfile_t *orig, const char *orig_name,
+				  mmfile_t *src1, const char *name1,
+				  mmfile_t *src2, const char *name2,
+				  const struct ll_merge_options *opts,
+				  int marker_size)
+{
+	struct strbuf resolved = STRBUF_INIT;
+	xmconflicts_t conflicts = { NULL, 0, 0 };
+	int ret, left;
+
+	ret = xdl_merge_conflicts(drv_unused, result, path,
+				  orig, orig_name, src1, name1, src2, name2,
+				  opts, marker_size, &conflicts);
+	/*
+	 * The conflicts of a virtual ancestor are merged again later;
+	 * they are resolved then, if at all.  A binary merge reports
+	 * no conflicts.
+	 */
+	if (ret <= 0 || opts->virtual_ancestor || !conflicts.nr ||
+	    !conflict_resolver)
+		goto out;
+
+	left = conflict_resolver(result->ptr, result->size,
+				 &conflicts, &resolved);
+	if (left < 0) {
+		strbuf_release(&resolved);
+		goto out;
+	}
+	free(result->ptr);
+	result->size = resolved.len;
+	result->ptr = strbuf_detach(&resolved, NULL);
+	ret = left;
+out:
+	free(conflicts.conflict);
+	return ret;
+}
+
 #define LL_BINARY_MERGE 0
 #define LL_TEXT_MERGE 1
 #define LL_UNION_MERGE 2
+#define LL_ALMOST_RERERE_MERGE 3
 static struct ll_merge_driver ll_merge_drv[] = {
 	{ "binary", "built-in binary merge", ll_binary_merge },
 	{ "text", "built-in 3-way text merge", ll_xdl_merge },
 	{ "union", "built-in union merge", ll_union_merge },
+	{ "almost-rerere", "built-in 3-way merge with recorded hunk resolutions",
+	  ll_almost_rerere_merge },
 };
 
 static void create_temp(mmfile_t *src, char *path, size_t len)
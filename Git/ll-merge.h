@@ -28,4 +28,17 @@ int ll_merge(mmbuffer_t *result_buf,
 int ll_merge_marker_size(struct index_state *istate, const char *path);
 void reset_merge_attributes(void);
 
+/*
+ * The "almost-rerere" driver hands the conflicts xdl_merge() left in
+ * "buf" to this, to be resolved into "out"; it returns how many are
+ * left, or -1 if none was resolved.  Until one is set, the driver is
+ * the "text" one.  git sets rerere_resolve_conflicts(), so that the
+ * programs that do not link rerere can still merge.
+ */
+struct strbuf;
+typedef int (*ll_conflict_resolver_fn)(const char *buf, size_t len,
+				       const xmconflicts_t *conflicts,
+				       struct strbuf *out);
+void ll_set_conflict_resolver(ll_conflict_resolver_fn fn);
+
 #endif
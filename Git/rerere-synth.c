@@ -0,0 +1,1160 @@
+#include "cache.h"
+#include "hashmap.h"
+#include "levenshtein.h"
+#include "string-list.h"
+#include "thread-utils.h"
+#include "rerere-synth.h"
+
+/*
+ * The rules are applied by RegexReplacement.jar, with Java regexes, and
+ * evaluated here with POSIX extended ones, so the trees only render to
+ * what both read the same way: no lookarounds, no non-capturing
+ * groups, no backslash inside a character list, and "\d" and "\w"
+ * spelled as lists.
+ */
+static const char *default_constants[] = {
+    "\\d", "\\w", "0", "1", "2", "3", "4", "5", "6", "7", "8", "9",
+    "\\.", ":", ",", ";", "_", "=", "\"", "'", "\\\\", "/", "\\?", "\\!",
+    "\\}", "\\{", "\\(", "\\)", "\\[", "\\]", "<", ">", "@", "#", " ",
+    NULL
+};
+
+static const char *default_ranges[] = { "a-z", "A-Z", NULL };
+
+/* characters that can go in a character list unescaped, for both */
+#define SYNTH_LIST_CHARS " ,;:_=@#<>'\"/"
+
+#define SYNTH_MAX_GROUPS 9
+#define SYNTH_MAX_TOKENS 32
+#define SYNTH_MAX_WORDS 64
+#define SYNTH_WORST ULONG_MAX
+
+static int max_int(int a, int b)
+{
+    return a > b ? a : b;
+}
+
+/*
+ * splitmix64; every run has its own stream, seeded from the options
+ * and its job number, so that its result does not depend on the
+ * thread it ran on.
+ */
+struct synth_rng {
+    uint64_t state;
+};
+
+static uint64_t rng_next(struct synth_rng *rng)
+{
+    uint64_t z = (rng->state += 0x9e3779b97f4a7c15ULL);
+
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+static unsigned rng_below(struct synth_rng *rng, unsigned n)
+{
+    return n ? rng_next(rng) % n : 0;
+}
+
+static double rng_unit(struct synth_rng *rng)
+{
+    return (rng_next(rng) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/*
+ * The terminals of a cluster: the constants and the words of its
+ * conflicts for the regexes, the group references and the words and
+ * punctuation of its resolutions for the replacements.  Like the
+ * populations of the jar, the first individuals are built from the
+ * examples: each "seed" rewrites what one example changes into what it
+ * is changed to, either literally or with its words made groups.
+ */
+struct synth_seed {
+    struct synth_node *regex;
+    const char *replacement;    /* one of the tokens */
+};
+
+struct synth_terminals {
+    struct string_list literals;
+    struct string_list list_items;  /* ranges and characters for [...] */
+    struct string_list tokens;      /* in replacement syntax */
+    struct synth_seed *seeds;
+    int nr_seeds, alloc_seeds;
+};
+
+static void escape_regex(struct strbuf *buf, const char *s, size_t len)
+{
+    for (; len; s++, len--) {
+        if (is_regex_special(*s) || *s == ']' || *s == '}')
+            strbuf_addch(buf, '\\');
+        strbuf_addch(buf, *s);
+    }
+}
+
+static void escape_replacement(struct strbuf *buf, const char *s, size_t len)
+{
+    for (; len; s++, len--) {
+        if (*s == '$' || *s == '\\')
+            strbuf_addch(buf, '\\');
+        strbuf_addch(buf, *s);
+    }
+}
+
+/* the copy of "s" in "list", added if needed */
+static const char *intern(struct string_list *list, const char *s)
+{
+    struct string_list_item *item = unsorted_string_list_lookup(list, s);
+
+    if (!item)
+        item = string_list_append(list, s);
+    return item->string;
+}
+
+static const char *add_regex_literal(struct string_list *literals, const char *s, size_t len)
+{
+    struct strbuf buf = STRBUF_INIT;
+    const char *literal;
+
+    escape_regex(&buf, s, len);
+    literal = intern(literals, buf.buf);
+    strbuf_release(&buf);
+    return literal;
+}
+
+static const char *add_replacement_token(struct string_list *tokens, const char *s, size_t len)
+{
+    struct strbuf buf = STRBUF_INIT;
+    const char *token;
+
+    escape_replacement(&buf, s, len);
+    token = intern(tokens, buf.buf);
+    strbuf_release(&buf);
+    return token;
+}
+
+static int is_word_char(char c)
+{
+    return isalnum(c) || c == '_';
+}
+
+/* call "add" on the words and the other non-space characters of "text" */
+static void add_words(struct string_list *list, const char *text, int punctuation,
+                      const char *(*add)(struct string_list *, const char *, size_t))
+{
+    while (*text && list->nr < SYNTH_MAX_WORDS) {
+        size_t len = 0;
+
+        while (is_word_char(text[len]))
+            len++;
+        if (len)
+            add(list, text, len);
+        else if (punctuation || isspace(*text))
+            add(list, text, len = 1);
+        else
+            len = 1;
+        text += len;
+    }
+}
+
+static void init_terminals(struct synth_terminals *t, const struct synth_cluster *cluster,
+                           const struct synth_options *opts)
+{
+    const char **constants = opts->constants ? opts->constants : default_constants;
+    const char **ranges = opts->ranges ? opts->ranges : default_ranges;
+    int i;
+
+    string_list_init(&t->literals, 1);
+    string_list_init(&t->list_items, 1);
+    string_list_init(&t->tokens, 1);
+
+    for (i = 0; constants[i]; i++) {
+        const char *c = constants[i];
+
+        if (!strcmp(c, "\\d"))
+            c = "[0-9]";
+        else if (!strcmp(c, "\\w"))
+            c = "[A-Za-z0-9_]";
+        string_list_append(&t->literals, c);
+        if (strlen(c) == 1 && strchr(SYNTH_LIST_CHARS, *c))
+            string_list_append(&t->list_items, c);
+    }
+    for (i = 0; ranges[i]; i++)
+        if (strlen(ranges[i]) == 3 && ranges[i][1] == '-' &&
+            isalnum(ranges[i][0]) && isalnum(ranges[i][2]))
+            string_list_append(&t->list_items, ranges[i]);
+    string_list_append(&t->list_items, "0-9");
+
+    for (i = 0; i <= SYNTH_MAX_GROUPS; i++)
+        string_list_append_nodup(&t->tokens, xstrfmt("$%d", i));
+    for (i = 0; i < cluster->nr; i++) {
+        add_words(&t->literals, cluster->examples[i].conflict, 0, add_regex_literal);
+        add_words(&t->tokens, cluster->examples[i].resolution, 1, add_replacement_token);
+    }
+}
+
+static void clear_terminals(struct synth_terminals *t)
+{
+    string_list_clear(&t->literals, 0);
+    string_list_clear(&t->list_items, 0);
+    string_list_clear(&t->tokens, 0);
+}
+
+enum synth_node_type {
+    SYNTH_LITERAL,
+    SYNTH_LIST,         /* [...] or [^...] */
+    SYNTH_CONCAT,
+    SYNTH_GROUP,
+    SYNTH_STAR,
+    SYNTH_PLUS,
+    SYNTH_OPTIONAL,
+    SYNTH_MIN_MAX
+};
+
+struct synth_node {
+    enum synth_node_type type;
+    char *text;         /* SYNTH_LITERAL and SYNTH_LIST */
+    int min, max;       /* SYNTH_MIN_MAX */
+    struct synth_node *kid[2];
+};
+
+static int node_kids(const struct synth_node *node)
+{
+    switch (node->type) {
+    case SYNTH_LITERAL:
+    case SYNTH_LIST:
+        return 0;
+    case SYNTH_CONCAT:
+        return 2;
+    default:
+        return 1;
+    }
+}
+
+static int is_quantifier(enum synth_node_type type)
+{
+    return type >= SYNTH_STAR;
+}
+
+static void free_node(struct synth_node *node)
+{
+    int i;
+
+    if (!node)
+        return;
+    for (i = 0; i < node_kids(node); i++)
+        free_node(node->kid[i]);
+    free(node->text);
+    free(node);
+}
+
+static struct synth_node *copy_node(const struct synth_node *node)
+{
+    struct synth_node *copy = xmalloc(sizeof(*copy));
+    int i;
+
+    *copy = *node;
+    copy->text = xstrdup_or_null(node->text);
+    for (i = 0; i < node_kids(node); i++)
+        copy->kid[i] = copy_node(node->kid[i]);
+    return copy;
+}
+
+static int node_depth(const struct synth_node *node)
+{
+    int i, depth = 0;
+
+    for (i = 0; i < node_kids(node); i++)
+        depth = max_int(depth, node_depth(node->kid[i]));
+    return depth + 1;
+}
+
+static int node_count(const struct synth_node *node)
+{
+    int i, count = 1;
+
+    for (i = 0; i < node_kids(node); i++)
+        count += node_count(node->kid[i]);
+    return count;
+}
+
+/* the slot holding the n-th node of the tree, in preorder */
+static struct synth_node **nth_slot(struct synth_node **slot, int *n)
+{
+    int i;
+
+    if (!(*n)--)
+        return slot;
+    for (i = 0; i < node_kids(*slot); i++) {
+        struct synth_node **found = nth_slot(&(*slot)->kid[i], n);
+
+        if (found)
+            return found;
+    }
+    return NULL;
+}
+
+/*
+ * A quantifier must apply to a single atom, or the regex either does
+ * not compile or does not mean the same to both engines.
+ */
+static int node_valid(const struct synth_node *node, int *groups)
+{
+    int i;
+
+    if (node->type == SYNTH_GROUP && ++*groups > SYNTH_MAX_GROUPS)
+        return 0;
+    if (is_quantifier(node->type) &&
+        node->kid[0]->type != SYNTH_LITERAL &&
+        node->kid[0]->type != SYNTH_LIST &&
+        node->kid[0]->type != SYNTH_GROUP)
+        return 0;
+    for (i = 0; i < node_kids(node); i++)
+        if (!node_valid(node->kid[i], groups))
+            return 0;
+    return 1;
+}
+
+static void render_node(const struct synth_node *node, struct strbuf *out)
+{
+    switch (node->type) {
+    case SYNTH_LITERAL:
+    case SYNTH_LIST:
+        strbuf_addstr(out, node->text);
+        break;
+    case SYNTH_CONCAT:
+        render_node(node->kid[0], out);
+        render_node(node->kid[1], out);
+        break;
+    case SYNTH_GROUP:
+        strbuf_addch(out, '(');
+        render_node(node->kid[0], out);
+        strbuf_addch(out, ')');
+        break;
+    case SYNTH_STAR:
+        render_node(node->kid[0], out);
+        strbuf_addch(out, '*');
+        break;
+    case SYNTH_PLUS:
+        render_node(node->kid[0], out);
+        strbuf_addch(out, '+');
+        break;
+    case SYNTH_OPTIONAL:
+        render_node(node->kid[0], out);
+        strbuf_addch(out, '?');
+        break;
+    case SYNTH_MIN_MAX:
+        render_node(node->kid[0], out);
+        strbuf_addf(out, "{%d,%d}", node->min, node->max);
+        break;
+    }
+}
+
+static struct synth_node *new_node(enum synth_node_type type)
+{
+    struct synth_node *node = xcalloc(1, sizeof(*node));
+
+    node->type = type;
+    return node;
+}
+
+static struct synth_node *random_leaf(struct synth_rng *rng, const struct synth_terminals *t)
+{
+    struct synth_node *node;
+    int i, nr;
+
+    if (rng_below(rng, 10) < 7) {
+        node = new_node(SYNTH_LITERAL);
+        node->text = xstrdup(t->literals.items[rng_below(rng, t->literals.nr)].string);
+        return node;
+    }
+
+    node = new_node(SYNTH_LIST);
+    {
+        struct strbuf buf = STRBUF_INIT;
+
+        strbuf_addch(&buf, '[');
+        if (rng_below(rng, 10) < 3)
+            strbuf_addch(&buf, '^');
+        nr = 1 + rng_below(rng, 3);
+        for (i = 0; i < nr; i++)
+            strbuf_addstr(&buf, t->list_items.items[rng_below(rng, t->list_items.nr)].string);
+        strbuf_addch(&buf, ']');
+        node->text = strbuf_detach(&buf, NULL);
+    }
+    return node;
+}
+
+/* "grow" picks a leaf before the depth is reached now and then */
+static struct synth_node *random_tree(struct synth_rng *rng, const struct synth_terminals *t,
+                                      int depth, int grow)
+{
+    static const enum synth_node_type functions[] = {
+        SYNTH_CONCAT, SYNTH_CONCAT, SYNTH_CONCAT, SYNTH_GROUP,
+        SYNTH_STAR, SYNTH_PLUS, SYNTH_OPTIONAL, SYNTH_MIN_MAX
+    };
+    struct synth_node *node;
+
+    if (depth <= 1 || (grow && rng_below(rng, 10) < 3))
+        return random_leaf(rng, t);
+
+    node = new_node(functions[rng_below(rng, ARRAY_SIZE(functions))]);
+    if (node->type == SYNTH_CONCAT) {
+        node->kid[0] = random_tree(rng, t, depth - 1, grow);
+        node->kid[1] = random_tree(rng, t, depth - 1, grow);
+    } else if (node->type == SYNTH_GROUP) {
+        node->kid[0] = random_tree(rng, t, depth - 1, grow);
+    } else if (depth > 2 && rng_below(rng, 2)) {
+        node->kid[0] = new_node(SYNTH_GROUP);
+        node->kid[0]->kid[0] = random_tree(rng, t, depth - 2, grow);
+    } else {
+        node->kid[0] = random_leaf(rng, t);
+    }
+    if (node->type == SYNTH_MIN_MAX) {
+        node->min = rng_below(rng, 3);
+        node->max = node->min + 1 + rng_below(rng, 3);
+    }
+    return node;
+}
+
+/*
+ * The part of "example" that changes: what is left without the prefix
+ * and the suffix it shares with its resolution, or with them cut at
+ * word boundaries instead when "words" is set.  What an insertion
+ * changes is made the character before (or after) it, so that the
+ * regex has something to match.  Return 0 if nothing changes.
+ */
+struct changed_span {
+    const char *a, *b;      /* in the conflict and in the resolution */
+    size_t a_len, b_len;
+};
+
+static int find_changed_span(const struct synth_example *example, int words,
+                             struct changed_span *span)
+{
+    const char *a = example->conflict, *b = example->resolution;
+    size_t a_len = strlen(a), b_len = strlen(b), start = 0, end = 0;
+
+    while (start < a_len && start < b_len && a[start] == b[start])
+        start++;
+    while (end < a_len - start && end < b_len - start &&
+           a[a_len - end - 1] == b[b_len - end - 1])
+        end++;
+    if (words) {
+        while (start && is_word_char(a[start - 1]))
+            start--;
+        while (end && is_word_char(a[a_len - end]))
+            end--;
+    }
+    if (start + end == a_len) {
+        if (start)
+            start--;
+        else if (end)
+            end--;
+        else
+            return 0;
+    }
+    span->a = a + start;
+    span->a_len = a_len - start - end;
+    span->b = b + start;
+    span->b_len = b_len - start - end;
+    return 1;
+}
+
+static struct synth_node *concat_nodes(struct synth_node *left, struct synth_node *right)
+{
+    struct synth_node *node;
+
+    if (!left)
+        return right;
+    node = new_node(SYNTH_CONCAT);
+    node->kid[0] = left;
+    node->kid[1] = right;
+    return node;
+}
+
+static void add_seed(struct synth_terminals *t, struct synth_node *regex,
+                     const char *replacement)
+{
+    struct strbuf rendered = STRBUF_INIT, other = STRBUF_INIT;
+    int i;
+
+    render_node(regex, &rendered);
+    for (i = 0; i < t->nr_seeds; i++) {
+        strbuf_reset(&other);
+        render_node(t->seeds[i].regex, &other);
+        if (t->seeds[i].replacement == replacement && !strcmp(rendered.buf, other.buf))
+            break;
+    }
+    if (i < t->nr_seeds) {
+        free_node(regex);
+    } else {
+        ALLOC_GROW(t->seeds, t->nr_seeds + 1, t->alloc_seeds);
+        t->seeds[t->nr_seeds].regex = regex;
+        t->seeds[t->nr_seeds++].replacement = replacement;
+    }
+    strbuf_release(&rendered);
+    strbuf_release(&other);
+}
+
+static void add_literal_seed(struct synth_terminals *t, const struct changed_span *span)
+{
+    struct synth_node *regex = new_node(SYNTH_LITERAL);
+
+    regex->text = xstrdup(add_regex_literal(&t->literals, span->a, span->a_len));
+    add_seed(t, regex, add_replacement_token(&t->tokens, span->b, span->b_len));
+}
+
+/*
+ * The words of the changed part become "([A-Za-z0-9_]+)" groups, and
+ * the words of the resolution that are one of them references to it.
+ */
+static void add_group_seed(struct synth_terminals *t, const struct changed_span *span)
+{
+    struct strbuf replacement = STRBUF_INIT, buf = STRBUF_INIT;
+    const char *word[SYNTH_MAX_GROUPS];
+    size_t word_len[SYNTH_MAX_GROUPS], len;
+    struct synth_node *regex = NULL;
+    const char *p, *end;
+    int groups = 0, i;
+
+    for (p = span->a, end = p + span->a_len; p < end; p += len) {
+        struct synth_node *node;
+
+        for (len = 0; p + len < end && is_word_char(p[len]); len++)
+            ;
+        if (len && groups < SYNTH_MAX_GROUPS) {
+            struct synth_node *plus = new_node(SYNTH_PLUS);
+
+            plus->kid[0] = new_node(SYNTH_LIST);
+            plus->kid[0]->text = xstrdup("[A-Za-z0-9_]");
+            node = new_node(SYNTH_GROUP);
+            node->kid[0] = plus;
+            regex = concat_nodes(regex, node);
+            word[groups] = p;
+            word_len[groups++] = len;
+            continue;
+        }
+        if (!len)
+            while (p + len < end && !is_word_char(p[len]))
+                len++;
+        strbuf_reset(&buf);
+        escape_regex(&buf, p, len);
+        node = new_node(SYNTH_LITERAL);
+        node->text = xstrdup(buf.buf);
+        regex = concat_nodes(regex, node);
+    }
+    if (!groups) {
+        free_node(regex);
+        strbuf_release(&buf);
+        return;
+    }
+
+    for (p = span->b, end = p + span->b_len; p < end; p += len) {
+        for (len = 0; p + len < end && is_word_char(p[len]); len++)
+            ;
+        for (i = 0; len && i < groups; i++)
+            if (word_len[i] == len && !memcmp(word[i], p, len))
+                break;
+        if (len && i < groups) {
+            strbuf_addf(&replacement, "$%d", i + 1);
+            continue;
+        }
+        if (!len)
+            len = 1;
+        escape_replacement(&replacement, p, len);
+    }
+    add_seed(t, regex, intern(&t->tokens, replacement.buf));
+    strbuf_release(&replacement);
+    strbuf_release(&buf);
+}
+
+static void init_seeds(struct synth_terminals *t, const struct synth_cluster *cluster)
+{
+    struct changed_span span;
+    int i;
+
+    for (i = 0; i < cluster->nr; i++) {
+        if (find_changed_span(&cluster->examples[i], 0, &span))
+            add_literal_seed(t, &span);
+        if (find_changed_span(&cluster->examples[i], 1, &span)) {
+            add_literal_seed(t, &span);
+            add_group_seed(t, &span);
+        }
+    }
+}
+
+static void clear_seeds(struct synth_terminals *t)
+{
+    int i;
+
+    for (i = 0; i < t->nr_seeds; i++)
+        free_node(t->seeds[i].regex);
+    FREE_AND_NULL(t->seeds);
+    t->nr_seeds = t->alloc_seeds = 0;
+}
+
+struct synth_individual {
+    struct synth_node *regex;
+    const char *tokens[SYNTH_MAX_TOKENS];   /* owned by the terminals */
+    int nr_tokens;
+    char *rendered;     /* regex, NUL, replacement */
+    size_t rendered_len;
+    unsigned long distance;
+    size_t complexity;
+};
+
+static const char *individual_replacement(const struct synth_individual *ind)
+{
+    return ind->rendered + strlen(ind->rendered) + 1;
+}
+
+static void render_individual(struct synth_individual *ind)
+{
+    struct strbuf buf = STRBUF_INIT;
+    int i;
+
+    render_node(ind->regex, &buf);
+    strbuf_addch(&buf, '\0');
+    for (i = 0; i < ind->nr_tokens; i++)
+        strbuf_addstr(&buf, ind->tokens[i]);
+    free(ind->rendered);
+    ind->rendered_len = buf.len;
+    ind->rendered = strbuf_detach(&buf, NULL);
+    ind->complexity = ind->rendered_len - 1;
+}
+
+static void copy_individual(struct synth_individual *dst, const struct synth_individual *src)
+{
+    *dst = *src;
+    dst->regex = copy_node(src->regex);
+    dst->rendered = xmemdupz(src->rendered, src->rendered_len);
+}
+
+static void clear_individual(struct synth_individual *ind)
+{
+    free_node(ind->regex);
+    free(ind->rendered);
+    memset(ind, 0, sizeof(*ind));
+}
+
+/* lower distance first, then the simpler rule, then any fixed order */
+static int compare_individuals(const struct synth_individual *a, const struct synth_individual *b)
+{
+    size_t len;
+
+    if (a->distance != b->distance)
+        return a->distance < b->distance ? -1 : 1;
+    if (a->complexity != b->complexity)
+        return a->complexity < b->complexity ? -1 : 1;
+    len = a->rendered_len < b->rendered_len ? a->rendered_len : b->rendered_len;
+    return memcmp(a->rendered, b->rendered, len + 1);
+}
+
+static int individual_cmp(const void *a, const void *b)
+{
+    return compare_individuals(a, b);
+}
+
+/*
+ * The distance of an individual on an example, by the rendered rule
+ * and the example number; the same rule comes up over and over in a
+ * population (elites, clones, crossovers that change nothing).
+ */
+struct fitness_entry {
+    struct hashmap_entry ent;
+    const char *rule;   /* regex, NUL, replacement */
+    size_t len;
+    int example;
+    unsigned long distance;
+};
+
+static int fitness_entry_cmp(const void *unused_cmp_data,
+                             const void *entry, const void *entry_or_key,
+                             const void *unused_keydata)
+{
+    const struct fitness_entry *a = entry, *b = entry_or_key;
+
+    return a->example != b->example || a->len != b->len ||
+        memcmp(a->rule, b->rule, a->len);
+}
+
+struct synth_run {
+    const struct synth_cluster *cluster;
+    const struct synth_terminals *terminals;
+    const struct synth_options *opts;
+    struct synth_rng rng;
+    struct hashmap fitness;
+    struct synth_individual best;
+};
+
+/*
+ * Java's replaceAll(): "$n" is group n, a backslash quotes the next
+ * character.  Return -1 when the rule does not apply to "text", as
+ * when it names a group the regex does not have.
+ */
+static int add_replacement(struct strbuf *out, const char *replacement,
+                           const char *text, const regmatch_t *match, size_t groups)
+{
+    const char *p;
+
+    for (p = replacement; *p; p++) {
+        if (*p == '\\' && p[1]) {
+            strbuf_addch(out, *++p);
+        } else if (*p == '$' && isdigit(p[1])) {
+            size_t group = *++p - '0';
+
+            if (group > groups)
+                return -1;
+            if (match[group].rm_so >= 0)
+                strbuf_add(out, text + match[group].rm_so,
+                           match[group].rm_eo - match[group].rm_so);
+        } else {
+            strbuf_addch(out, *p);
+        }
+    }
+    return 0;
+}
+
+static int apply_rule(const regex_t *regex, const char *replacement,
+                      const char *text, struct strbuf *out)
+{
+    regmatch_t match[SYNTH_MAX_GROUPS + 1];
+    size_t limit = 4 * strlen(text) + 256;
+    const char *p = text;
+    int flags = 0;
+
+    strbuf_reset(out);
+    while (!regexec(regex, p, ARRAY_SIZE(match), match, flags)) {
+        strbuf_add(out, p, match[0].rm_so);
+        if (add_replacement(out, replacement, p, match, regex->re_nsub) < 0 ||
+            out->len > limit)
+            return -1;
+        p += match[0].rm_eo;
+        if (match[0].rm_eo == match[0].rm_so) {
+            /* an empty match: step over one character */
+            if (!*p)
+                break;
+            strbuf_addch(out, *p++);
+        }
+        flags = REG_NOTBOL;
+    }
+    strbuf_addstr(out, p);
+    return 0;
+}
+
+static unsigned long example_distance(const char *result, const char *resolution)
+{
+    return levenshtein(result, resolution, 1, 1, 1, 1);
+}
+
+static void evaluate(struct synth_run *run, struct synth_individual *ind)
+{
+    const struct synth_cluster *cluster = run->cluster;
+    struct strbuf result = STRBUF_INIT;
+    regex_t regex;
+    int compiled = 0, invalid = 0, i;
+    unsigned int rule_hash;
+
+    render_individual(ind);
+    rule_hash = memhash(ind->rendered, ind->rendered_len);
+    ind->distance = 0;
+    for (i = 0; i < cluster->nr && !invalid; i++) {
+        struct fitness_entry key, *e;
+
+        hashmap_entry_init(&key, rule_hash ^ (i * 0x9e3779b9U));
+        key.rule = ind->rendered;
+        key.len = ind->rendered_len;
+        key.example = i;
+        e = hashmap_get(&run->fitness, &key, NULL);
+        if (!e) {
+            unsigned long distance = SYNTH_WORST;
+
+            if (!compiled) {
+                compiled = regcomp(&regex, ind->rendered, REG_EXTENDED) ? -1 : 1;
+                if (compiled > 0 && regex.re_nsub > SYNTH_MAX_GROUPS)
+                    compiled = -1;
+            }
+            if (compiled > 0 &&
+                !apply_rule(&regex, individual_replacement(ind),
+                            cluster->examples[i].conflict, &result))
+                distance = example_distance(result.buf, cluster->examples[i].resolution);
+
+            e = xmalloc(sizeof(*e));
+            e->ent = key.ent;
+            e->rule = xmemdupz(ind->rendered, ind->rendered_len);
+            e->len = ind->rendered_len;
+            e->example = i;
+            e->distance = distance;
+            hashmap_add(&run->fitness, e);
+        }
+        if (e->distance == SYNTH_WORST)
+            invalid = 1;
+        else
+            ind->distance += e->distance;
+    }
+    if (invalid)
+        ind->distance = SYNTH_WORST;
+    if (compiled)
+        regfree(&regex);
+    strbuf_release(&result);
+}
+
+static void random_tokens(struct synth_run *run, struct synth_individual *ind)
+{
+    const struct string_list *tokens = &run->terminals->tokens;
+    int i;
+
+    ind->nr_tokens = 1 + rng_below(&run->rng, 4);
+    for (i = 0; i < ind->nr_tokens; i++)
+        ind->tokens[i] = tokens->items[rng_below(&run->rng, tokens->nr)].string;
+}
+
+/* replace a subtree with a new one, if the result is still a valid regex */
+static void mutate_regex(struct synth_run *run, struct synth_individual *ind)
+{
+    struct synth_node *old = ind->regex, *subtree;
+    struct synth_node **slot;
+    int n, groups = 0;
+
+    ind->regex = copy_node(old);
+    n = rng_below(&run->rng, node_count(ind->regex));
+    slot = nth_slot(&ind->regex, &n);
+    subtree = random_tree(&run->rng, run->terminals, 3, 1);
+    free_node(*slot);
+    *slot = subtree;
+    if (node_depth(ind->regex) > run->opts->max_depth ||
+        !node_valid(ind->regex, &groups)) {
+        free_node(ind->regex);
+        ind->regex = old;
+    } else {
+        free_node(old);
+    }
+}
+
+static void mutate_tokens(struct synth_run *run, struct synth_individual *ind)
+{
+    const struct string_list *tokens = &run->terminals->tokens;
+    const char *token = tokens->items[rng_below(&run->rng, tokens->nr)].string;
+    int pos = rng_below(&run->rng, ind->nr_tokens);
+
+    switch (rng_below(&run->rng, 3)) {
+    case 0:
+        ind->tokens[pos] = token;
+        break;
+    case 1:
+        if (ind->nr_tokens < SYNTH_MAX_TOKENS) {
+            MOVE_ARRAY(ind->tokens + pos + 1, ind->tokens + pos, ind->nr_tokens - pos);
+            ind->tokens[pos] = token;
+            ind->nr_tokens++;
+        }
+        break;
+    default:
+        if (ind->nr_tokens > 1) {
+            MOVE_ARRAY(ind->tokens + pos, ind->tokens + pos + 1, ind->nr_tokens - pos - 1);
+            ind->nr_tokens--;
+        }
+        break;
+    }
+}
+
+/*
+ * Subtree crossover for the regex, one point crossover for the
+ * replacement; "child" starts as a copy of "a" and is left alone where
+ * the crossover makes an invalid or too deep regex.
+ */
+static void crossover(struct synth_run *run, struct synth_individual *child,
+                      const struct synth_individual *b)
+{
+    struct synth_node *other = copy_node(b->regex), *keep = copy_node(child->regex);
+    struct synth_node **slot_a, **slot_b, *swap;
+    int n, groups = 0, cut_a, cut_b;
+
+    n = rng_below(&run->rng, node_count(child->regex));
+    slot_a = nth_slot(&child->regex, &n);
+    n = rng_below(&run->rng, node_count(other));
+    slot_b = nth_slot(&other, &n);
+    swap = *slot_a;
+    *slot_a = *slot_b;
+    *slot_b = swap;
+    free_node(other);
+    if (node_depth(child->regex) > run->opts->max_depth ||
+        !node_valid(child->regex, &groups)) {
+        free_node(child->regex);
+        child->regex = keep;
+    } else {
+        free_node(keep);
+    }
+
+    cut_a = rng_below(&run->rng, child->nr_tokens + 1);
+    cut_b = rng_below(&run->rng, b->nr_tokens + 1);
+    if (cut_a + b->nr_tokens - cut_b > 0 &&
+        cut_a + b->nr_tokens - cut_b <= SYNTH_MAX_TOKENS) {
+        COPY_ARRAY(child->tokens + cut_a, b->tokens + cut_b, b->nr_tokens - cut_b);
+        child->nr_tokens = cut_a + b->nr_tokens - cut_b;
+    }
+}
+
+static const struct synth_individual *tournament(struct synth_run *run,
+                                                 const struct synth_individual *population,
+                                                 int nr)
+{
+    const struct synth_individual *winner = NULL;
+    int i;
+
+    for (i = 0; i < run->opts->tournament || !winner; i++) {
+        const struct synth_individual *ind = &population[rng_below(&run->rng, nr)];
+
+        if (!winner || compare_individuals(ind, winner) < 0)
+            winner = ind;
+    }
+    return winner;
+}
+
+static void evolve(struct synth_run *run)
+{
+    const struct synth_options *opts = run->opts;
+    int nr = opts->population, elitism = opts->elitism;
+    struct synth_individual *population, *next;
+    int generation, i;
+
+    if (elitism > nr)
+        elitism = nr;
+    CALLOC_ARRAY(population, nr);
+    CALLOC_ARRAY(next, nr);
+
+    for (i = 0; i < run->terminals->nr_seeds && i < nr / 2; i++) {
+        const struct synth_seed *seed = &run->terminals->seeds[i];
+
+        population[i].regex = copy_node(seed->regex);
+        population[i].tokens[0] = seed->replacement;
+        population[i].nr_tokens = 1;
+        evaluate(run, &population[i]);
+    }
+
+    /* the others, ramped half-and-half */
+    for (; i < nr; i++) {
+        int depth = 2 + i % max_int(opts->max_creation_depth - 1, 1);
+
+        for (;;) {
+            int groups = 0;
+
+            population[i].regex = random_tree(&run->rng, run->terminals, depth, i & 1);
+            if (node_valid(population[i].regex, &groups))
+                break;
+            free_node(population[i].regex);
+        }
+        random_tokens(run, &population[i]);
+        evaluate(run, &population[i]);
+    }
+    QSORT(population, nr, individual_cmp);
+
+    for (generation = 0; generation < opts->generations; generation++) {
+        if (!population[0].distance)
+            break;
+        for (i = 0; i < elitism; i++)
+            copy_individual(&next[i], &population[i]);
+        for (; i < nr; i++) {
+            copy_individual(&next[i], tournament(run, population, nr));
+            if (rng_unit(&run->rng) < opts->crossover)
+                crossover(run, &next[i], tournament(run, population, nr));
+            if (rng_unit(&run->rng) < opts->mutation)
+                mutate_regex(run, &next[i]);
+            if (rng_unit(&run->rng) < opts->mutation)
+                mutate_tokens(run, &next[i]);
+            evaluate(run, &next[i]);
+        }
+        for (i = 0; i < nr; i++)
+            clear_individual(&population[i]);
+        SWAP(population, next);
+        QSORT(population, nr, individual_cmp);
+    }
+
+    copy_individual(&run->best, &population[0]);
+    for (i = 0; i < nr; i++)
+        clear_individual(&population[i]);
+    free(population);
+    free(next);
+}
+
+static void run_job(struct synth_run *run, const struct synth_cluster *cluster,
+                    const struct synth_terminals *terminals,
+                    const struct synth_options *opts, int job)
+{
+    run->cluster = cluster;
+    run->terminals = terminals;
+    run->opts = opts;
+    run->rng.state = opts->seed + job;
+    hashmap_init(&run->fitness, fitness_entry_cmp, NULL, 0);
+    evolve(run);
+    {
+        struct hashmap_iter iter;
+        struct fitness_entry *e;
+
+        hashmap_iter_init(&run->fitness, &iter);
+        while ((e = hashmap_iter_next(&iter)))
+            free((char *)e->rule);
+    }
+    hashmap_free(&run->fitness, 1);
+}
+
+/*
+ * The runs (every job of every cluster) are dealt to the threads up
+ * front; a thread takes its own runs from the back of its deque, and
+ * once it is out of them steals from the front of the others'.
+ */
+struct synth_deque {
+    pthread_mutex_t mutex;
+    int *runs;
+    int front, back;
+};
+
+struct synth_pool {
+    struct synth_cluster *clusters;
+    struct synth_terminals *terminals;
+    const struct synth_options *opts;
+    struct synth_run *runs;
+    int nr_runs;
+    struct synth_deque *deques;
+    int nr_threads;
+};
+
+struct synth_worker {
+    struct synth_pool *pool;
+    int self;
+    pthread_t thread;
+};
+
+static int take_run(struct synth_pool *pool, int self)
+{
+    int i, run = -1;
+
+    for (i = 0; run < 0 && i < pool->nr_threads; i++) {
+        struct synth_deque *deque = &pool->deques[(self + i) % pool->nr_threads];
+
+        pthread_mutex_lock(&deque->mutex);
+        if (deque->front < deque->back)
+            run = i ? deque->runs[deque->front++] : deque->runs[--deque->back];
+        pthread_mutex_unlock(&deque->mutex);
+    }
+    return run;
+}
+
+static void *synth_worker(void *data)
+{
+    struct synth_worker *worker = data;
+    struct synth_pool *pool = worker->pool;
+    int run;
+
+    while ((run = take_run(pool, worker->self)) >= 0) {
+        int cluster = run / pool->opts->jobs;
+
+        run_job(&pool->runs[run], &pool->clusters[cluster],
+                &pool->terminals[cluster], pool->opts, run % pool->opts->jobs);
+    }
+    return NULL;
+}
+
+static unsigned long identity_distance(const struct synth_cluster *cluster)
+{
+    unsigned long distance = 0;
+    int i;
+
+    for (i = 0; i < cluster->nr; i++)
+        distance += example_distance(cluster->examples[i].conflict,
+                                     cluster->examples[i].resolution);
+    return distance;
+}
+
+void synthesize_rules(struct synth_cluster *clusters, int nr,
+                      const struct synth_options *options)
+{
+    struct synth_options opts = *options;
+    struct synth_pool pool;
+    struct synth_worker *workers;
+    int i, j;
+
+    opts.jobs = max_int(opts.jobs, 1);
+    opts.population = max_int(opts.population, 2);
+    opts.tournament = max_int(opts.tournament, 1);
+    opts.max_creation_depth = max_int(opts.max_creation_depth, 2);
+    opts.max_depth = max_int(opts.max_depth, opts.max_creation_depth);
+
+    memset(&pool, 0, sizeof(pool));
+    pool.clusters = clusters;
+    pool.opts = &opts;
+    pool.nr_runs = nr * opts.jobs;
+    pool.nr_threads = HAVE_THREADS ? max_int(opts.threads, 1) : 1;
+    if (pool.nr_threads > pool.nr_runs)
+        pool.nr_threads = max_int(pool.nr_runs, 1);
+    CALLOC_ARRAY(pool.terminals, nr);
+    CALLOC_ARRAY(pool.runs, pool.nr_runs);
+    CALLOC_ARRAY(pool.deques, pool.nr_threads);
+    CALLOC_ARRAY(workers, pool.nr_threads);
+
+    for (i = 0; i < nr; i++) {
+        clusters[i].regex = clusters[i].replacement = NULL;
+        clusters[i].distance = identity_distance(&clusters[i]);
+        init_terminals(&pool.terminals[i], &clusters[i], &opts);
+        init_seeds(&pool.terminals[i], &clusters[i]);
+    }
+    for (i = 0; i < pool.nr_threads; i++) {
+        pthread_mutex_init(&pool.deques[i].mutex, NULL);
+        ALLOC_ARRAY(pool.deques[i].runs, pool.nr_runs / pool.nr_threads + 1);
+    }
+    for (i = 0; i < pool.nr_runs; i++) {
+        struct synth_deque *deque = &pool.deques[i % pool.nr_threads];
+
+        deque->runs[deque->back++] = i;
+    }
+
+    for (i = 0; i < pool.nr_threads; i++) {
+        workers[i].pool = &pool;
+        workers[i].self = i;
+    }
+    if (!HAVE_THREADS) {
+        synth_worker(&workers[0]);
+    } else {
+        for (i = 0; i < pool.nr_threads; i++)
+            if (pthread_create(&workers[i].thread, NULL, synth_worker, &workers[i]))
+                die(_("unable to create synthesis thread"));
+        for (i = 0; i < pool.nr_threads; i++)
+            pthread_join(workers[i].thread, NULL);
+    }
+
+    /* the best run of every cluster, the first job winning a tie */
+    for (i = 0; i < nr; i++) {
+        const struct synth_individual *best = NULL;
+
+        for (j = 0; j < opts.jobs; j++) {
+            const struct synth_individual *ind = &pool.runs[i * opts.jobs + j].best;
+
+            if (!best || compare_individuals(ind, best) < 0)
+                best = ind;
+        }
+        if (best && best->distance < clusters[i].distance) {
+            clusters[i].regex = xstrdup(best->rendered);
+            clusters[i].replacement = xstrdup(individual_replacement(best));
+            clusters[i].distance = best->distance;
+        }
+        clear_seeds(&pool.terminals[i]);
+        clear_terminals(&pool.terminals[i]);
+    }
+
+    for (i = 0; i < pool.nr_runs; i++)
+        clear_individual(&pool.runs[i].best);
+    for (i = 0; i < pool.nr_threads; i++) {
+        pthread_mutex_destroy(&pool.deques[i].mutex);
+        free(pool.deques[i].runs);
+    }
+    free(pool.terminals);
+    free(pool.runs);
+    free(pool.deques);
+    free(workers);
+}
+
+void clear_synth_cluster(struct synth_cluster *cluster)
+{
+    FREE_AND_NULL(cluster->regex);
+    FREE_AND_NULL(cluster->replacement);
+}
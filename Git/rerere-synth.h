@@ -0,0 +1,59 @@
+#ifndef RERERE_SYNTH_H
+#define RERERE_SYNTH_H
+
+/*
+ * Learn, for each cluster of (conflict, resolution) examples, a regex
+ * and a replacement that turn the conflicts into their resolutions.
+ * This is the genetic-programming search RandomSearchReplaceTurtle.jar
+ * does, run natively: regexes are trees of constants, character lists,
+ * groups and quantifiers, every cluster gets "jobs" independent runs
+ * and the best of them wins.
+ */
+
+struct synth_example {
+    const char *conflict;
+    const char *resolution;
+};
+
+struct synth_cluster {
+    const char *name;
+    struct synth_example *examples;
+    int nr;
+    /*
+     * Filled by synthesize_rules(); both NULL when no rule does
+     * better on the examples than leaving the conflicts alone.
+     */
+    char *regex;
+    char *replacement;
+    unsigned long distance; /* edit distance left on the examples */
+};
+
+struct synth_options {
+    unsigned long seed;
+    int jobs;
+    int threads;
+    int generations;
+    int population;
+    int tournament;
+    int elitism;
+    int max_creation_depth;
+    int max_depth;              /* of a tree made by crossover */
+    double crossover;
+    double mutation;
+    const char **constants;     /* NULL terminated; NULL for the defaults */
+    const char **ranges;
+};
+
+/* the values of the example configuration of the jar */
+#define SYNTH_OPTIONS_INIT { 0, 4, 2, 30, 500, 5, 1, 7, 15, 0.8, 0.1, NULL, NULL }
+
+/*
+ * The result only depends on the examples and the options, not on how
+ * the runs were scheduled on the threads.
+ */
+void synthesize_rules(struct synth_cluster *clusters, int nr,
+                      const struct synth_options *opts);
+
+void clear_synth_cluster(struct synth_cluster *cluster);
+
+#endif
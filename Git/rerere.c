@@ -6,12 +6,19 @@
 #include "xdiff-interface.h"
 #include "dir.h"
 #include "resolve-undo.h"
+#include "cache-tree.h"
 #include "ll-merge.h"
 #include "attr.h"
 #include "pathspec.h"
 #include "object-store.h"
 #include "sha1-lookup.h"
+#include "run-command.h"
+#include "oidset.h"
+#include "kwset.h"
+#include "argv-array.h"
+#include "rerere-synth.h"
 #include "json.h"
+#include "unix-socket.h"
 
 #define RESOLVED 0
 #define PUNTED 1
@@ -30,8 +37,6 @@ static int rerere_autoupdate;
 static int rerere_dir_nr;
 static int rerere_dir_alloc;
 
-struct string_list groupId_list = STRING_LIST_INIT_NODUP; // list of json groupId that has been changed
-
 #define RR_HAS_POSTIMAGE 1
 #define RR_HAS_PREIMAGE 2
 static struct rerere_dir {
@@ -40,12 +45,6 @@ static struct rerere_dir {
     unsigned char *status;
 } **rerere_dir;
 
-struct list {
-    char conflict[2000];
-    char resolution[2000];
-    struct list *next;
-};
-
 static void free_rerere_dirs(void)
 {
     int i;
@@ -210,13 +209,170 @@ static struct rerere_id *new_rerere_id(unsigned char *sha1)
  * used to keep track of the set of paths that "rerere" may need to
  * work on (i.e. what is left by the previous invocation of "git
  * rerere" during the current conflict resolution session).
+ *
+ * $GIT_DIR/MERGE_RR_STAT extends it with the stat data each path had
+ * when it was last examined, as "conflict ID", SP, "ctime ctime-nsec
+ * mtime mtime-nsec dev ino uid gid size", a HT and pathname, terminated
+ * with a NUL, so that a path that did not change since is not read and
+ * hashed again.  A record whose conflict ID is not the one in MERGE_RR
+ * is ignored and, like for the index, so is the stat data of a path
+ * modified in the same second as the file was written.
+ */
+static GIT_PATH_FUNC(git_path_merge_rr_stat, "MERGE_RR_STAT")
+
+struct merge_rr_stat {
+    struct stat_data sd;
+    char id[GIT_MAX_HEXSZ + 16]; /* with the variant */
+};
+static struct string_list merge_rr_stat = STRING_LIST_INIT_DUP;
+static struct stat_data merge_rr_stamp;
+
+static const char *parse_merge_rr_stat(const char *p, struct stat_data *sd)
+{
+    unsigned long v[9];
+    char *end;
+    int i;
+
+    for (i = 0; i < ARRAY_SIZE(v); i++) {
+        if (*p != ' ')
+            return NULL;
+        errno = 0;
+        v[i] = strtoul(p + 1, &end, 10);
+        if (errno || end == p + 1)
+            return NULL;
+        p = end;
+    }
+    sd->sd_ctime.sec = v[0];
+    sd->sd_ctime.nsec = v[1];
+    sd->sd_mtime.sec = v[2];
+    sd->sd_mtime.nsec = v[3];
+    sd->sd_dev = v[4];
+    sd->sd_ino = v[5];
+    sd->sd_uid = v[6];
+    sd->sd_gid = v[7];
+    sd->sd_size = v[8];
+    return p;
+}
+
+static void format_merge_rr_id(char *buf, size_t len, struct rerere_id *id)
+{
+    if (0 < id->variant)
+        xsnprintf(buf, len, "%s.%d", rerere_id_hex(id), id->variant);
+    else
+        xsnprintf(buf, len, "%s", rerere_id_hex(id));
+}
+
+static void read_merge_rr_stat(void)
+{
+    struct strbuf buf = STRBUF_INIT;
+    struct stat st;
+    FILE *in;
+
+    string_list_clear(&merge_rr_stat, 1);
+    in = fopen(git_path_merge_rr_stat(), "r");
+    if (!in)
+        return;
+    if (!fstat(fileno(in), &st))
+        fill_stat_data(&merge_rr_stamp, &st);
+    while (!strbuf_getwholeline(&buf, in, '\0')) {
+        struct merge_rr_stat stat;
+        const char *p;
+        size_t idlen = strcspn(buf.buf, " ");
+
+        if (idlen >= sizeof(stat.id))
+            continue;
+        memcpy(stat.id, buf.buf, idlen);
+        stat.id[idlen] = '\0';
+        p = parse_merge_rr_stat(buf.buf + idlen, &stat.sd);
+        if (!p || *p != '\t')
+            continue;
+        string_list_insert(&merge_rr_stat, p + 1)->util = xmemdupz(&stat, sizeof(stat));
+    }
+    strbuf_release(&buf);
+    fclose(in);
+}
+
+static void write_merge_rr_stat(struct string_list *rr)
+{
+    struct strbuf buf = STRBUF_INIT;
+    int i;
+
+    for (i = 0; i < rr->nr; i++) {
+        struct string_list_item *item;
+        struct merge_rr_stat *stat;
+        char id[GIT_MAX_HEXSZ + 16];
+
+        if (!rr->items[i].util ||
+            !(item = string_list_lookup(&merge_rr_stat, rr->items[i].string)))
+            continue;
+        stat = item->util;
+        format_merge_rr_id(id, sizeof(id), rr->items[i].util);
+        /* examined before the conflict ID was known */
+        if (*stat->id && strcmp(stat->id, id))
+            continue;
+        strbuf_addf(&buf, "%s %u %u %u %u %u %u %u %u %u\t%s%c", id,
+                    stat->sd.sd_ctime.sec, stat->sd.sd_ctime.nsec,
+                    stat->sd.sd_mtime.sec, stat->sd.sd_mtime.nsec,
+                    stat->sd.sd_dev, stat->sd.sd_ino, stat->sd.sd_uid,
+                    stat->sd.sd_gid, stat->sd.sd_size,
+                    rr->items[i].string, 0);
+    }
+    if (buf.len)
+        write_file_buf(git_path_merge_rr_stat(), buf.buf, buf.len);
+    else
+        unlink(git_path_merge_rr_stat());
+    strbuf_release(&buf);
+}
+
+/* the stat data of "path" before it is examined */
+static void remember_merge_rr_stat(const char *path)
+{
+    struct stat st;
+    struct string_list_item *item;
+
+    if (lstat(path, &st))
+        return;
+    item = string_list_insert(&merge_rr_stat, path);
+    free(item->util);
+    item->util = xcalloc(1, sizeof(struct merge_rr_stat));
+    fill_stat_data(item->util, &st);
+}
+
+/*
+ * Whether "path" is still the file a previous invocation examined and
+ * left for the user to resolve.
  */
+static int merge_rr_unchanged(struct string_list *rr, const char *path)
+{
+    struct string_list_item *item = string_list_lookup(&merge_rr_stat, path);
+    struct string_list_item *rr_item = string_list_lookup(rr, path);
+    struct merge_rr_stat *stat;
+    struct stat_data *sd;
+    char id[GIT_MAX_HEXSZ + 16];
+    struct stat st;
+
+    if (!item || !rr_item || !rr_item->util || lstat(path, &st))
+        return 0;
+    stat = item->util;
+    sd = &stat->sd;
+    format_merge_rr_id(id, sizeof(id), rr_item->util);
+    if (strcmp(stat->id, id) || match_stat_data(sd, &st))
+        return 0;
+    /* racily clean, as for the index */
+    if (sd->sd_mtime.sec > merge_rr_stamp.sd_mtime.sec ||
+        (sd->sd_mtime.sec == merge_rr_stamp.sd_mtime.sec &&
+         sd->sd_mtime.nsec >= merge_rr_stamp.sd_mtime.nsec))
+        return 0;
+    return 1;
+}
+
 static void read_rr(struct repository *r, struct string_list *rr)
 {
     //fprintf_ln(stderr, _("LOG_ENTER: read_rr function"));
     struct strbuf buf = STRBUF_INIT;
     FILE *in = fopen_or_warn(git_path_merge_rr(r), "r");
 
+    read_merge_rr_stat();
     if (!in)
         return;
     while (!strbuf_getwholeline(&buf, in, '\0')) {
@@ -284,6 +440,7 @@ static int write_rr(struct string_list *rr, int out_fd)
     }
     if (commit_lock_file(&write_lock) != 0)
         die(_("unable to write rerere record"));
+    write_merge_rr_stat(rr);
     return 0;
 }
 
@@ -377,22 +534,105 @@ static void rerere_strbuf_putconflict(struct strbuf *buf, int ch, size_t size)
     strbuf_addch(buf, '\n');
 }
 
-static char* remove_spaces(char *s)
+/*
+ * The line matchers compare lines ignoring their spaces and newlines.
+ * Instead of building the stripped copy of a line for every comparison,
+ * the hash and length of the stripped line are computed once, and the
+ * bytes are only compared, skipping the spaces in place, when those
+ * agree.
+ */
+#define LINE_KEY_FNV_BASE 0x811c9dc5
+#define LINE_KEY_FNV_PRIME 0x01000193
+
+struct line_key {
+    unsigned int hash;
+    size_t len;
+};
+
+#define LINE_KEY_INIT { LINE_KEY_FNV_BASE, 0 }
+
+static inline int is_line_space(char c)
 {
-    struct strbuf temp = STRBUF_INIT;
+    return c == ' ' || c == '\n';
+}
 
-    while(*s++) {
-        if (*s != ' ' && *s != '\n' && *s != '\0') {
-            strbuf_addch(&temp,*s);
-        }
+static void line_key_add(struct line_key *key, const char *s, size_t len)
+{
+    for (; len; s++, len--) {
+        if (is_line_space(*s))
+            continue;
+        key->hash = (key->hash * LINE_KEY_FNV_PRIME) ^ (unsigned char)*s;
+        key->len++;
     }
-    char *str = temp.buf;
-    if (strlen(str) == 0) {
-        str = NULL;
+}
+
+static void line_key_init(struct line_key *key, const char *s)
+{
+    key->hash = LINE_KEY_FNV_BASE;
+    key->len = 0;
+    line_key_add(key, s, strlen(s));
+}
+
+static int only_spaces(const char *s)
+{
+    for (; *s; s++)
+        if (!is_line_space(*s))
+            return 0;
+    return 1;
+}
+
+/* the non-space characters of a text given in up to three pieces */
+struct spaceless_text {
+    const char *part[3];
+    size_t len[3];
+    int nr, i;
+    size_t pos;
+};
+
+static int spaceless_next(struct spaceless_text *t)
+{
+    while (t->i < t->nr) {
+        while (t->pos < t->len[t->i]) {
+            char c = t->part[t->i][t->pos++];
+
+            if (!is_line_space(c))
+                return (unsigned char)c;
+        }
+        t->i++;
+        t->pos = 0;
     }
+    return -1;
+}
+
+static int spaceless_equal(struct spaceless_text *a, struct spaceless_text *b)
+{
+    int c;
+
+    do {
+        c = spaceless_next(a);
+        if (c != spaceless_next(b))
+            return 0;
+    } while (c >= 0);
+    return 1;
+}
+
+static void spaceless_add(struct spaceless_text *t, const char *s, size_t len)
+{
+    t->part[t->nr] = s;
+    t->len[t->nr++] = len;
+}
+
+/* whether "a" and "b" are the same line once spaces are ignored */
+static int same_without_spaces(const char *a, const struct line_key *a_key,
+                               const char *b, const struct line_key *b_key)
+{
+    struct spaceless_text ta = { { NULL } }, tb = { { NULL } };
 
-    strbuf_release(&temp);
-    return str;
+    if (a_key->hash != b_key->hash || a_key->len != b_key->len)
+        return 0;
+    spaceless_add(&ta, a, strlen(a));
+    spaceless_add(&tb, b, strlen(b));
+    return spaceless_equal(&ta, &tb);
 }
 
 static int max(int x, int y) {
@@ -468,1475 +708,3883 @@ static double jaro_winkler_distance(const char *s, const char *a) {
     return dw;
 }
 
+#ifndef SEARCH_REPLACE_DIR
+#define SEARCH_REPLACE_DIR "/Users/manan/CLionProjects/git/search-and-replace/"
+#endif
 
-static size_t levenshtein_n(const char *a, const size_t length, const char *b, const size_t bLength) {
-    // Shortcut optimizations / degenerate cases.
-    if (a == b) {
-        return 0;
-    }
-
-    if (length == 0) {
-        return bLength;
-    }
-
-    if (bLength == 0) {
-        return length;
-    }
-
-    size_t *cache = calloc(length, sizeof(size_t));
-    size_t index = 0;
-    size_t bIndex = 0;
-    size_t distance;
-    size_t bDistance;
-    size_t result;
-    char code;
-
-    // initialize the vector.
-    while (index < length) {
-        cache[index] = index + 1;
-        index++;
-    }
-
-    // Loop.
-    while (bIndex < bLength) {
-        code = b[bIndex];
-        result = distance = bIndex++;
-        index = SIZE_MAX;
-
-        while (++index < length) {
-            bDistance = code == a[index] ? distance : distance + 1;
-            distance = cache[index];
-
-            cache[index] = result = distance > result
-                                    ? bDistance > result
-                                      ? result + 1
-                                      : bDistance
-                                    : bDistance > distance
-                                      ? distance + 1
-                                      : bDistance;
-        }
-    }
-
-    free(cache);
+/*
+ * The directory of the search/replace jars and of the config.properties
+ * the shards start from: rerere.searchReplaceDir, or SEARCH_REPLACE_DIR
+ * as git was built.
+ */
+static char *search_replace_dir;
 
-    return result;
+static const char *search_replace_path(const char *file)
+{
+    if (!search_replace_dir)
+        search_replace_dir = xstrdup(SEARCH_REPLACE_DIR);
+    return mkpath("%s%s", search_replace_dir, file);
 }
 
-static size_t levenshtein(const char *a, const char *b) {
-    const size_t length = strlen(a);
-    const size_t bLength = strlen(b);
+/*
+ * The cluster index is split into shards, one per file extension or
+ * per "conflict-class" gitattribute, so that a hunk is only compared
+ * with the clusters learned from the same kind of file.  A shard lives
+ * in $GIT_DIR/rr-cache/shards/<name>/ and is read the first time a hunk
+ * of that kind is seen.  Paths with neither (or with -conflict-class)
+ * use the original $GIT_DIR/rr-cache/conflict_index.json.
+ */
+struct rule_prefilter;
+
+struct conflict_shard {
+    const char *name;          /* "" for the original index */
+    char *index_file;
+    char *journal_file;        /* pairs not folded into index_file yet */
+    char *jar_dir;             /* where the jars find config.properties */
+    struct json_object *index; /* NULL until read, or if there is none */
+    int loaded;
+    struct string_list changed_groups; /* clusters that need new rules */
+    char *synth_file;          /* cluster sizes the rules were learned at */
+    char *digest_file;
+    struct oidset digests;     /* of the pairs recorded in the index */
+    int digests_loaded;
+    struct rule_prefilter *rules; /* of the rules learned by the jar */
+    int rules_loaded;
+    char *summary_file;
+    struct string_list summaries; /* util: struct cluster_summary */
+    unsigned long clock;       /* of the last cluster match */
+    unsigned long next_group;
+    int summaries_loaded;
+    int summaries_dirty;
+    struct stat_validity index_validity;   /* of the files the daemon read */
+    struct stat_validity journal_validity;
+};
 
-    size_t leve = levenshtein_n(a, length, b, bLength);
-    //fprintf_ln(stderr, _("leve: %zu\n\n"),leve);
-    return leve;
-}
+static struct string_list conflict_shards = STRING_LIST_INIT_DUP;
 
 /*
- * return null if conflict and resolution are already present in json file
- * otherwise return id of the group with jaro-winkler similarity greater than 0.90 or
- * return a new id
- * resolution can be null if you want only group id
+ * Give the jars a config.properties of their own for the shard, that
+ * is the default one with the index files pointed into the shard.
  */
-static const char* get_conflict_json_id(char* conflict,char* resolution)
+static void write_shard_jar_config(struct conflict_shard *shard)
 {
-    //fprintf_ln(stderr, _("LOG_ENTER: get_conflict_json_id function"));
+    static const char *shard_files[][2] = {
+        { "conflict_file", "conflict_index.json" },
+        { "regex_file", "regex_replace_index.json" },
+        { "dataset_file", "conflict_dataset.csv" },
+        { "regex_tree_file", "regex_replace_tree_index/group_" },
+    };
+    struct strbuf in = STRBUF_INIT, out = STRBUF_INIT;
+    struct string_list lines = STRING_LIST_INIT_NODUP;
+    char *config = xstrfmt("%sconfig.properties", shard->jar_dir);
+    int i, j;
 
-    struct json_object *file_json = json_object_from_file(".git/rr-cache/conflict_index.json");
-    if (!file_json) { // if file is empty
-        if (!resolution) { //resolution is NULL
-            return  NULL;
-        }
-        return "1";
+    if (file_exists(config)) {
+        free(config);
+        return;
     }
+    if (strbuf_read_file(&in, search_replace_path("config.properties"), 0) >= 0)
+        string_list_split_in_place(&lines, in.buf, '\n', -1);
+    for (i = 0; i < lines.nr; i++) {
+        const char *line = lines.items[i].string;
+        size_t keylen = strcspn(line, "=");
 
-    double jaroW = 0 ;
-    //size_t leve = 0 ;
-    const char* groupId = NULL;
-    double max_sim = similarity_th;
-    char* idCount;
-
-    fprintf_ln(stderr, _("\nconflict: %s"),conflict);
-    //fprintf_ln(stderr, _("resolution: %s\n"),resolution);
+        if (!*line)
+            continue;
+        for (j = 0; j < ARRAY_SIZE(shard_files); j++)
+            if (strlen(shard_files[j][0]) == keylen &&
+                !strncmp(line, shard_files[j][0], keylen))
+                break;
+        if (j == ARRAY_SIZE(shard_files))
+            strbuf_addf(&out, "%s\n", line);
+    }
+    for (j = 0; j < ARRAY_SIZE(shard_files); j++)
+        strbuf_addf(&out, "%s=%s%s\n", shard_files[j][0],
+                    shard->jar_dir, shard_files[j][1]);
 
-    struct json_object *obj;
-    const char* jconf;
-    const char* jresol;
-    int arraylen;
-    double total_similarity = 0;
-    json_object_object_foreach(file_json,key,val){
-        obj = NULL;
-        arraylen = json_object_array_length(val);
-        idCount = key;
-        total_similarity = 0;
-        for (int i = 0; i < arraylen; i++) {
-            obj = json_object_array_get_idx(val, i);
-            jconf = json_object_get_string(json_object_object_get(obj, "conflict"));
-            jresol = json_object_get_string(json_object_object_get(obj, "resolution"));
-
-            if (resolution) {
-                if (strcmp(conflict, jconf) == 0 && strcmp(resolution, jresol) == 0) {
-                    //fprintf_ln(stderr,
-                    //          _("LOG_EXIT: get_conflict_json_id : conflict and resolution already present in json file\n"));
-                    json_object_put(file_json);
-                    return NULL;
-                }
-            }
+    if (safe_create_leading_directories_const(mkpath("%sregex_replace_tree_index/", shard->jar_dir)))
+        error_errno(_("could not create directory for '%s'"), config);
+    else
+        write_file_buf(config, out.buf, out.len);
 
-            jaroW = jaro_winkler_distance(conflict,jconf);
-            total_similarity += jaroW;
-        }
-        double avg = total_similarity/arraylen;
-        if (avg >= max_sim) {
-            max_sim = avg;
-            groupId = key;
-        }
-    }
+    string_list_clear(&lines, 0);
+    strbuf_release(&in);
+    strbuf_release(&out);
+    free(config);
+}
 
-    if (!groupId && resolution) { //if group == null and resolution != null
-        //create new group id
-        groupId = json_object_to_json_string(json_object_new_int(atoi(idCount)+1));
+static struct conflict_shard *conflict_shard_named(const char *name)
+{
+    struct string_list_item *item = string_list_insert(&conflict_shards, name);
+    struct conflict_shard *shard = item->util;
+
+    if (shard)
+        return shard;
+    shard = xcalloc(1, sizeof(*shard));
+    string_list_init(&shard->changed_groups, 1);
+    string_list_init(&shard->summaries, 1);
+    if (!*name) {
+        shard->index_file = xstrdup(git_path("rr-cache/conflict_index.json"));
+        shard->journal_file = xstrdup(git_path("rr-cache/conflict_index.journal"));
+        shard->digest_file = xstrdup(git_path("rr-cache/conflict_index.digests"));
+        shard->synth_file = xstrdup(git_path("rr-cache/conflict_index.synthesized"));
+        shard->summary_file = xstrdup(git_path("rr-cache/conflict_index.clusters"));
+        shard->jar_dir = xstrdup(search_replace_path(""));
+    } else {
+        shard->index_file = xstrdup(git_path("rr-cache/shards/%s/conflict_index.json", name));
+        shard->journal_file = xstrdup(git_path("rr-cache/shards/%s/conflict_index.journal", name));
+        shard->digest_file = xstrdup(git_path("rr-cache/shards/%s/conflict_index.digests", name));
+        shard->synth_file = xstrdup(git_path("rr-cache/shards/%s/conflict_index.synthesized", name));
+        shard->summary_file = xstrdup(git_path("rr-cache/shards/%s/conflict_index.clusters", name));
+        shard->jar_dir = xstrfmt("%s/", absolute_path(git_path("rr-cache/shards/%s", name)));
     }
-
-    fprintf_ln(stderr, _("groupID:  %s"),groupId);
-    //fprintf_ln(stderr, _("LOG_EXIT: get_conflict_json_id : groupID %s"),groupId);
-    json_object_put(file_json);
-    return groupId;
+    shard->name = item->string;
+    item->util = shard;
+    return shard;
 }
+
 /*
- * return 1 if it is multiline otherwise return 0
+ * The shard a conflicted "path" belongs to: its "conflict-class"
+ * attribute if it has one, otherwise its extension.
  */
-static int is_multiline_string(char* string)
+static struct conflict_shard *find_conflict_shard(struct index_state *istate, const char *path)
 {
-    char *line = strdup(string);
-    strtok(line,"\n");
-    char * secondline= strtok(NULL, "\n");
-    if(secondline != NULL){
-        fprintf_ln(stderr, _("Multiline String is not accepted"));
-        free(line);
-        return 1;
+    static struct attr_check *check;
+    struct strbuf name = STRBUF_INIT;
+    struct conflict_shard *shard;
+    size_t i;
+
+    if (!check)
+        check = attr_check_initl("conflict-class", NULL);
+
+    if (path) {
+        const char *value, *ext;
+
+        git_check_attr(istate, path, check);
+        value = check->items[0].value;
+        if (!ATTR_TRUE(value) && !ATTR_FALSE(value) && !ATTR_UNSET(value))
+            strbuf_addstr(&name, value);
+        else if (!ATTR_FALSE(value) &&
+                 (ext = strrchr(find_last_dir_sep(path) ? find_last_dir_sep(path) : path, '.')))
+            strbuf_addstr(&name, ext + 1);
     }
-    free(line);
-    return 0;
+    for (i = 0; i < name.len; i++)
+        if (isalnum(name.buf[i]) || name.buf[i] == '-' || name.buf[i] == '_')
+            name.buf[i] = tolower(name.buf[i]);
+        else
+            name.buf[i] = '_';
+
+    shard = conflict_shard_named(name.buf);
+    strbuf_release(&name);
+    return shard;
 }
 
-static int write_json_object(struct json_object* file_object, char* file_name, const char* group_id, char* conflict, char* resolution){
+/*
+ * Recording a pair does not rewrite the whole conflict_index.json (nor
+ * conflict_list.json): the pair is appended to a journal next to it as
+ * one {"group", "conflict", "resolution"} object per line, and readers
+ * replay the journal over the file.  A record with a "slot" replaces
+ * that member of the cluster instead, and one with "evict" drops the
+ * cluster (see rerere.maxClusters).  The journal is folded back into
+ * the file by "git rerere gc", before the generalization jar reads the
+ * index, and once it grows past rerere.journalSize bytes.
+ *
+ * Writers hold the lock of the journal (and compaction that of the
+ * file too), and the file is only ever replaced as a whole by renaming
+ * its lock over it, so each version of it is an immutable snapshot.
+ * Readers take no lock: the first record of a journal names the
+ * snapshot it goes with by the inode, size and mtime of its file (see
+ * snapshot_base()), and a reader that finds its snapshot and journal do
+ * not go together (a compaction ran in between) reads them again.
+ */
+static unsigned long rerere_journal_size = 1024 * 1024;
+
+static GIT_PATH_FUNC(git_path_conflict_list, "rr-cache/conflict_list.json")
+static GIT_PATH_FUNC(git_path_conflict_list_journal, "rr-cache/conflict_list.journal")
 
+static void add_conflict_pair(struct json_object *file_object, const char *group_id,
+                              const char *conflict, const char *resolution)
+{
     struct json_object *object = json_object_new_object();
-    struct json_object *jarray = json_object_new_array();
+    struct json_object *jarray = json_object_object_get(file_object, group_id);
 
-    jarray = json_object_object_get(file_object, group_id);
+    json_object_object_add(object, "conflict", json_object_new_string(conflict));
+    json_object_object_add(object, "resolution", json_object_new_string(resolution));
 
-    if(!jarray)
+    if (!jarray) { // if id1 not exists
         jarray = json_object_new_array();
-
-    if (json_object_array_length(jarray)) { // get object id1 if exists
-        //add new line to object id1
-        json_object_object_add(object, "conflict", json_object_new_string(conflict));
-        json_object_object_add(object, "resolution", json_object_new_string(resolution));
-        json_object_array_add(jarray,object);
-    } else { // if id1 not exists
-        json_object_object_add(object, "conflict", json_object_new_string(conflict));
-        json_object_object_add(object, "resolution", json_object_new_string(resolution));
-        json_object_array_add(jarray,object);
         json_object_object_add(file_object,group_id,jarray);
     }
-
-    FILE *fp = fopen(file_name,"w");
-    if (!fp)
-        return 0;
-    //update or add groupid to file
-    fprintf(fp,"%s", json_object_to_json_string_ext(file_object,2));
-    fclose(fp);
-    free(object);
-    free(jarray);
-    return 1;
+    json_object_array_add(jarray,object);
 }
 
-static int write_json_conflict_index(char* conflict, char* resolution)
+static void replace_conflict_pair(struct json_object *jarray, int slot,
+                                  const char *conflict, const char *resolution)
 {
-    //fprintf_ln(stderr, _("LOG_ENTER: write_json_conflict_index function"));
-
-    if (strlen(remove_spaces(conflict)) == 0 || strlen(remove_spaces(resolution)) == 0)
-        return 0;
+    struct json_object *object = json_object_new_object();
 
-    struct json_object *file_json = json_object_from_file(".git/rr-cache/conflict_index.json");
+    json_object_object_add(object, "conflict", json_object_new_string(conflict));
+    json_object_object_add(object, "resolution", json_object_new_string(resolution));
+    json_object_array_put_idx(jarray, slot, object);
+}
 
-    if (!file_json) // if file is empty
-        file_json = json_object_new_object();
+#define JOURNAL_READ_TRIES 3
 
-    const char* group_id = get_conflict_json_id(conflict,resolution);
+/*
+ * What tells a snapshot from the others: a snapshot is never written in
+ * place, so a new one is a new file, with an inode of its own or at
+ * least another size or mtime.  "none" when there is no snapshot.
+ */
+static void snapshot_base(struct strbuf *base, const struct stat *st)
+{
+    strbuf_reset(base);
+    if (!st)
+        strbuf_addstr(base, "none");
+    else
+        strbuf_addf(base, "%"PRIuMAX" %"PRIuMAX" %"PRIuMAX" %"PRIuMAX" %u",
+                    (uintmax_t)st->st_dev, (uintmax_t)st->st_ino,
+                    (uintmax_t)st->st_size, (uintmax_t)st->st_mtime,
+                    ST_MTIME_NSEC(*st));
+}
 
-    if (!group_id) {
-        json_object_put(file_json);
-        return 0;
-    }
+/*
+ * Map the snapshot "file", and describe it in "base".  Return the
+ * descriptor it was mapped from, which is kept open so that its inode
+ * can be compared with that of the file later on, or -1.
+ */
+static int map_snapshot(const char *file, void **map, size_t *size,
+                        struct stat *st, struct strbuf *base)
+{
+    int fd = git_open(file);
 
-    if(!write_json_object(file_json,".git/rr-cache/conflict_index.json",group_id,conflict,resolution)){ //if return 0
-        json_object_put(file_json);
-        return 0;
+    *map = NULL;
+    *size = 0;
+    if (fd >= 0 && fstat(fd, st)) {
+        close(fd);
+        fd = -1;
     }
-
-    struct json_object *conflict_list = json_object_from_file(".git/rr-cache/conflict_list.json");
-
-    if (!conflict_list) // if file is empty
-        conflict_list = json_object_new_object();
-
-    // write conflict list file
-    if(!write_json_object(conflict_list,".git/rr-cache/conflict_list.json","conflicts_list",conflict,resolution)){ //if return 0
-        json_object_put(file_json);
-        return 0;
+    if (fd >= 0 && st->st_size) {
+        *size = xsize_t(st->st_size);
+        *map = xmmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0);
     }
+    snapshot_base(base, fd < 0 ? NULL : st);
+    return fd;
+}
 
-    //save cluster id for jar file
-    string_list_insert(&groupId_list,group_id);
-
-    //free(file_json);
-    json_object_put(file_json);
-    free(conflict_list);
-    //fprintf_ln(stderr, _("LOG_EXIT: write_json_conflict_index function"));
-    return 1;
+static void add_journal_base(struct strbuf *buf, const struct strbuf *base)
+{
+    strbuf_addf(buf, "{\"base\":\"%s\"}\n", base->buf);
 }
 
-static char* get_file_hash (const char *path)
+/* the snapshot the journal in "buf" goes with; -1 if it does not say */
+static int read_journal_base(const char *buf, struct strbuf *base)
 {
-    //fprintf_ln(stderr, _("LOG_ENTER: get_hash_file function"));
-    struct strbuf buf = STRBUF_INIT;
-    struct rerere_io_file io;
-    memset(&io, 0, sizeof(io));
-    io.io.getline = rerere_file_getline;
-    io.input = fopen(".git/rr-cache/hash_index", "r");
+    const char *start, *end;
 
-    io.io.wrerror = 0;
-    if (io.input) {
-        while (!io.io.getline(&buf, &io.io)) {
-
-            if (strstr(buf.buf, path) != NULL) {
-                char *hash = strchr(buf.buf, ';');
-                hash++;
-                size_t ln = strlen(hash) - 1;
-                if (*hash && hash[ln] == '\n')
-                    hash[ln] = '\0';
-
-                fclose(io.input);
-                return hash;
-            }
-        }
-        fclose(io.input);
-    }
-    //fprintf_ln(stderr, _("LOG_EXIT: get_hash_file function"));
+    if (!skip_prefix(buf, "{\"base\":\"", &start) ||
+        !(end = strchr(start, '"')) || !starts_with(end, "\"}\n"))
+        return -1;
+    strbuf_reset(base);
+    strbuf_add(base, start, end - start);
     return 0;
 }
 
 /*
- * read conflict file index
+ * Replay the records of a journal over "file_object".  A line that does
+ * not parse, as the last one can be after a crash, is skipped.
  */
-static void read_conflict_index(struct list **c_list)
+static struct json_object *replay_journal(struct json_object *file_object, char *buf)
 {
-    //fprintf_ln(stderr, _("read_conflict_index: ENTER"));
-    struct index {
-        char conflict[2000];
-        char resolution[2000];
-    } object;
-
-    struct list *conflict_list = (*c_list);
+    char *line, *eol;
 
-    FILE *conflict_index = fopen(".git/rr-cache/conflict_index", "r");
+    for (line = buf; *line; line = eol) {
+        struct json_object *record;
+        const char *group_id, *conflict, *resolution;
 
-    if (conflict_index) {
-        while (fread(&object, sizeof(struct index), 1, conflict_index)) {
-            // printf("write_conflict_index: CONFLICT %s ", object2.conflict);
-            //printf("write_conflict_index: RESOLUTION %s", object2.resolution);
-            //printf("\n");
-
-            if (conflict_list == NULL){
-                conflict_list = malloc(sizeof(struct list));
-                memcpy(conflict_list->conflict, object.conflict, strlen(object.conflict)+1);
-                memcpy(conflict_list->resolution, object.resolution, strlen(object.resolution)+1);
-                conflict_list->next = NULL;
-            } else{
-                struct list *node = malloc(sizeof(struct list));
-                memcpy(node->conflict, object.conflict, strlen(object.conflict)+1);
-                memcpy(node->resolution, object.resolution, strlen(object.resolution)+1);
-                node->next = conflict_list;
-                conflict_list = node;
-            }
+        eol = strchrnul(line, '\n');
+        if (*eol)
+            *eol++ = '\0';
+        record = json_tokener_parse(line);
+        if (!record)
+            continue;
+        group_id = json_object_get_string(json_object_object_get(record, "group"));
+        conflict = json_object_get_string(json_object_object_get(record, "conflict"));
+        resolution = json_object_get_string(json_object_object_get(record, "resolution"));
+        if (group_id && json_object_object_get_ex(record, "evict", NULL)) {
+            if (file_object)
+                json_object_object_del(file_object, group_id);
+        } else if (group_id && conflict && resolution) {
+            struct json_object *slot, *jarray;
+
+            if (!file_object)
+                file_object = json_object_new_object();
+            if (json_object_object_get_ex(record, "slot", &slot) &&
+                (jarray = json_object_object_get(file_object, group_id)) &&
+                json_object_get_int(slot) < json_object_array_length(jarray))
+                replace_conflict_pair(jarray, json_object_get_int(slot), conflict, resolution);
+            else
+                add_conflict_pair(file_object, group_id, conflict, resolution);
         }
-        fclose(conflict_index);
-    } else {
-        fprintf_ln(stderr, _("conflict_index_file does not exist"));
+        json_object_put(record);
     }
-    (*c_list) = conflict_list;
-    //fprintf_ln(stderr, _("read_conflict_index: EXIT"));
+    return file_object;
 }
 
-static void write_conflict_index(char* conflict, char* resolution)
+/*
+ * Read the snapshot "file" and replay "journal" over it into "*result".
+ * Return -1 if they do not go together, unless "locked": with the lock
+ * of the journal held, a journal that does not go with the snapshot was
+ * folded into it already, by a compaction that did not get to remove it.
+ */
+static int read_journaled_json_once(const char *file, const char *journal,
+                                    int locked, struct json_object **result)
 {
-    struct index {
-        char conflict[2000];
-        char resolution[2000];
-    };
-
-    if (strlen(conflict) > 2000 || strlen(resolution) > 2000){
-        fprintf_ln(stderr, _("write_conflict_index: STRING IS TOO LONG FOR INDEX FILE"));
-        return;
+    struct json_object *file_object = NULL;
+    struct strbuf buf = STRBUF_INIT, snapshot = STRBUF_INIT, base = STRBUF_INIT;
+    struct stat st, now;
+    void *map;
+    size_t size;
+    int fd, ret = 0;
+
+    fd = map_snapshot(file, &map, &size, &st, &snapshot);
+    if (map) {
+        struct json_tokener *tok = json_tokener_new();
+
+        if (size <= INT_MAX)
+            file_object = json_tokener_parse_ex(tok, map, size);
+        json_tokener_free(tok);
+        munmap(map, size);
     }
 
-    FILE *conflict_index = fopen(".git/rr-cache/conflict_index", "a+");
-
-    if (conflict_index) {
-        struct index new_conflict = {"",""};
-        memcpy(new_conflict.conflict, conflict, strlen(conflict));
-        memcpy(new_conflict.resolution, resolution, strlen(resolution));
-        fwrite(&new_conflict, sizeof(struct index), 1, conflict_index);
-        fclose(conflict_index);
+    if (strbuf_read_file(&buf, journal, 0) < 0) {
+        /* with no journal, was the snapshot replaced by a compaction? */
+        if (!locked && (fd < 0 ? !lstat(file, &now) :
+                        lstat(file, &now) || now.st_ino != st.st_ino ||
+                        now.st_dev != st.st_dev))
+            ret = -1;
+    } else if (!read_journal_base(buf.buf, &base) && strbuf_cmp(&base, &snapshot)) {
+        if (!locked)
+            ret = -1;
+    } else {
+        file_object = replay_journal(file_object, buf.buf);
     }
+    if (fd >= 0)
+        close(fd);
+    strbuf_release(&buf);
+    strbuf_release(&snapshot);
+    strbuf_release(&base);
+
+    if (ret && file_object)
+        json_object_put(file_object);
+    else
+        *result = file_object;
+    return ret;
 }
 
-static int handle_conflict(struct strbuf *out, struct rerere_io *io,
-                           int marker_size, git_hash_ctx *ctx)
+/*
+ * The content of "file" with the pairs of "journal" added; NULL if
+ * there is neither.  Should a compaction run every time it is read,
+ * the journal is read under its lock.
+ */
+static struct json_object *read_journaled_json(const char *file, const char *journal)
 {
-    enum {
-        RR_SIDE_1 = 0, RR_SIDE_2, RR_ORIGINAL
-    } hunk = RR_SIDE_1;
-    struct strbuf one = STRBUF_INIT, two = STRBUF_INIT;
-    struct strbuf buf = STRBUF_INIT, conflict = STRBUF_INIT;
-    int has_conflicts = -1;
-
-    while (!io->getline(&buf, io)) {
-        if (is_cmarker(buf.buf, '<', marker_size)) {
-            if (handle_conflict(&conflict, io, marker_size, NULL) < 0)
-                break;
-            if (hunk == RR_SIDE_1)
-                strbuf_addbuf(&one, &conflict);
-            else
-                strbuf_addbuf(&two, &conflict);
-            strbuf_release(&conflict);
-        } else if (is_cmarker(buf.buf, '|', marker_size)) {
-            if (hunk != RR_SIDE_1)
-                break;
-            hunk = RR_ORIGINAL;
-        } else if (is_cmarker(buf.buf, '=', marker_size)) {
-            if (hunk != RR_SIDE_1 && hunk != RR_ORIGINAL)
-                break;
-            hunk = RR_SIDE_2;
-        } else if (is_cmarker(buf.buf, '>', marker_size)) {
-            if (hunk != RR_SIDE_2)
-                break;
-            // < 0 : one < two
-            // = 0 : one = two
-            // > 0 : one > two
-            if (strbuf_cmp(&one, &two) > 0) // if one > two then swap
-                strbuf_swap(&one, &two);
-            has_conflicts = 1;
-            //preparing output out
-            rerere_strbuf_putconflict(out, '<', marker_size); //add < marker_size time in out
-            strbuf_addbuf(out, &one); // add content of one in out
-            rerere_strbuf_putconflict(out, '=', marker_size); // add = marker_size time in out
-            strbuf_addbuf(out, &two); // add content of two in out
-            rerere_strbuf_putconflict(out, '>', marker_size); // add > marker_size time in out
-            if (ctx) {
-                the_hash_algo->update_fn(ctx, one.buf ?
-                                              one.buf : "",
-                                         one.len + 1);
-                the_hash_algo->update_fn(ctx, two.buf ?
-                                              two.buf : "",
-                                         two.len + 1);
-            }
-            break;
-        } else if (hunk == RR_SIDE_1)
-            strbuf_addbuf(&one, &buf);
-        else if (hunk == RR_ORIGINAL)
-            ; /* discard */
-        else if (hunk == RR_SIDE_2)
-            strbuf_addbuf(&two, &buf);
-    }
-    strbuf_release(&one);
-    strbuf_release(&two);
-    strbuf_release(&buf);
+    struct lock_file lock = LOCK_INIT;
+    struct json_object *file_object = NULL;
+    int i;
 
-    return has_conflicts;
+    for (i = 0; i < JOURNAL_READ_TRIES; i++)
+        if (!read_journaled_json_once(file, journal, 0, &file_object))
+            return file_object;
+    if (hold_lock_file_for_update_timeout(&lock, journal, 0, 1000) < 0)
+        error_errno(_("could not lock '%s'"), journal);
+    read_journaled_json_once(file, journal, 1, &file_object);
+    rollback_lock_file(&lock);
+    return file_object;
 }
 
 /*
- * Read contents a file with conflicts, normalize the conflicts
- * by (1) discarding the common ancestor version in diff3-style,
- * (2) reordering our side and their side so that whichever sorts
- * alphabetically earlier comes before the other one, while
- * computing the "conflict ID", which is just an SHA-1 hash of
- * one side of the conflict, NUL, the other side of the conflict,
- * and NUL concatenated together.
- *
- * Return 1 if conflict hunks are found, 0 if there are no conflict
- * hunks and -1 if an error occured.
+ * Append a record to the journal of "file", taking ownership of it.
+ * The lock on the journal only keeps writers (and compaction) out while
+ * the line is written and synced.  A journal is started with the base
+ * of the snapshot it goes with; one that goes with another snapshot
+ * was folded already, and is started anew.  Only the snapshot is
+ * stat()ed for that, it is not read.
  */
-static int handle_path(unsigned char *hash, struct rerere_io *io, int marker_size)
+static int append_journal_record(const char *file, const char *journal,
+                                 struct json_object *record)
 {
-    git_hash_ctx ctx;
-    struct strbuf buf = STRBUF_INIT, out = STRBUF_INIT;
-    int has_conflicts = 0;
-    if (hash)
-        the_hash_algo->init_fn(&ctx);
+    struct lock_file lock = LOCK_INIT;
+    struct strbuf line = STRBUF_INIT, head = STRBUF_INIT;
+    struct strbuf snapshot = STRBUF_INIT, base = STRBUF_INIT;
+    struct stat st;
+    FILE *in;
+    int fd, ret = 0;
 
-    while (!io->getline(&buf, io)) {
-        if (is_cmarker(buf.buf, '<', marker_size)) {
-            has_conflicts = handle_conflict(&out, io, marker_size,
-                                            hash ? &ctx : NULL);
-            if (has_conflicts < 0)
-                break;
-            rerere_io_putmem(out.buf, out.len, io);
-            strbuf_reset(&out);
-        } else
-            rerere_io_putstr(buf.buf, io);
+    strbuf_addstr(&line, json_object_to_json_string_ext(record, JSON_C_TO_STRING_PLAIN));
+    strbuf_addch(&line, '\n');
+    json_object_put(record);
+
+    if (safe_create_leading_directories_const(journal) ||
+        hold_lock_file_for_update_timeout(&lock, journal, 0, 1000) < 0) {
+        strbuf_release(&line);
+        return error_errno(_("could not lock '%s'"), journal);
     }
-    strbuf_release(&buf);
-    strbuf_release(&out);
 
-    if (hash)
-        the_hash_algo->final_fn(hash, &ctx);
+    in = fopen(journal, "r");
+    if (in) {
+        strbuf_getwholeline(&head, in, '\n');
+        fclose(in);
+    }
+    if (!in || !read_journal_base(head.buf, &base)) {
+        snapshot_base(&snapshot, stat(file, &st) ? NULL : &st);
+        if (!in || strbuf_cmp(&base, &snapshot)) {
+            strbuf_reset(&head);
+            add_journal_base(&head, &snapshot);
+            strbuf_addbuf(&head, &line);
+            if (write_in_full(get_lock_file_fd(&lock), head.buf, head.len) < 0 ||
+                commit_lock_file(&lock))
+                ret = error_errno(_("could not write '%s'"), journal);
+            goto out;
+        }
+    }
 
-    return has_conflicts;
+    fd = open(journal, O_WRONLY | O_APPEND, 0666);
+    if (fd < 0 || write_in_full(fd, line.buf, line.len) < 0)
+        ret = error_errno(_("could not write '%s'"), journal);
+    else
+        fsync_or_die(fd, journal);
+    if (fd >= 0)
+        close(fd);
+out:
+    rollback_lock_file(&lock);
+    strbuf_release(&line);
+    strbuf_release(&head);
+    strbuf_release(&snapshot);
+    strbuf_release(&base);
+    return ret;
+}
+
+/* append a pair, or with "slot" >= 0 the replacement of that member */
+static int append_journal_pair(const char *file, const char *journal, const char *group_id,
+                               int slot, const char *conflict, const char *resolution)
+{
+    struct json_object *record = json_object_new_object();
+
+    json_object_object_add(record, "group", json_object_new_string(group_id));
+    if (slot >= 0)
+        json_object_object_add(record, "slot", json_object_new_int(slot));
+    json_object_object_add(record, "conflict", json_object_new_string(conflict));
+    json_object_object_add(record, "resolution", json_object_new_string(resolution));
+    return append_journal_record(file, journal, record);
+}
+
+static int append_journal(const char *file, const char *journal, const char *group_id,
+                          const char *conflict, const char *resolution)
+{
+    return append_journal_pair(file, journal, group_id, -1, conflict, resolution);
 }
 
 /*
- * Require the exact number of conflict marker letters, no more, no
- * less, followed by SP or any whitespace
- * (including LF).
+ * Fold the journal into "file".  Both are locked, so that no pair is
+ * appended between reading the journal and removing it.  The new
+ * snapshot is in place before the journal goes away: a reader seeing
+ * both can tell the journal goes with the previous snapshot.
  */
-static int my_cmarker(char *buf, int marker_char, int marker_size)
+static int compact_journal(const char *file, const char *journal)
 {
-    while (marker_size--) {
-        if (*buf++ != marker_char) {
-            return 0;
+    struct lock_file journal_lock = LOCK_INIT, file_lock = LOCK_INIT;
+    struct json_object *file_object = NULL;
+    const char *content;
+    int fd, ret = 0;
+
+    if (!file_exists(journal))
+        return 0;
+    if (hold_lock_file_for_update_timeout(&journal_lock, journal, 0, 1000) < 0)
+        return error_errno(_("could not lock '%s'"), journal);
+    fd = hold_lock_file_for_update_timeout(&file_lock, file, 0, 1000);
+    if (fd < 0) {
+        rollback_lock_file(&journal_lock);
+        return error_errno(_("could not lock '%s'"), file);
+    }
+
+    read_journaled_json_once(file, journal, 1, &file_object);
+    if (file_object) {
+        content = json_object_to_json_string_ext(file_object, JSON_C_TO_STRING_PRETTY);
+        if (write_in_full(fd, content, strlen(content)) < 0) {
+            ret = error_errno(_("could not write '%s'"), file);
+        } else {
+            fsync_or_die(fd, file);
+            if (commit_lock_file(&file_lock))
+                ret = error_errno(_("could not write '%s'"), file);
         }
+        json_object_put(file_object);
     }
-    return 1;
+    if (!ret)
+        unlink_or_warn(journal);
+    rollback_lock_file(&file_lock);
+    rollback_lock_file(&journal_lock);
+    return ret;
 }
 
-static void regex_repalce_suggestion(char *conflict)
+static void compact_journal_if_large(const char *file, const char *journal)
 {
-    //fprintf_ln(stderr, _("LOG_ENTER: regex_repalce_suggestion"));
+    struct stat st;
+
+    if (!stat(journal, &st) && st.st_size > rerere_journal_size)
+        compact_journal(file, journal);
+}
+
 /*
-    struct json_object *regex_json = json_object_from_file("/Users/manan/CLionProjects/git/search-and-replace/regex_replace_index.json");
-    if (!regex_json) {
-        fprintf_ln(stderr, _("LOG_EXIT: regex_repalce_suggestion: regex_replace_index does not exists "));
-        return;
+ * The cluster index of the shard, read on first use; NULL when no
+ * conflict has been recorded for that kind of file yet.
+ */
+static struct json_object *shard_index(struct conflict_shard *shard)
+{
+    if (!shard->loaded) {
+        shard->index = read_journaled_json(shard->index_file, shard->journal_file);
+        shard->loaded = 1;
     }
-*/
-    const char *groupId = get_conflict_json_id(conflict,NULL);
+    return shard->index;
+}
 
-    if (!groupId)
-        return;
+static void hash_conflict_pair(struct object_id *oid,
+                               const char *conflict, const char *resolution)
+{
+    git_hash_ctx ctx;
 
-    //fprintf_ln(stderr, _("\nConflict: %s"),conflict);
-    pid_t pid = fork();
-    if (pid == 0) { // child process
-        /* open /dev/null for writing */
-        int fd = open(".git/rr-cache/string_replace.txt", O_RDWR | O_CREAT, S_IRUSR | S_IWUSR);
-        dup2(fd, 1);    /* make stdout a copy of fd (> /dev/null) */
-        //dup2(fd, 2);    /* ...and same with stderr */
-        close(fd);
-        execl("/usr/bin/java", "/usr/bin/java", "-jar", "/Users/manan/CLionProjects/git/search-and-replace/RegexReplacement.jar","/Users/manan/CLionProjects/git/search-and-replace/",groupId,conflict,(char*)0);
-    } else { //parent process
-        int status;
-        (void)waitpid(pid, &status, 0);
-        //printf("\nJar Process terminate with code: %d\n",status);
-
-        if (!status) {
-            struct strbuf buf1 = STRBUF_INIT, buf2 = STRBUF_INIT, buf3 = STRBUF_INIT;
-            struct rerere_io_file io;
-            memset(&io, 0, sizeof(io));
-            io.io.getline = rerere_file_getline;
-            io.input = fopen(".git/rr-cache/string_replace.txt", "r");
-
-            io.io.wrerror = 0;
-            if (io.input) {
-                char *regex1=NULL, *regex2=NULL, *replace1=NULL, *replace2=NULL, *res1=NULL, *res2=NULL;
-                // read first resolution
-                if (!io.io.getline(&buf1, &io.io) && !io.io.getline(&buf2, &io.io) && !io.io.getline(&buf3, &io.io)) {
-                    regex1 = buf1.buf;
-                    replace1 = buf2.buf;
-                    res1 = buf3.buf;
-                }
-                // read second resolution
-                if (!io.io.getline(&buf1, &io.io) && !io.io.getline(&buf2, &io.io) && !io.io.getline(&buf3, &io.io)) {
-                    regex2 = buf1.buf;
-                    replace2 = buf2.buf;
-                    res2 = buf3.buf;
-                }
+    the_hash_algo->init_fn(&ctx);
+    the_hash_algo->update_fn(&ctx, conflict, strlen(conflict) + 1);
+    the_hash_algo->update_fn(&ctx, resolution, strlen(resolution) + 1);
+    the_hash_algo->final_fn(oid->hash, &ctx);
+}
 
-                if(res1 && res2){
-                    double jw1 = jaro_winkler_distance(conflict,res1);
-                    double jw2 = jaro_winkler_distance(conflict,res2);
-                    FILE *fp = fopen(".git/rr-cache/regex_replace_result.txt","a+");
-                    fprintf(fp, "\nconflict: %s",conflict);
-                    fprintf(fp, "groupID: %s",groupId);
-                    if(jw1 >= jw2){
-                        fprintf(fp, "regex: %s",regex1);
-                        fprintf(fp, "replacement: %s",replace1);
-                        fprintf(fp, "regex & replacement: %s",res1);
-                    }else{
-                        fprintf(fp, "regex: %s",regex2);
-                        fprintf(fp, "replacement: %s",replace2);
-                        fprintf(fp, "regex & replacement: %s",res2);
-                    }
-                    fclose(fp);
-                }else{
-                    FILE *fp = fopen(".git/rr-cache/regex_replace_result.txt","a+");
-                    fprintf(fp, "conflict: %s",conflict);
-                    fprintf(fp, "groupID: %s",groupId);
-                    fprintf(fp, "regex: %s",regex1);
-                    fprintf(fp, "replacement: %s",replace1);
-                    fprintf(fp, "regex & replacement: %s",res1);
-                }
-                fclose(io.input);
-                unlink_or_warn(".git/rr-cache/string_replace.txt");
-            }else{
-                FILE *fp = fopen(".git/rr-cache/regex_replace_result.txt","a+");
-                fprintf(fp, "conflict: %s",conflict);
-                fprintf(fp, "groupID: %s",groupId);
-                fprintf(fp, "Regex not apply: %s",conflict);
-            }
-            strbuf_release(&buf1);
-            strbuf_release(&buf2);
-            strbuf_release(&buf3);
-        }
+/*
+ * The digests of the (conflict, resolution) pairs already in the
+ * index of the shard, and of those a full cluster left out of its
+ * sample, kept one hex digest per line next to it, so that recording
+ * the same pair again is rejected without comparing it with every
+ * stored pair.  A pair that leaves the index gets a "-<digest>" line.
+ * The file is computed again from the index by "rerere gc", and
+ * whenever it is older than the index or the index is gone, as when the
+ * index was recorded before the digests were kept or was replaced
+ * behind our back.
+ */
+static void read_conflict_digests(struct conflict_shard *shard)
+{
+    struct strbuf line = STRBUF_INIT;
+    struct object_id oid;
+    FILE *fp = fopen_or_warn(shard->digest_file, "r");
+
+    if (!fp)
+        return;
+    while (strbuf_getline(&line, fp) != EOF) {
+        const char *hex = line.buf;
+        int forget = *hex == '-';
+
+        if (get_oid_hex(hex + forget, &oid) || hex[forget + the_hash_algo->hexsz])
+            continue;
+        if (forget)
+            oidset_remove(&shard->digests, &oid);
+        else
+            oidset_insert(&shard->digests, &oid);
     }
-    //free(regex_json);
-    //free(jobject);
-    //fprintf_ln(stderr, _("LOG_EXIT: regex_repalce_suggestion"));
+    fclose(fp);
+    strbuf_release(&line);
 }
 
-static void conflict_suggestion(char *conflict)
+static void compute_conflict_digests(struct conflict_shard *shard)
 {
-    //fprintf_ln(stderr, _("conflict_suggestion: ENTER"));
-    //struct list conflict_list = read_conflict_index();
-    struct list *conflict_list = NULL;
-    read_conflict_index(&conflict_list);
+    struct json_object *index = shard_index(shard);
+    struct json_object_iter it;
+    struct strbuf buf = STRBUF_INIT;
+    struct object_id oid;
 
-    if (!conflict_list) {
-        //fprintf_ln(stderr, _("conflict_suggestion: EXIT"));
+    if (shard->digests_loaded)
+        oidset_clear(&shard->digests);
+    shard->digests_loaded = 1;
+    oidset_init(&shard->digests, 0);
+    if (!index)
         return;
-    }
-    struct list *current = conflict_list;
-    double jaroW = 0 ;
-    size_t leve = 0 ;
+    json_object_object_foreachC(index, it) {
+        int i, arraylen = json_object_array_length(it.val);
 
-    double max_similarity = 0;
-    char* solution;
-    char* file_conflict;
-    //fprintf_ln(stderr, _("conflict_suggestion: conflict: %s\n"),conflict);
-    while (current != NULL) {
-        jaroW = jaro_winkler_distance(conflict,current->conflict);
-        leve = levenshtein(conflict,current->conflict);
+        for (i = 0; i < arraylen; i++) {
+            struct json_object *obj = json_object_array_get_idx(it.val, i);
 
-        if (max_similarity < jaroW) {
-            max_similarity = jaroW;
-            solution = current->resolution;
-            file_conflict = current->conflict;
+            hash_conflict_pair(&oid,
+                               json_object_get_string(json_object_object_get(obj, "conflict")),
+                               json_object_get_string(json_object_object_get(obj, "resolution")));
+            if (!oidset_insert(&shard->digests, &oid))
+                strbuf_addf(&buf, "%s\n", oid_to_hex(&oid));
         }
-        current = current->next;
     }
-    fprintf_ln(stderr, _("file_conflict:%s\nresolution:%s\nsimilarity: %lf\n"),file_conflict,solution,max_similarity);
-
-    free(current);
-    free(conflict_list);
-    //fprintf_ln(stderr, _("conflict_suggestion: EXIT"));
+    write_file_buf(shard->digest_file, buf.buf, buf.len);
+    strbuf_release(&buf);
 }
 
+static struct oidset *shard_digests(struct conflict_shard *shard)
+{
+    struct stat digest_st, index_st;
+
+    if (shard->digests_loaded)
+        return &shard->digests;
+    if (stat(shard->digest_file, &digest_st) ||
+        stat(shard->index_file, &index_st) ||
+        digest_st.st_mtime < index_st.st_mtime) {
+        compute_conflict_digests(shard);
+        return &shard->digests;
+    }
+    shard->digests_loaded = 1;
+    oidset_init(&shard->digests, 0);
+    read_conflict_digests(shard);
+    return &shard->digests;
+}
 
-static int control_whitespace_diff(char *cur_s, char *pre_s,struct strbuf *out_buf)
+static void record_conflict_digest(struct conflict_shard *shard,
+                                   const struct object_id *oid)
 {
-    //fprintf_ln(stderr, _("control_whitespace_diff: ENTER"));
+    FILE *fp;
 
-    if (strcmp(remove_spaces(cur_s),remove_spaces(pre_s)) != 0) {
-        return 0; // if without whitespaces strings are different
-    }
+    if (oidset_insert(shard_digests(shard), oid))
+        return;
+    fp = fopen_or_warn(shard->digest_file, "a");
+    if (!fp)
+        return;
+    fprintf(fp, "%s\n", oid_to_hex(oid));
+    fclose(fp);
+}
 
-    char * cur_str = malloc(strlen(cur_s)+1);
-    memcpy(cur_str, cur_s, strlen(cur_s));
+static void forget_conflict_digest(struct conflict_shard *shard,
+                                   const struct object_id *oid)
+{
+    FILE *fp;
 
-    char * pre_str = malloc(strlen(pre_s)+1);
-    memcpy(pre_str, pre_s, strlen(pre_s));
+    if (!oidset_remove(shard_digests(shard), oid))
+        return;
+    fp = fopen_or_warn(shard->digest_file, "a");
+    if (!fp)
+        return;
+    fprintf(fp, "-%s\n", oid_to_hex(oid));
+    fclose(fp);
+}
 
-    cur_str[strlen(cur_s)] = 0;
-    pre_str[strlen(pre_s)] = 0;
+/* Forget the digest of the pair "obj" of the index, which leaves it. */
+static void forget_conflict_pair(struct conflict_shard *shard, struct json_object *obj)
+{
+    struct object_id oid;
 
-    int count = 1;
+    if (!obj)
+        return;
+    hash_conflict_pair(&oid,
+                       json_object_get_string(json_object_object_get(obj, "conflict")),
+                       json_object_get_string(json_object_object_get(obj, "resolution")));
+    forget_conflict_digest(shard, &oid);
+}
 
-    while(*cur_str++){
-        if (*cur_str == pre_str[count]) {
-            count += 1;
-        }else if (*cur_str == ' ') {
-            continue;
-        } else
-            return 0;
-    }
+/*
+ * With rerere.maxClusters and rerere.clusterMembers the index of a
+ * shard stays within a budget, however many years of conflicts it
+ * learns from.  A full cluster keeps its members a uniform sample of
+ * all the distinct pairs it was given: the n-th one replaces a random
+ * member with probability clusterMembers/n (reservoir sampling).  A new
+ * cluster beyond maxClusters evicts the cluster a pair was recorded in
+ * least recently; looking a cluster up for a suggestion does not count.
+ *
+ * How many pairs each cluster was given, when it was last recorded in
+ * and how many of its members were replaced are kept in
+ * conflict_index.clusters next to the index, as a "<clock> <next
+ * cluster id>" line and one "<cluster id> <pairs> <last record>
+ * <replaced>" line per cluster.  The clock counts the records, so that
+ * the order of records in the same second is not lost.
+ */
+static int rerere_max_clusters;
+static int rerere_cluster_members;
 
-    //only space difference add string to output buffer
-    strbuf_addstr(out_buf, cur_s);
+struct cluster_summary {
+    unsigned long pairs;
+    unsigned long last_hit;
+    unsigned long replaced;
+};
 
-    free(cur_str);
-    free(pre_str);
-    //fprintf_ln(stderr, _("control_whitespace_diff: EXIT"));
-    return 1;
+static int cluster_budget(void)
+{
+    return rerere_max_clusters > 0 || rerere_cluster_members > 0;
 }
 
-static char* get_html_comment(char *buf)
+static struct cluster_summary *add_cluster_summary(struct conflict_shard *shard,
+                                                   const char *group_id)
 {
-    //fprintf_ln(stderr, _("LOG_ENTER: get_html_comment"));
-
-    const char *PATTERN1 = "<!--";
-    const char *PATTERN2 = " <!--";
-    const char *PATTERN3 = "-->";
-    const char *PATTERN4 = "--> ";
+    struct string_list_item *item = string_list_insert(&shard->summaries, group_id);
 
-    char *comment = NULL;
+    if (!item->util)
+        item->util = xcalloc(1, sizeof(struct cluster_summary));
+    if (shard->next_group <= strtoul(group_id, NULL, 10))
+        shard->next_group = strtoul(group_id, NULL, 10) + 1;
+    return item->util;
+}
 
-    if ((strstr(buf, "<!--") != NULL) && (strstr(buf, "-->") != NULL)) {
-        //if ((strstr(pre_buf->buf, "<!--") == NULL) && (strstr(pre_buf->buf, "-->") == NULL)) {
+/*
+ * Read the summaries, keeping only those of the clusters in the index;
+ * a cluster recorded before there were summaries gets one from its
+ * members.
+ */
+static void load_cluster_summaries(struct conflict_shard *shard)
+{
+    struct json_object *index = shard_index(shard);
+    struct string_list lines = STRING_LIST_INIT_NODUP;
+    struct strbuf buf = STRBUF_INIT;
+    struct json_object_iter it;
+    int i;
 
-        char *start, *end;
+    if (shard->summaries_loaded)
+        return;
+    shard->summaries_loaded = 1;
+    shard->next_group = 1;
+
+    if (strbuf_read_file(&buf, shard->summary_file, 0) >= 0)
+        string_list_split_in_place(&lines, buf.buf, '\n', -1);
+    for (i = 0; i < lines.nr; i++) {
+        char *line = lines.items[i].string, *end;
+        struct cluster_summary *summary;
+        unsigned long pairs, last_hit, replaced;
+
+        if (!i) {
+            shard->clock = strtoul(line, &end, 10);
+            shard->next_group = strtoul(end, NULL, 10);
+            continue;
+        }
+        end = strchr(line, ' ');
+        if (!end)
+            continue;
+        *end++ = '\0';
+        pairs = strtoul(end, &end, 10);
+        last_hit = strtoul(end, &end, 10);
+        replaced = strtoul(end, NULL, 10);
+        if (!index || !json_object_object_get_ex(index, line, NULL))
+            continue;
+        summary = add_cluster_summary(shard, line);
+        summary->pairs = pairs;
+        summary->last_hit = last_hit;
+        summary->replaced = replaced;
+    }
+    if (index) {
+        json_object_object_foreachC(index, it) {
+            struct cluster_summary *summary = add_cluster_summary(shard, it.key);
 
-        start = strstr(buf, PATTERN2); //comment start with initial space
-        if (!start)
-            start = strstr(buf, PATTERN1); //comment start without initial space
+            if (!summary->pairs)
+                summary->pairs = json_object_array_length(it.val);
+        }
+    }
+    string_list_clear(&lines, 0);
+    strbuf_release(&buf);
+}
 
-        if (start) {
-            end = strstr(start, PATTERN4); //comment end with space
-            if (!end)
-                end = strstr(start, PATTERN3); //comment end without space
+static void write_cluster_summaries(struct conflict_shard *shard)
+{
+    struct lock_file lock = LOCK_INIT;
+    struct strbuf out = STRBUF_INIT;
+    int i, fd;
 
-            if (end) {
-                end += strlen(PATTERN3);
-                comment = (char *) malloc(end - start + 1);
-                memcpy(comment, start, end - start);
-                comment[end - start] = '\0';
+    if (!shard->summaries_dirty)
+        return;
+    shard->summaries_dirty = 0;
+    fd = hold_lock_file_for_update_timeout(&lock, shard->summary_file, 0, 1000);
+    if (fd < 0) {
+        error_errno(_("could not lock '%s'"), shard->summary_file);
+        return;
+    }
+    strbuf_addf(&out, "%lu %lu\n", shard->clock, shard->next_group);
+    for (i = 0; i < shard->summaries.nr; i++) {
+        struct cluster_summary *summary = shard->summaries.items[i].util;
 
-                fprintf_ln(stderr, _("COMMENT: %s"), comment);
-                fprintf_ln(stderr, _("LOG_EXIT: get_html_comment"));
-                return comment;
-            }
-        } else {
-            fprintf_ln(stderr, _("No Comment Pattern Found"));
-            fprintf_ln(stderr, _("LOG_EXIT: get_html_comment"));
-            return comment;
-        }
-        //}
+        strbuf_addf(&out, "%s %lu %lu %lu\n", shard->summaries.items[i].string,
+                    summary->pairs, summary->last_hit, summary->replaced);
     }
-    //fprintf_ln(stderr, _("No HTML Comment Found"));
-    //fprintf_ln(stderr, _("LOG_EXIT: get_html_comment"));
-    return comment;
+    if (write_in_full(fd, out.buf, out.len) < 0 || commit_lock_file(&lock) < 0)
+        error_errno(_("could not write '%s'"), shard->summary_file);
+    rollback_lock_file(&lock);
+    strbuf_release(&out);
 }
 
+static void touch_cluster(struct conflict_shard *shard, const char *group_id)
+{
+    if (!cluster_budget())
+        return;
+    load_cluster_summaries(shard);
+    add_cluster_summary(shard, group_id)->last_hit = ++shard->clock;
+    shard->summaries_dirty = 1;
+}
 
-static int control_html_comment(struct strbuf *cur_buf,struct strbuf *pre_buf,struct strbuf *out_buf)
+/* make room for a new cluster by evicting the least recently recorded ones */
+static void evict_cold_clusters(struct conflict_shard *shard)
 {
-    fprintf_ln(stderr, _("LOG_ENTER: control_html_comment"));
-
-    char * comment;
-    if ((comment = get_html_comment(cur_buf->buf)) != NULL){
-
-        if (get_html_comment(pre_buf->buf) != NULL) {
-            return -1; // case preimage has already a html comment
-        }
-
-        if (strcmp(remove_spaces(comment),remove_spaces(cur_buf->buf)) == 0) {
-            strbuf_addbuf(out_buf,cur_buf); //new line
-            fprintf_ln(stderr, _("LOG_EXIT: control_html_comment: new line with comment"));
-            return 0;
-        }
-
-        struct strbuf temp_buf = STRBUF_INIT;
-        strbuf_addbuf(&temp_buf,pre_buf);
-
-        strbuf_insert(&temp_buf,temp_buf.len,comment,(size_t) strlen(comment));
-
-        if (strbuf_cmp(cur_buf,&temp_buf) == 0){
-            //two buffers are equal after adding comment to preimage
-            strbuf_addbuf(out_buf,cur_buf);
-            strbuf_release(&temp_buf);
-            return 1;
-        } else if (strcmp(remove_spaces(cur_buf->buf),remove_spaces(temp_buf.buf)) == 0) {
-            // two strings are equal after adding comment and removing all spaces
-            strbuf_addbuf(out_buf,cur_buf);
-            strbuf_release(&temp_buf);
-            return 1;
-        } else { // case <!-- <tr></> -->
-            strbuf_reset(&temp_buf);
-            strbuf_addstr(&temp_buf,remove_spaces(pre_buf->buf));
-            strbuf_insert(&temp_buf,(size_t) 0,"<!--",(size_t) strlen("<!--"));
-            strbuf_insert(&temp_buf,(size_t) temp_buf.len,"-->",(size_t) strlen("-->"));
-
-            if (strcmp(remove_spaces(cur_buf->buf),temp_buf.buf) == 0) {
-                // two strings are equal
-                strbuf_addbuf(out_buf,cur_buf);
-                strbuf_release(&temp_buf);
-                return 1;
+    struct json_object *index = shard_index(shard);
+
+    load_cluster_summaries(shard);
+    while (index && rerere_max_clusters > 0 &&
+           json_object_object_length(index) >= rerere_max_clusters) {
+        struct json_object *record = json_object_new_object(), *pairs;
+        struct cluster_summary *coldest = NULL;
+        char *group_id = NULL;
+        int i;
+
+        for (i = 0; i < shard->summaries.nr; i++) {
+            struct cluster_summary *summary = shard->summaries.items[i].util;
+
+            if (!coldest || summary->last_hit < coldest->last_hit) {
+                coldest = summary;
+                group_id = shard->summaries.items[i].string;
             }
         }
+        if (!group_id)
+            break;
+        group_id = xstrdup(group_id);
+        json_object_object_add(record, "group", json_object_new_string(group_id));
+        json_object_object_add(record, "evict", json_object_new_boolean(1));
+        if (append_journal_record(shard->index_file, shard->journal_file, record)) {
+            free(group_id);
+            break;
+        }
+        if (json_object_object_get_ex(index, group_id, &pairs))
+            for (i = 0; i < json_object_array_length(pairs); i++)
+                forget_conflict_pair(shard, json_object_array_get_idx(pairs, i));
+        json_object_object_del(index, group_id);
+        string_list_remove(&shard->summaries, group_id, 1);
+        string_list_remove(&shard->changed_groups, group_id, 0);
+        shard->summaries_dirty = 1;
+        free(group_id);
     }
-
-    fprintf_ln(stderr, _("No Comment Found"));
-    fprintf_ln(stderr, _("LOG_EXIT: control_html_comment"));
-    return -1;
 }
 
-static int control_line_character(struct string_list *list_A,struct string_list *list_B, struct strbuf *out_buf)
+/* a random number below "n", to sample the members of a cluster */
+static unsigned long cluster_random(unsigned long n)
 {
-    //fprintf_ln(stderr, _("LOG_ENTER: control_line_character"));
+    static int seeded;
 
-    struct strbuf buf_A = STRBUF_INIT, buf_B = STRBUF_INIT;
-
-    int cur = 0, pre = 0, res = 0;
+    if (!seeded) {
+        srand((unsigned int)(getpid() ^ time(NULL)));
+        seeded = 1;
+    }
+    return (((unsigned long)rand() << 16) ^ rand()) % n;
+}
 
-    //fprintf_ln(stderr, _("control_line_character: list_A size : %d"),list_A->nr);
-    //fprintf_ln(stderr, _("control_line_character: list_B size : %d"),list_B->nr);
+/*
+ * The member of the cluster a new pair replaces, -1 to append it, or
+ * -2 to leave it out.
+ */
+static int cluster_slot(struct conflict_shard *shard, const char *group_id)
+{
+    struct json_object *pairs;
+    struct cluster_summary *summary;
+    unsigned long random;
+    int size = 0;
 
-    while (cur < list_A->nr && pre < list_B->nr) {
+    if (!cluster_budget())
+        return -1;
+    load_cluster_summaries(shard);
+    summary = add_cluster_summary(shard, group_id);
+    summary->pairs++;
+    shard->summaries_dirty = 1;
+    if (json_object_object_get_ex(shard_index(shard), group_id, &pairs))
+        size = json_object_array_length(pairs);
+    if (rerere_cluster_members <= 0 || size < rerere_cluster_members)
+        return -1;
+    random = cluster_random(summary->pairs);
+    if (random >= rerere_cluster_members)
+        return -2;
+    summary->replaced++;
+    return random;
+}
 
-        strbuf_addstr(&buf_A,list_A->items[cur].string);
-        strbuf_addstr(&buf_B,list_B->items[pre].string);
+/*
+ * Running the learned search/replace rules of a cluster means starting
+ * a JVM, which is wasted when none of them can match.  Most rules need
+ * some literal text (an identifier, an import prefix) to match; those
+ * literals are put in one kwset, so that a single scan of a hunk tells
+ * which clusters have a rule worth running on it.
+ */
+struct rule_prefilter {
+    kwset_t kws;                   /* NULL if no rule needs a literal */
+    struct string_list literals;   /* in kwset order, util: struct rule_literal */
+    struct string_list unfiltered; /* clusters with a rule needing no literal */
+    struct string_list clusters;   /* clusters with any rule */
+};
 
-        //fprintf_ln(stderr, _("cur_buf : %s"),buf_A.buf);
-        //fprintf_ln(stderr, _("pre_buf : %s"),buf_B.buf);
+struct rule_literal {
+    struct string_list clusters;   /* with a rule needing the literal */
+    int *prefixes;                 /* the shorter literals it starts with */
+    int nr_prefixes, alloc_prefixes;
+};
 
-        if (strbuf_cmp(&buf_A, &buf_B) == 0) {
-            strbuf_addbuf(out_buf, &buf_A);
-            fprintf_ln(stderr, _("UGUALIIIII"));
-            cur += 1;
-            pre += 1;
-        } else if (remove_spaces(buf_A.buf) == NULL) {
-            fprintf_ln(stderr, _("VUOTOOO"));
-            strbuf_addbuf(out_buf,&buf_A);
-            cur += 1;
-        } else if ((res = control_html_comment(&buf_A, &buf_B, out_buf)) >= 0) {
-            if (res == 0) //new line with comment
-                cur += 1;
+static void skip_regex_quantifier(const char *regex, size_t *i)
+{
+    if (regex[*i] == '{') {
+        while (regex[*i] && regex[*i] != '}')
+            (*i)++;
+        if (regex[*i])
+            (*i)++;
+    } else if (regex[*i] == '?' || regex[*i] == '*' || regex[*i] == '+') {
+        (*i)++;
+    } else {
+        return;
+    }
+    if (regex[*i] == '?' || regex[*i] == '+') /* lazy or possessive */
+        (*i)++;
+}
 
-            if (res == 1) { // two strings are equal after adding comment(and removing all spaces)
-                cur += 1;
-                pre += 1;
-            }
-        } else if (control_whitespace_diff(buf_A.buf,buf_B.buf,out_buf)) {
-            cur += 1;
-            pre += 1;
-        } else {
-            fprintf_ln(stderr, _("TWO LINES ARE DIFFERENT."));
-            //conflict_suggestion(buf_A.buf);
-            regex_repalce_suggestion(buf_A.buf);
-            strbuf_release(&buf_A);
-            strbuf_release(&buf_B);
-            fprintf_ln(stderr, _("LOG_EXIT: control_line_character"));
-            return -1;
-        }
-        strbuf_reset(&buf_A);
-        strbuf_reset(&buf_B);
+/* skip the group or character class starting at regex[*i] */
+static void skip_regex_group(const char *regex, size_t *i)
+{
+    int depth = 0, in_class = 0;
 
-        if (cur < list_A->nr && pre == list_B->nr) { // Assumption: list_A could be bigger than list_B
-            pre -= 1;
-        }
+    do {
+        char c = regex[*i];
 
-        //fprintf_ln(stderr, _("control_line_character: CUR : %d"),cur);
-        //fprintf_ln(stderr, _("control_line_character: PRE : %d"),pre);
-    }
-    strbuf_release(&buf_A);
-    strbuf_release(&buf_B);
-    //fprintf_ln(stderr, _("LOG_EXIT: control_line_character"));
-    return 1;
+        if (!c)
+            return;
+        (*i)++;
+        if (c == '\\' && regex[*i])
+            (*i)++;
+        else if (in_class && c == ']')
+            in_class = 0;
+        else if (in_class)
+            ;
+        else if (c == '[') {
+            in_class = 1;
+            if (regex[*i] == '^')
+                (*i)++;
+            if (regex[*i] == ']')
+                (*i)++;
+        } else if (c == '(')
+            depth++;
+        else if (c == ')')
+            depth--;
+    } while (depth || in_class);
 }
 
-static int separate_conflict_area(struct rerere_io *io,struct strbuf *buf_A,struct strbuf *buf_B,int marker_size,
-                                  struct string_list *list_A, struct string_list *list_B)
+/*
+ * Whether an inline flag group, as "(?i)", "(?ix:...)" or "(?-u)",
+ * turns case insensitivity, comments or Unicode case on or off
+ * anywhere in the regex, so that its text does not match as it reads.
+ */
+static int regex_flags_change_text(const char *regex)
 {
-    //fprintf_ln(stderr, _("LOG_ENTER: separate_conflict_area"));
-    struct strbuf buf = STRBUF_INIT;
+    const char *p;
 
-    enum {
-        RR_SIDE_1 = 0,  // = 0
-        RR_SIDE_2,      // = 1
-        RR_ORIGINAL     // = 2
-    } hunk = RR_SIDE_1;
+    for (p = regex; (p = strstr(p, "(?")); p += 2) {
+        const char *flag;
 
-    while (!io->getline(&buf,io)) {
-        if(my_cmarker(buf.buf,'<',marker_size)) {
+        if (p > regex && p[-1] == '\\')
             continue;
-        } else if (my_cmarker(buf.buf,'|',marker_size)) {
-            if (hunk != RR_SIDE_1)
-                return -1;
-            hunk = RR_ORIGINAL;
-        } else if (my_cmarker(buf.buf, '=', marker_size)) {
-            if (hunk != RR_SIDE_1 && hunk != RR_ORIGINAL)
-                return -1;
-            hunk = RR_SIDE_2;
-        } else if (my_cmarker(buf.buf, '>', marker_size)) {
-            if (hunk != RR_SIDE_2)
-                return -1;
-            break;
-        } else if (hunk == RR_SIDE_1) {
-            strbuf_addbuf(buf_A, &buf);
-            string_list_append(list_A,buf.buf);
-        }
-        else if (hunk == RR_ORIGINAL)
-            ; /* discard */
-        else if (hunk == RR_SIDE_2) {
-            strbuf_addbuf(buf_B, &buf);
-            string_list_append(list_B,buf.buf);
-        }
+        for (flag = p + 2; isalpha(*flag) || *flag == '-'; flag++)
+            if (*flag == 'i' || *flag == 'x' || *flag == 'u')
+                return 1;
     }
-    strbuf_release(&buf);
-    //fprintf_ln(stderr, _("LOG_EXIT: separate_conflict_area"));
-    return 1;
+    return 0;
 }
 
-
-/* cur = current file
- * pre = preimage file
- * <<<<<<<
- *    A
- * =======
- *    B
- * >>>>>>>
+/*
+ * The longest run of text any match of the (Java) regex must contain,
+ * or an empty "literal" if we cannot tell.  Groups and classes are not
+ * looked into, and a pattern with a top-level alternation or with
+ * inline flags that change how its text matches has no required
+ * literal.
  */
-
-static int control_conflict_area(struct rerere_io *cur,struct rerere_io *pre, struct rerere_io *post,
-                                 struct strbuf *pre_out_buf,struct strbuf *post_out_buf,int marker_size)
+static void required_literal(const char *regex, struct strbuf *literal)
 {
-    //fprintf_ln(stderr, _("LOG_ENTER: control_conflict_area"));
+    struct strbuf run = STRBUF_INIT;
+    size_t i = 0;
 
-    struct rerere_io    *cur_io = cur,
-            *pre_io = pre;
+    strbuf_reset(literal);
+    if (regex_flags_change_text(regex))
+        return;
+    while (regex[i]) {
+        if (regex[i] == '|')
+            goto no_literal;
+        if (regex[i] == '(' || regex[i] == '[')
+            skip_regex_group(regex, &i);
+        else
+            i += (regex[i] == '\\' && regex[i + 1]) ? 2 : 1;
+    }
 
-    struct strbuf   cur_buf_A = STRBUF_INIT, cur_buf_B = STRBUF_INIT,
-            pre_buf_A = STRBUF_INIT, pre_buf_B = STRBUF_INIT,
-            end_pre_buf = STRBUF_INIT,
-            post_buf = STRBUF_INIT;
+    i = 0;
+    while (regex[i]) {
+        char c = regex[i];
+        int literal_char = 1;
 
-    struct string_list  cur_list_A = STRING_LIST_INIT_DUP, cur_list_B = STRING_LIST_INIT_DUP,
-            pre_list_A = STRING_LIST_INIT_DUP, pre_list_B = STRING_LIST_INIT_DUP,
-            post_list = STRING_LIST_INIT_DUP;
+        if (c == '\\' && regex[i + 1] == 'Q') {
+            const char *end = strstr(regex + i + 2, "\\E");
+            size_t len = end ? end - (regex + i + 2) : strlen(regex + i + 2);
 
-    enum {
-        RR_SIDE_1 = 0,  // = 0
-        RR_SIDE_2,      // = 1
-        RR_NO_SIDE,
-    } conflict_area = RR_NO_SIDE;
+            strbuf_add(&run, regex + i + 2, len);
+            i += 2 + len + (end ? 2 : 0);
+            continue;
+        } else if (c == '\\' && regex[i + 1] && !isalnum(regex[i + 1])) {
+            c = regex[i + 1];
+            i += 2;
+        } else if (c == '\\' || c == '(' || c == '[') {
+            if (c == '\\')
+                i += regex[i + 1] ? 2 : 1;
+            else
+                skip_regex_group(regex, &i);
+            literal_char = 0;
+        } else if (c == '.' || c == '^' || c == '$' || c == ')') {
+            i++;
+            literal_char = 0;
+        } else {
+            i++;
+        }
 
-    rerere_strbuf_putconflict(pre_out_buf, '<', marker_size);
+        if (literal_char &&
+            (regex[i] == '?' || regex[i] == '*' ||
+             (regex[i] == '{' && regex[i + 1] == '0')))
+            literal_char = 0; /* optional */
+        else if (literal_char)
+            strbuf_addch(&run, c);
+        if (!literal_char || regex[i] == '+' || regex[i] == '{') {
+            if (run.len > literal->len)
+                strbuf_swap(&run, literal);
+            strbuf_reset(&run);
+            skip_regex_quantifier(regex, &i);
+        }
+    }
+    if (run.len > literal->len)
+        strbuf_swap(&run, literal);
+    strbuf_release(&run);
+    return;
 
-    // current file
-    if (separate_conflict_area(cur_io,&cur_buf_A,&cur_buf_B,marker_size,&cur_list_A,&cur_list_B) < 0)
-        return -1;
+no_literal:
+    strbuf_release(&run);
+}
 
-    // preimage file
-    if (separate_conflict_area(pre_io,&pre_buf_A,&pre_buf_B,marker_size,&pre_list_A,&pre_list_B) <0)
-        return -1;
+static void free_rule_prefilter(struct rule_prefilter *rules)
+{
+    int i;
 
-    //get preimage line after '>' marker... this is necessary to understand where the conflict area ends in postimage
-    pre->getline(&end_pre_buf,pre);
-    //fprintf_ln(stderr, _("control_conflict_area: end_pre_buf: %s"),end_pre_buf.buf);
-    // < 0 : one < two
-    // = 0 : one = two
-    // > 0 : one > two
-    if (strbuf_cmp(&cur_buf_A, &cur_buf_B) > 0) {
-        strbuf_swap(&cur_buf_A,&cur_buf_B);
-        SWAP(cur_list_A,cur_list_B);
+    if (!rules)
+        return;
+    if (rules->kws)
+        kwsfree(rules->kws);
+    for (i = 0; i < rules->literals.nr; i++) {
+        struct rule_literal *lit = rules->literals.items[i].util;
+
+        string_list_clear(&lit->clusters, 0);
+        free(lit->prefixes);
+        free(lit);
     }
+    string_list_clear(&rules->literals, 0);
+    string_list_clear(&rules->unfiltered, 0);
+    string_list_clear(&rules->clusters, 0);
+    free(rules);
+}
 
-    if (strbuf_cmp(&cur_buf_A, &pre_buf_B) == 0 && strbuf_cmp(&cur_buf_B, &pre_buf_A) != 0) {
-        strbuf_swap(&pre_buf_A,&pre_buf_B);
-        SWAP(pre_list_A,pre_list_B);
-    } else if (strbuf_cmp(&cur_buf_B, &pre_buf_A) == 0 && strbuf_cmp(&cur_buf_A, &pre_buf_B) != 0) {
-        strbuf_swap(&pre_buf_A,&pre_buf_B);
-        SWAP(pre_list_A,pre_list_B);
-    }
+/* the value of "key" in the config.properties of the jars of the shard */
+static char *jar_config_value(struct conflict_shard *shard, const char *key)
+{
+    struct strbuf config = STRBUF_INIT;
+    char *path = xstrfmt("%sconfig.properties", shard->jar_dir);
+    char *value = NULL;
+    const char *line, *v;
 
-    //get postimage line and compare it to preimage areas to determine the area to which it belongs
-    while(!post->getline(&post_buf,post)) {
-        //fprintf_ln(stderr, _("control_conflict_area: post_buf: %s"),post_buf.buf);
-        if (strbuf_cmp(&post_buf,&end_pre_buf) == 0) {
+    line = strbuf_read_file(&config, path, 0) < 0 ? "" : config.buf;
+    while (*line) {
+        const char *eol = strchrnul(line, '\n');
+
+        if (skip_prefix(line, key, &v) && *v == '=') {
+            value = xstrndup(v + 1, strcspn(v + 1, "\r\n"));
             break;
         }
-        string_list_append(&post_list,post_buf.buf);
+        line = *eol ? eol + 1 : eol;
+    }
+    free(path);
+    strbuf_release(&config);
+    return value;
+}
+
+/*
+ * The rules are in the regex_file the jar is configured with, as
+ * {"<cluster>": [{"regex": ..., "replacement": ...}, ...], ...}, or
+ * next to the conflict index when there is no such configuration.
+ */
+static char *shard_regex_file(struct conflict_shard *shard)
+{
+    char *file = jar_config_value(shard, "regex_file");
+
+    if (file)
+        return file;
+    if (!*shard->name)
+        return xstrdup(git_path("rr-cache/regex_replace_index.json"));
+    return xstrfmt("%sregex_replace_index.json", shard->jar_dir);
+}
 
-        if (unsorted_string_list_has_string(&pre_list_A,post_buf.buf)) { // present in part A
-            if (!unsorted_string_list_has_string(&pre_list_B,post_buf.buf)) { // non present in part B
-                conflict_area = RR_SIDE_1; // set side A
+static struct rule_prefilter *shard_rules(struct conflict_shard *shard)
+{
+    struct strbuf literal = STRBUF_INIT;
+    struct json_object *regex_index;
+    struct json_object_iter it;
+    struct rule_prefilter *rules;
+    char *file;
+    int i, j;
+
+    if (shard->rules_loaded)
+        return shard->rules;
+    shard->rules_loaded = 1;
+
+    file = shard_regex_file(shard);
+    regex_index = json_object_from_file(file);
+    free(file);
+    if (!regex_index)
+        return NULL;
+
+    rules = xcalloc(1, sizeof(*rules));
+    string_list_init(&rules->literals, 1);
+    string_list_init(&rules->unfiltered, 1);
+    string_list_init(&rules->clusters, 1);
+    json_object_object_foreachC(regex_index, it) {
+        int arraylen = json_object_array_length(it.val);
+
+        for (i = 0; i < arraylen; i++) {
+            struct json_object *rule = json_object_array_get_idx(it.val, i);
+            const char *regex = json_object_get_string(json_object_object_get(rule, "regex"));
+            struct string_list_item *item;
+
+            if (!regex)
+                continue;
+            string_list_insert(&rules->clusters, it.key);
+            required_literal(regex, &literal);
+            if (!literal.len) {
+                string_list_insert(&rules->unfiltered, it.key);
+                continue;
             }
-        }else if (unsorted_string_list_has_string(&pre_list_B,post_buf.buf)) { // present in part B
-            if (unsorted_string_list_has_string(&pre_list_B,post_buf.buf)) { // not present in part A
-                conflict_area = RR_SIDE_2; // set side B
+            item = unsorted_string_list_lookup(&rules->literals, literal.buf);
+            if (!item) {
+                struct rule_literal *lit = xcalloc(1, sizeof(*lit));
+
+                if (!rules->kws)
+                    rules->kws = kwsalloc(NULL);
+                kwsincr(rules->kws, literal.buf, literal.len);
+                string_list_init(&lit->clusters, 1);
+                item = string_list_append(&rules->literals, literal.buf);
+                item->util = lit;
             }
+            string_list_insert(&((struct rule_literal *)item->util)->clusters, it.key);
         }
     }
+    /* where a literal matches, the literals it starts with match too */
+    for (i = 0; i < rules->literals.nr; i++) {
+        struct rule_literal *lit = rules->literals.items[i].util;
 
-    if (conflict_area == RR_NO_SIDE)
-        return -1;
+        for (j = 0; j < rules->literals.nr; j++) {
+            const char *prefix = rules->literals.items[j].string;
 
-    // compare part A of current and preimage file
-    if (control_line_character(&cur_list_A,&pre_list_A,pre_out_buf) < 0){
-        return -1;
+            if (j != i && starts_with(rules->literals.items[i].string, prefix)) {
+                ALLOC_GROW(lit->prefixes, lit->nr_prefixes + 1, lit->alloc_prefixes);
+                lit->prefixes[lit->nr_prefixes++] = j;
+            }
+        }
     }
+    if (rules->kws)
+        kwsprep(rules->kws);
+    json_object_put(regex_index);
+    strbuf_release(&literal);
+    shard->rules = rules;
+    return rules;
+}
 
-    rerere_strbuf_putconflict(pre_out_buf, '=', marker_size);
+static void add_literal_clusters(struct rule_prefilter *rules, int n, char *seen,
+                                 struct string_list *clusters)
+{
+    struct rule_literal *lit = rules->literals.items[n].util;
+    int i;
 
-    // compare part B of current and preimage file
-    if (control_line_character(&cur_list_B,&pre_list_B,pre_out_buf) < 0){
-        return -1;
-    }
+    if (seen[n])
+        return;
+    seen[n] = 1;
+    for (i = 0; i < lit->clusters.nr; i++)
+        string_list_insert(clusters, lit->clusters.items[i].string);
+}
 
-    rerere_strbuf_putconflict(pre_out_buf, '>', marker_size);
+/*
+ * Add to "clusters" those with a rule that may match "text", scanning
+ * it once for all the literals.  The kwset reports the longest keyword
+ * at each position, and the shorter ones starting there are those it
+ * starts with.
+ */
+static void candidate_rule_clusters(struct rule_prefilter *rules, const char *text,
+                                    struct string_list *clusters)
+{
+    size_t len = strlen(text), pos = 0;
+    char *seen = xcalloc(rules->literals.nr ? rules->literals.nr : 1, 1);
+    int i;
 
-    if (conflict_area == RR_SIDE_1) {
-        fprintf_ln(stderr, _("control_conflict_area: SIDE 11111111111"));
-        if (control_line_character(&cur_list_A,&post_list,post_out_buf) < 0){
-            return -1;
-        }
-    }
+    for (i = 0; i < rules->unfiltered.nr; i++)
+        string_list_insert(clusters, rules->unfiltered.items[i].string);
+    while (rules->kws && pos < len) {
+        struct kwsmatch kwsm;
+        size_t offset = kwsexec(rules->kws, text + pos, len - pos, &kwsm);
+        struct rule_literal *lit;
 
-    if (conflict_area == RR_SIDE_2) {
-        fprintf_ln(stderr, _("control_conflict_area: SIDE 222222222222"));
-        if (control_line_character(&cur_list_B,&post_list,post_out_buf) < 0){
-            return -1;
-        }
+        if (offset == -1)
+            break;
+        pos += offset;
+        lit = rules->literals.items[kwsm.index].util;
+        if (!seen[kwsm.index])
+            for (i = 0; i < lit->nr_prefixes; i++)
+                add_literal_clusters(rules, lit->prefixes[i], seen, clusters);
+        add_literal_clusters(rules, kwsm.index, seen, clusters);
+        pos++;
     }
+    free(seen);
+}
 
-    if (end_pre_buf.len >= 0){
-        strbuf_addbuf(pre_out_buf,&end_pre_buf);
-        strbuf_addbuf(post_out_buf,&end_pre_buf);
-    }
+/*
+ * Whether a rule learned for "group_id" may apply to "conflict"; when
+ * we do not know the rules of the cluster, the jar has to find out.
+ */
+static int cluster_rules_may_match(struct conflict_shard *shard, const char *group_id,
+                                   const char *conflict)
+{
+    struct rule_prefilter *rules = shard_rules(shard);
+    struct string_list candidates = STRING_LIST_INIT_DUP;
+    int ret;
 
-    strbuf_release(&cur_buf_A);
-    strbuf_release(&cur_buf_B);
-    strbuf_release(&pre_buf_A);
-    strbuf_release(&pre_buf_B);
+    if (!rules || !string_list_has_string(&rules->clusters, group_id))
+        return 1;
+    candidate_rule_clusters(rules, conflict, &candidates);
+    ret = string_list_has_string(&candidates, group_id);
+    string_list_clear(&candidates, 0);
+    return ret;
+}
+
+static void clear_conflict_shards(void)
+{
+    int i;
+
+    for (i = 0; i < conflict_shards.nr; i++) {
+        struct conflict_shard *shard = conflict_shards.items[i].util;
+
+        if (shard->index)
+            json_object_put(shard->index);
+        string_list_clear(&shard->changed_groups, 0);
+        write_cluster_summaries(shard);
+        string_list_clear(&shard->summaries, 1);
+        stat_validity_clear(&shard->index_validity);
+        stat_validity_clear(&shard->journal_validity);
+        if (shard->digests_loaded)
+            oidset_clear(&shard->digests);
+        free_rule_prefilter(shard->rules);
+        free(shard->digest_file);
+        free(shard->synth_file);
+        free(shard->summary_file);
+        free(shard->journal_file);
+        free(shard->index_file);
+        free(shard->jar_dir);
+    }
+    string_list_clear(&conflict_shards, 1);
+}
+
+static void add_suggestion_field(struct strbuf *sb, const char *field)
+{
+    strbuf_addstr(sb, field ? field : "");
+    strbuf_addch(sb, '\0');
+}
+
+/*
+ * With rerere.cacheDaemon, matching a hunk with the clusters and
+ * recording a pair are left to "git rerere-cache--daemon", which keeps
+ * the cluster indexes in memory instead of every git process reading
+ * them again.  Its socket is in the rr-cache directory, so that all the
+ * worktrees of a repository share it.  A request is NUL terminated
+ * fields: "match" or "record", the shard, the conflict and, to record
+ * it, the resolution; the answer is "1" and the cluster, or "0".  When
+ * there is no daemon and one cannot be started, the work is done here
+ * as usual.
+ */
+static int rerere_cache_daemon;
+static int serving_cache; /* set in the daemon itself */
+
+GIT_PATH_FUNC(git_path_rerere_cache_socket, "rr-cache/daemon/socket")
+
+#ifndef NO_UNIX_SOCKETS
+static int send_cache_request(const char *socket, const struct strbuf *request,
+                              struct strbuf *reply)
+{
+    int fd = unix_stream_connect(socket), ret = 0;
+
+    if (fd < 0)
+        return -1;
+    strbuf_reset(reply);
+    if (write_in_full(fd, request->buf, request->len) < 0)
+        ret = -1;
+    else if (shutdown(fd, SHUT_WR) < 0 || strbuf_read(reply, fd, 0) < 0)
+        ret = -1;
+    close(fd);
+    return ret;
+}
+
+static void spawn_cache_daemon(const char *socket)
+{
+    struct child_process daemon = CHILD_PROCESS_INIT;
+    char buf[128];
+    int r;
+
+    argv_array_pushl(&daemon.args, "rerere-cache--daemon", socket, NULL);
+    daemon.git_cmd = 1;
+    daemon.no_stdin = 1;
+    daemon.out = -1;
+    if (start_command(&daemon))
+        return;
+    /* another process may have started one first, we only wait for ours */
+    r = read_in_full(daemon.out, buf, sizeof(buf));
+    if (r != 3 || memcmp(buf, "ok\n", 3))
+        warning(_("rerere cache daemon did not start"));
+    close(daemon.out);
+}
+
+static int cache_request(const struct strbuf *request, struct strbuf *reply)
+{
+    static char *socket;
+    static int unavailable;
+
+    if (unavailable)
+        return -1;
+    if (!socket)
+        socket = xstrdup(absolute_path(git_path_rerere_cache_socket()));
+    if (!send_cache_request(socket, request, reply) && reply->len)
+        return 0;
+    spawn_cache_daemon(socket);
+    if (!send_cache_request(socket, request, reply) && reply->len)
+        return 0;
+    unavailable = 1;
+    return -1;
+}
+#else
+static int cache_request(const struct strbuf *request, struct strbuf *reply)
+{
+    return -1;
+}
+#endif
+
+/*
+ * 1 with the cluster in "group" when the daemon answered with one, 0
+ * when it answered without, -1 when there is no daemon to ask.
+ */
+static int ask_cache_daemon(const char *action, struct conflict_shard *shard,
+                            const char *conflict, const char *resolution,
+                            struct strbuf *group)
+{
+    struct strbuf request = STRBUF_INIT, reply = STRBUF_INIT;
+    int ret = -1;
+
+    add_suggestion_field(&request, action);
+    add_suggestion_field(&request, shard->name);
+    add_suggestion_field(&request, conflict);
+    if (resolution)
+        add_suggestion_field(&request, resolution);
+    if (!cache_request(&request, &reply)) {
+        ret = reply.buf[0] == '1' && reply.len > 2;
+        strbuf_reset(group);
+        if (ret)
+            strbuf_addstr(group, reply.buf + 2);
+    }
+    strbuf_release(&request);
+    strbuf_release(&reply);
+    return ret;
+}
+
+/*
+ * return id of the group with jaro-winkler similarity greater than 0.90 or
+ * return a new id
+ * resolution can be null if you want only group id
+ */
+static const char* get_conflict_json_id(struct conflict_shard *shard, char* conflict,char* resolution)
+{
+    //fprintf_ln(stderr, _("LOG_ENTER: get_conflict_json_id function"));
+
+    if (!resolution && rerere_cache_daemon && !serving_cache) {
+        static struct strbuf group = STRBUF_INIT;
+        int ret = ask_cache_daemon("match", shard, conflict, NULL, &group);
+
+        if (ret >= 0)
+            return ret ? group.buf : NULL;
+    }
+
+    struct json_object *file_json = shard_index(shard);
+    if (!file_json) { // if file is empty
+        if (!resolution) { //resolution is NULL
+            return  NULL;
+        }
+        return "1";
+    }
+
+    double jaroW = 0 ;
+    //size_t leve = 0 ;
+    const char* groupId = NULL;
+    double max_sim = similarity_th;
+    char* idCount = "0";
+
+    fprintf_ln(stderr, _("\nconflict: %s"),conflict);
+    //fprintf_ln(stderr, _("resolution: %s\n"),resolution);
+
+    struct json_object *obj;
+    const char* jconf;
+    int arraylen;
+    double total_similarity = 0;
+    json_object_object_foreach(file_json,key,val){
+        obj = NULL;
+        arraylen = json_object_array_length(val);
+        idCount = key;
+        total_similarity = 0;
+        for (int i = 0; i < arraylen; i++) {
+            obj = json_object_array_get_idx(val, i);
+            jconf = json_object_get_string(json_object_object_get(obj, "conflict"));
+
+            jaroW = jaro_winkler_distance(conflict,jconf);
+            total_similarity += jaroW;
+        }
+        double avg = total_similarity/arraylen;
+        if (avg >= max_sim) {
+            max_sim = avg;
+            groupId = key;
+        }
+    }
+
+    if (!groupId && resolution) { //if group == null and resolution != null
+        //create new group id
+        if (cluster_budget()) {
+            //ids of evicted clusters are not given out again
+            load_cluster_summaries(shard);
+            groupId = json_object_to_json_string(json_object_new_int(shard->next_group));
+        } else {
+            groupId = json_object_to_json_string(json_object_new_int(atoi(idCount)+1));
+        }
+    }
+    /* only recording a pair keeps its cluster warm, not looking it up */
+    if (groupId && resolution)
+        touch_cluster(shard, groupId);
+
+    fprintf_ln(stderr, _("groupID:  %s"),groupId);
+    //fprintf_ln(stderr, _("LOG_EXIT: get_conflict_json_id : groupID %s"),groupId);
+    return groupId;
+}
+/*
+ * return 1 if it is multiline otherwise return 0
+ */
+static int is_multiline_string(char* string)
+{
+    char *line = strdup(string);
+    strtok(line,"\n");
+    char * secondline= strtok(NULL, "\n");
+    if(secondline != NULL){
+        fprintf_ln(stderr, _("Multiline String is not accepted"));
+        free(line);
+        return 1;
+    }
+    free(line);
+    return 0;
+}
+
+static int write_json_conflict_index(struct conflict_shard *shard, char* conflict, char* resolution)
+{
+    struct object_id digest;
+    int slot;
+
+    //fprintf_ln(stderr, _("LOG_ENTER: write_json_conflict_index function"));
+
+    if (only_spaces(conflict) || only_spaces(resolution))
+        return 0;
+
+    if (rerere_cache_daemon && !serving_cache) {
+        struct strbuf group = STRBUF_INIT;
+        int ret = ask_cache_daemon("record", shard, conflict, resolution, &group);
+
+        if (ret > 0)
+            string_list_insert(&shard->changed_groups, group.buf);
+        strbuf_release(&group);
+        if (ret >= 0)
+            return ret;
+    }
+
+    //conflict and resolution already present in json file
+    hash_conflict_pair(&digest, conflict, resolution);
+    if (oidset_contains(shard_digests(shard), &digest))
+        return 0;
+
+    struct json_object *file_json = shard_index(shard);
+
+    if (!file_json) // if file is empty
+        file_json = shard->index = json_object_new_object();
+
+    const char* group_id = get_conflict_json_id(shard,conflict,resolution);
+
+    if (!group_id)
+        return 0;
+
+    if (!json_object_object_get_ex(file_json, group_id, NULL))
+        evict_cold_clusters(shard);
+    slot = cluster_slot(shard, group_id);
+    if (slot == -2) {
+        /* the sample keeps its members, but the pair is counted once */
+        record_conflict_digest(shard, &digest);
+        return 0;
+    }
+    if (append_journal_pair(shard->index_file, shard->journal_file, group_id, slot,
+                            conflict, resolution))
+        return 0;
+    if (slot >= 0) {
+        struct json_object *jarray = json_object_object_get(file_json, group_id);
+
+        forget_conflict_pair(shard, json_object_array_get_idx(jarray, slot));
+        replace_conflict_pair(jarray, slot, conflict, resolution);
+    } else
+        add_conflict_pair(file_json, group_id, conflict, resolution);
+    record_conflict_digest(shard, &digest);
+    write_shard_jar_config(shard);
+    compact_journal_if_large(shard->index_file, shard->journal_file);
+
+    // write conflict list file
+    if (append_journal(git_path_conflict_list(), git_path_conflict_list_journal(),
+                       "conflicts_list", conflict, resolution))
+        return 0;
+    compact_journal_if_large(git_path_conflict_list(), git_path_conflict_list_journal());
+
+    //save cluster id for jar file
+    string_list_insert(&shard->changed_groups,group_id);
+
+    //fprintf_ln(stderr, _("LOG_EXIT: write_json_conflict_index function"));
+    return 1;
+}
+
+static int handle_conflict(struct strbuf *out, struct rerere_io *io,
+                           int marker_size, git_hash_ctx *ctx)
+{
+    enum {
+        RR_SIDE_1 = 0, RR_SIDE_2, RR_ORIGINAL
+    } hunk = RR_SIDE_1;
+    struct strbuf one = STRBUF_INIT, two = STRBUF_INIT;
+    struct strbuf buf = STRBUF_INIT, conflict = STRBUF_INIT;
+    int has_conflicts = -1;
+
+    while (!io->getline(&buf, io)) {
+        if (is_cmarker(buf.buf, '<', marker_size)) {
+            if (handle_conflict(&conflict, io, marker_size, NULL) < 0)
+                break;
+            if (hunk == RR_SIDE_1)
+                strbuf_addbuf(&one, &conflict);
+            else
+                strbuf_addbuf(&two, &conflict);
+            strbuf_release(&conflict);
+        } else if (is_cmarker(buf.buf, '|', marker_size)) {
+            if (hunk != RR_SIDE_1)
+                break;
+            hunk = RR_ORIGINAL;
+        } else if (is_cmarker(buf.buf, '=', marker_size)) {
+            if (hunk != RR_SIDE_1 && hunk != RR_ORIGINAL)
+                break;
+            hunk = RR_SIDE_2;
+        } else if (is_cmarker(buf.buf, '>', marker_size)) {
+            if (hunk != RR_SIDE_2)
+                break;
+            // < 0 : one < two
+            // = 0 : one = two
+            // > 0 : one > two
+            if (strbuf_cmp(&one, &two) > 0) // if one > two then swap
+                strbuf_swap(&one, &two);
+            has_conflicts = 1;
+            //preparing output out
+            rerere_strbuf_putconflict(out, '<', marker_size); //add < marker_size time in out
+            strbuf_addbuf(out, &one); // add content of one in out
+            rerere_strbuf_putconflict(out, '=', marker_size); // add = marker_size time in out
+            strbuf_addbuf(out, &two); // add content of two in out
+            rerere_strbuf_putconflict(out, '>', marker_size); // add > marker_size time in out
+            if (ctx) {
+                the_hash_algo->update_fn(ctx, one.buf ?
+                                              one.buf : "",
+                                         one.len + 1);
+                the_hash_algo->update_fn(ctx, two.buf ?
+                                              two.buf : "",
+                                         two.len + 1);
+            }
+            break;
+        } else if (hunk == RR_SIDE_1)
+            strbuf_addbuf(&one, &buf);
+        else if (hunk == RR_ORIGINAL)
+            ; /* discard */
+        else if (hunk == RR_SIDE_2)
+            strbuf_addbuf(&two, &buf);
+    }
+    strbuf_release(&one);
+    strbuf_release(&two);
+    strbuf_release(&buf);
+
+    return has_conflicts;
+}
+
+/*
+ * Read contents a file with conflicts, normalize the conflicts
+ * by (1) discarding the common ancestor version in diff3-style,
+ * (2) reordering our side and their side so that whichever sorts
+ * alphabetically earlier comes before the other one, while
+ * computing the "conflict ID", which is just an SHA-1 hash of
+ * one side of the conflict, NUL, the other side of the conflict,
+ * and NUL concatenated together.
+ *
+ * Return 1 if conflict hunks are found, 0 if there are no conflict
+ * hunks and -1 if an error occured.
+ */
+static int handle_path(unsigned char *hash, struct rerere_io *io, int marker_size)
+{
+    git_hash_ctx ctx;
+    struct strbuf buf = STRBUF_INIT, out = STRBUF_INIT;
+    int has_conflicts = 0;
+    if (hash)
+        the_hash_algo->init_fn(&ctx);
+
+    while (!io->getline(&buf, io)) {
+        if (is_cmarker(buf.buf, '<', marker_size)) {
+            has_conflicts = handle_conflict(&out, io, marker_size,
+                                            hash ? &ctx : NULL);
+            if (has_conflicts < 0)
+                break;
+            rerere_io_putmem(out.buf, out.len, io);
+            strbuf_reset(&out);
+        } else
+            rerere_io_putstr(buf.buf, io);
+    }
+    strbuf_release(&buf);
+    strbuf_release(&out);
+
+    if (hash)
+        the_hash_algo->final_fn(hash, &ctx);
+
+    return has_conflicts;
+}
+
+/*
+ * Require the exact number of conflict marker letters, no more, no
+ * less, followed by SP or any whitespace
+ * (including LF).
+ */
+static int my_cmarker(char *buf, int marker_char, int marker_size)
+{
+    while (marker_size--) {
+        if (*buf++ != marker_char) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/*
+ * Suggestions for single-line hunks are computed by RegexReplacement.jar,
+ * which takes far too long to run while "git merge" or "git commit" is
+ * waiting.  Instead, the hunks are queued in $GIT_DIR/rr-cache/suggest-queue
+ * as NUL terminated "path", "shard", "cluster id" and "conflict" fields, and
+ * a background "git rerere suggest --process" fills
+ * $GIT_DIR/rr-cache/suggestions with "path", "shard", "cluster id",
+ * "conflict", "regex", "replacement" and "result" records that
+ * "git rerere suggest" shows later.
+ */
+#define SUGGEST_QUEUE_FIELDS 4
+#define SUGGESTION_FIELDS 7
+static int rerere_suggest_async = 1;
+static int rerere_jar_synthesis = 1;
+static int rerere_synthesis_jobs = 1;
+static struct strbuf suggestion_queue = STRBUF_INIT;
+static int synthesis_queued; /* for the worker, see learn_cluster_rules() */
+
+static GIT_PATH_FUNC(git_path_suggest_queue, "rr-cache/suggest-queue")
+static GIT_PATH_FUNC(git_path_suggest_worker, "rr-cache/suggest-worker")
+static GIT_PATH_FUNC(git_path_suggestions, "rr-cache/suggestions")
+
+/*
+ * Ask RegexReplacement.jar to apply the rules learned for cluster
+ * "group_id" to "conflict", and keep the candidate (out of at most two)
+ * whose result is the closest to the conflict.
+ * Return 0 when a suggestion was found.
+ */
+static int run_suggestion_jar(struct conflict_shard *shard,
+                              const char *group_id, const char *conflict,
+                              struct strbuf *regex, struct strbuf *replacement,
+                              struct strbuf *result)
+{
+    struct strbuf buf1 = STRBUF_INIT, buf2 = STRBUF_INIT, buf3 = STRBUF_INIT;
+    struct rerere_io_file io;
+    int status, ret = -1;
+    pid_t pid = fork();
+
+    if (pid < 0)
+        return error_errno(_("fork failed"));
+    if (pid == 0) { // child process
+        /* open /dev/null for writing */
+        int fd = open(".git/rr-cache/string_replace.txt", O_RDWR | O_CREAT, S_IRUSR | S_IWUSR);
+        dup2(fd, 1);    /* make stdout a copy of fd (> /dev/null) */
+        //dup2(fd, 2);    /* ...and same with stderr */
+        close(fd);
+        execl("/usr/bin/java", "/usr/bin/java", "-jar", search_replace_path("RegexReplacement.jar"),shard->jar_dir,group_id,conflict,(char*)0);
+        _exit(127);
+    }
+    //parent process
+    if (waitpid(pid, &status, 0) < 0 || status)
+        return -1;
+
+    memset(&io, 0, sizeof(io));
+    io.io.getline = rerere_file_getline;
+    io.input = fopen(".git/rr-cache/string_replace.txt", "r");
+    if (!io.input)
+        return -1;
+
+    // read first resolution
+    if (!io.io.getline(&buf1, &io.io) && !io.io.getline(&buf2, &io.io) && !io.io.getline(&buf3, &io.io)) {
+        strbuf_addbuf(regex, &buf1);
+        strbuf_addbuf(replacement, &buf2);
+        strbuf_addbuf(result, &buf3);
+        ret = 0;
+    }
+    // read second resolution, and keep it if it is closer to the conflict
+    if (!ret && !io.io.getline(&buf1, &io.io) && !io.io.getline(&buf2, &io.io) && !io.io.getline(&buf3, &io.io)) {
+        if (jaro_winkler_distance(conflict, result->buf) < jaro_winkler_distance(conflict, buf3.buf)) {
+            strbuf_swap(regex, &buf1);
+            strbuf_swap(replacement, &buf2);
+            strbuf_swap(result, &buf3);
+        }
+    }
+    fclose(io.input);
+    unlink_or_warn(".git/rr-cache/string_replace.txt");
+
+    strbuf_trim_trailing_newline(regex);
+    strbuf_trim_trailing_newline(replacement);
+    strbuf_trim_trailing_newline(result);
+    strbuf_release(&buf1);
+    strbuf_release(&buf2);
+    strbuf_release(&buf3);
+    return ret;
+}
+
+/*
+ * Append "records" to the NUL separated record file at "path",
+ * holding its lock so that concurrent writers do not lose entries.
+ */
+static int append_suggestion_records(const char *path, struct strbuf *records)
+{
+    struct lock_file lock = LOCK_INIT;
+    struct strbuf old = STRBUF_INIT;
+    int fd;
+
+    fd = hold_lock_file_for_update_timeout(&lock, path, 0, 1000);
+    if (fd < 0)
+        return error_errno(_("could not lock '%s'"), path);
+    if (strbuf_read_file(&old, path, 0) < 0 && errno != ENOENT) {
+        rollback_lock_file(&lock);
+        return error_errno(_("could not read '%s'"), path);
+    }
+    if (write_in_full(fd, old.buf, old.len) < 0 ||
+        write_in_full(fd, records->buf, records->len) < 0 ||
+        commit_lock_file(&lock) < 0) {
+        strbuf_release(&old);
+        rollback_lock_file(&lock);
+        return error_errno(_("could not write '%s'"), path);
+    }
+    strbuf_release(&old);
+    return 0;
+}
+
+static void compute_suggestion(struct conflict_shard *shard, const char *path,
+                               const char *group_id, const char *conflict)
+{
+    struct strbuf regex = STRBUF_INIT, replacement = STRBUF_INIT, result = STRBUF_INIT;
+    struct strbuf record = STRBUF_INIT;
+    FILE *fp = fopen(".git/rr-cache/regex_replace_result.txt", "a+");
+
+    if (fp) {
+        fprintf(fp, "\nconflict: %s\n", conflict);
+        fprintf(fp, "groupID: %s\n", group_id);
+    }
+    if (!cluster_rules_may_match(shard, group_id, conflict) ||
+        run_suggestion_jar(shard, group_id, conflict, &regex, &replacement, &result)) {
+        if (fp) {
+            fprintf(fp, "Regex not apply: %s\n", conflict);
+            fclose(fp);
+        }
+        return;
+    }
+    if (fp) {
+        fprintf(fp, "regex: %s\n", regex.buf);
+        fprintf(fp, "replacement: %s\n", replacement.buf);
+        fprintf(fp, "regex & replacement: %s\n", result.buf);
+        fclose(fp);
+    }
+
+    add_suggestion_field(&record, path);
+    add_suggestion_field(&record, shard->name);
+    add_suggestion_field(&record, group_id);
+    add_suggestion_field(&record, conflict);
+    add_suggestion_field(&record, regex.buf);
+    add_suggestion_field(&record, replacement.buf);
+    add_suggestion_field(&record, result.buf);
+    append_suggestion_records(git_path_suggestions(), &record);
+
+    strbuf_release(&record);
+    strbuf_release(&regex);
+    strbuf_release(&replacement);
+    strbuf_release(&result);
+}
+
+/*
+ * Find the cluster "conflict" belongs to and remember the hunk so that
+ * a suggestion can be computed for it, either right away when
+ * rerere.suggestAsync is off, or later by the background worker.
+ */
+static void queue_suggestion(struct conflict_shard *shard, const char *path, char *conflict)
+{
+    const char *group_id = get_conflict_json_id(shard, conflict, NULL);
+
+    if (!group_id)
+        return;
+    if (!rerere_suggest_async) {
+        compute_suggestion(shard, path, group_id, conflict);
+        return;
+    }
+    add_suggestion_field(&suggestion_queue, path);
+    add_suggestion_field(&suggestion_queue, shard->name);
+    add_suggestion_field(&suggestion_queue, group_id);
+    add_suggestion_field(&suggestion_queue, conflict);
+}
+
+/*
+ * Hand the hunks and the clusters queued during this invocation over
+ * to a background worker; we do not wait for it.
+ */
+static void flush_suggestion_queue(void)
+{
+    const char *argv[] = { "rerere", "suggest", "--process", NULL };
+
+    if (suggestion_queue.len &&
+        append_suggestion_records(git_path_suggest_queue(), &suggestion_queue))
+        strbuf_reset(&suggestion_queue);
+    if ((suggestion_queue.len || synthesis_queued) &&
+        run_command_v_opt(argv, RUN_GIT_CMD))
+        warning(_("could not start the rerere suggestion worker"));
+    strbuf_reset(&suggestion_queue);
+    synthesis_queued = 0;
+}
+
+/*
+ * Take over everything that is queued so far, leaving an empty queue
+ * behind for the next "git merge" to fill.
+ */
+static int take_suggestion_queue(struct strbuf *batch)
+{
+    struct lock_file lock = LOCK_INIT;
+    const char *path = git_path_suggest_queue();
+
+    if (hold_lock_file_for_update_timeout(&lock, path, 0, 1000) < 0)
+        return error_errno(_("could not lock '%s'"), path);
+    strbuf_reset(batch);
+    if (strbuf_read_file(batch, path, 0) < 0) {
+        rollback_lock_file(&lock);
+        return errno == ENOENT ? 0 : error_errno(_("could not read '%s'"), path);
+    }
+    unlink_or_warn(path);
+    rollback_lock_file(&lock);
+    return batch->len > 0;
+}
+
+static void process_suggestion_queue(void)
+{
+    struct strbuf batch = STRBUF_INIT;
+
+    do {
+        struct lock_file worker = LOCK_INIT;
+
+        /* somebody else is already draining the queue */
+        if (hold_lock_file_for_update(&worker, git_path_suggest_worker(), 0) < 0)
+            break;
+        while (take_suggestion_queue(&batch) > 0) {
+            const char *p = batch.buf, *end = batch.buf + batch.len;
+
+            while (p < end) {
+                const char *field[SUGGEST_QUEUE_FIELDS];
+                int i;
+
+                for (i = 0; i < ARRAY_SIZE(field) && p < end; i++) {
+                    field[i] = p;
+                    p += strlen(p) + 1;
+                }
+                if (i < ARRAY_SIZE(field)) {
+                    error(_("corrupt '%s'"), git_path_suggest_queue());
+                    break;
+                }
+                compute_suggestion(conflict_shard_named(field[1]),
+                                   field[0], field[2], field[3]);
+            }
+        }
+        rollback_lock_file(&worker);
+        /*
+         * A hunk may have been queued after we last looked but before
+         * we let go of the worker lock, with its own worker giving up.
+         */
+    } while (file_exists(git_path_suggest_queue()));
+    strbuf_release(&batch);
+}
+
+static void show_suggestions(void)
+{
+    struct strbuf buf = STRBUF_INIT;
+    const char *p, *end;
+    int pending = 0;
+
+    if (strbuf_read_file(&buf, git_path_suggest_queue(), 0) > 0)
+        for (p = buf.buf; p < buf.buf + buf.len; p += strlen(p) + 1)
+            pending++;
+    if (pending)
+        fprintf_ln(stderr, Q_("%d suggestion is still being computed.",
+                              "%d suggestions are still being computed.",
+                              pending / SUGGEST_QUEUE_FIELDS),
+                     pending / SUGGEST_QUEUE_FIELDS);
+
+    strbuf_reset(&buf);
+    if (strbuf_read_file(&buf, git_path_suggestions(), 0) < 0) {
+        strbuf_release(&buf);
+        return;
+    }
+    for (p = buf.buf, end = buf.buf + buf.len; p < end;) {
+        const char *field[SUGGESTION_FIELDS];
+        int i;
+
+        for (i = 0; i < ARRAY_SIZE(field) && p < end; i++) {
+            field[i] = p;
+            p += strlen(p) + 1;
+        }
+        if (i < ARRAY_SIZE(field))
+            break;
+        printf("%s\n", field[0]);
+        printf("  conflict:   %s\n", field[3]);
+        printf("  suggestion: %s\n", field[6]);
+        printf("  rule:       s/%s/%s/ (cluster %s%s%s)\n", field[4], field[5],
+               field[1], *field[1] ? "/" : "", field[2]);
+    }
+    strbuf_release(&buf);
+}
+
+/*
+ * Drop the suggestions for the paths that are no longer conflicted,
+ * i.e. that are resolved or gone; "rr" is what MERGE_RR still lists.
+ */
+static void compact_suggestions(struct string_list *rr)
+{
+    struct lock_file lock = LOCK_INIT;
+    const char *fname = git_path_suggestions();
+    struct strbuf buf = STRBUF_INIT, out = STRBUF_INIT;
+    const char *p, *end;
+    int fd;
+
+    if (!file_exists(fname))
+        return;
+    fd = hold_lock_file_for_update_timeout(&lock, fname, 0, 1000);
+    if (fd < 0) {
+        error_errno(_("could not lock '%s'"), fname);
+        return;
+    }
+    if (strbuf_read_file(&buf, fname, 0) < 0) {
+        error_errno(_("could not read '%s'"), fname);
+        rollback_lock_file(&lock);
+        return;
+    }
+    for (p = buf.buf, end = buf.buf + buf.len; p < end;) {
+        const char *record = p;
+        int i;
+
+        for (i = 0; i < SUGGESTION_FIELDS && p < end; i++)
+            p += strlen(p) + 1;
+        if (i < SUGGESTION_FIELDS)
+            break;
+        if (string_list_has_string(rr, record) && file_exists(record))
+            strbuf_add(&out, record, p - record);
+    }
+    if (!out.len) {
+        rollback_lock_file(&lock);
+        unlink_or_warn(fname);
+    } else if (write_in_full(fd, out.buf, out.len) < 0 ||
+               commit_lock_file(&lock))
+        error_errno(_("could not write '%s'"), fname);
+    rollback_lock_file(&lock);
+    strbuf_release(&buf);
+    strbuf_release(&out);
+}
+
+/*
+ * The lines of one side of a conflict hunk, hashed the way xdiff hashes
+ * records, so that the side a postimage line comes from is found
+ * without scanning the lines of both sides for it.
+ */
+struct side_line {
+    struct hashmap_entry ent;
+    const char *line;
+};
+
+static int side_line_cmp(const void *unused_cmp_data,
+                         const void *entry, const void *entry_or_key,
+                         const void *unused_keydata)
+{
+    const struct side_line *a = entry, *b = entry_or_key;
+
+    return strcmp(a->line, b->line);
+}
+
+static unsigned int side_line_hash(const char *line)
+{
+    return (unsigned int)xdiff_hash_string(line, strlen(line), 0);
+}
+
+static void side_lines_init(struct hashmap *side, const struct string_list *lines)
+{
+    int i;
+
+    hashmap_init(side, side_line_cmp, NULL, lines->nr);
+    for (i = 0; i < lines->nr; i++) {
+        struct side_line *e = xmalloc(sizeof(*e));
+
+        hashmap_entry_init(e, side_line_hash(lines->items[i].string));
+        e->line = lines->items[i].string;
+        hashmap_add(side, e);
+    }
+}
+
+/*
+ * 0 if "line" is only found in side A, 1 if it is only found in side
+ * B, and -1 if it does not tell the sides apart.
+ */
+static int postimage_line_side(struct hashmap *side_A, struct hashmap *side_B,
+                               const char *line)
+{
+    struct side_line key;
+    int in_A, in_B;
+
+    hashmap_entry_init(&key, side_line_hash(line));
+    key.line = line;
+    in_A = !!hashmap_get(side_A, &key, NULL);
+    in_B = !!hashmap_get(side_B, &key, NULL);
+    return in_A == in_B ? -1 : in_B;
+}
+
+static int control_whitespace_diff(const char *cur_s, const struct line_key *cur_key,
+                                   const char *pre_s, const struct line_key *pre_key,
+                                   struct strbuf *out_buf)
+{
+    const char *cur = cur_s, *pre = pre_s;
+
+    //fprintf_ln(stderr, _("control_whitespace_diff: ENTER"));
+
+    if (!same_without_spaces(cur_s, cur_key, pre_s, pre_key)) {
+        return 0; // if without whitespaces strings are different
+    }
+
+    // the current line may only add spaces to the preimage line
+    while (*cur) {
+        if (*cur == *pre)
+            pre++;
+        else if (*cur != ' ')
+            return 0;
+        cur++;
+    }
+
+    //only space difference add string to output buffer
+    strbuf_addstr(out_buf, cur_s);
+
+    //fprintf_ln(stderr, _("control_whitespace_diff: EXIT"));
+    return 1;
+}
+
+/*
+ * Find the html comment in "buf"; it is returned in place, with its
+ * length in "len".
+ */
+static const char* get_html_comment(const char *buf, size_t *len)
+{
+    //fprintf_ln(stderr, _("LOG_ENTER: get_html_comment"));
+
+    const char *PATTERN1 = "<!--";
+    const char *PATTERN2 = " <!--";
+    const char *PATTERN3 = "-->";
+    const char *PATTERN4 = "--> ";
+
+    const char *comment = NULL;
+
+    if ((strstr(buf, "<!--") != NULL) && (strstr(buf, "-->") != NULL)) {
+        //if ((strstr(pre_buf->buf, "<!--") == NULL) && (strstr(pre_buf->buf, "-->") == NULL)) {
+
+        const char *start, *end;
+
+        start = strstr(buf, PATTERN2); //comment start with initial space
+        if (!start)
+            start = strstr(buf, PATTERN1); //comment start without initial space
+
+        if (start) {
+            end = strstr(start, PATTERN4); //comment end with space
+            if (!end)
+                end = strstr(start, PATTERN3); //comment end without space
+
+            if (end) {
+                end += strlen(PATTERN3);
+                comment = start;
+                *len = end - start;
+
+                fprintf_ln(stderr, _("COMMENT: %.*s"), (int)*len, comment);
+                fprintf_ln(stderr, _("LOG_EXIT: get_html_comment"));
+                return comment;
+            }
+        } else {
+            fprintf_ln(stderr, _("No Comment Pattern Found"));
+            fprintf_ln(stderr, _("LOG_EXIT: get_html_comment"));
+            return comment;
+        }
+        //}
+    }
+    //fprintf_ln(stderr, _("No HTML Comment Found"));
+    //fprintf_ln(stderr, _("LOG_EXIT: get_html_comment"));
+    return comment;
+}
+
+
+static int control_html_comment(struct strbuf *cur_buf, const struct line_key *cur_key,
+                                struct strbuf *pre_buf, const struct line_key *pre_key,
+                                struct strbuf *out_buf)
+{
+    fprintf_ln(stderr, _("LOG_ENTER: control_html_comment"));
+
+    const char *comment;
+    size_t comment_len, pre_len;
+    if ((comment = get_html_comment(cur_buf->buf, &comment_len)) != NULL){
+        struct line_key key = LINE_KEY_INIT;
+        struct spaceless_text cur = { { NULL } }, text = { { NULL } };
+
+        if (get_html_comment(pre_buf->buf, &pre_len) != NULL) {
+            return -1; // case preimage has already a html comment
+        }
+
+        line_key_add(&key, comment, comment_len);
+        spaceless_add(&cur, cur_buf->buf, cur_buf->len);
+        spaceless_add(&text, comment, comment_len);
+        if (key.hash == cur_key->hash && key.len == cur_key->len &&
+            spaceless_equal(&text, &cur)) {
+            strbuf_addbuf(out_buf,cur_buf); //new line
+            fprintf_ln(stderr, _("LOG_EXIT: control_html_comment: new line with comment"));
+            return 0;
+        }
+
+        // preimage line followed by the comment
+        if (cur_buf->len == pre_buf->len + comment_len &&
+            !memcmp(cur_buf->buf, pre_buf->buf, pre_buf->len) &&
+            !memcmp(cur_buf->buf + pre_buf->len, comment, comment_len)){
+            //two buffers are equal after adding comment to preimage
+            strbuf_addbuf(out_buf,cur_buf);
+            return 1;
+        }
+
+        key = *pre_key;
+        line_key_add(&key, comment, comment_len);
+        memset(&cur, 0, sizeof(cur));
+        memset(&text, 0, sizeof(text));
+        spaceless_add(&cur, cur_buf->buf, cur_buf->len);
+        spaceless_add(&text, pre_buf->buf, pre_buf->len);
+        spaceless_add(&text, comment, comment_len);
+        if (key.hash == cur_key->hash && key.len == cur_key->len &&
+            spaceless_equal(&cur, &text)) {
+            // two strings are equal after adding comment and removing all spaces
+            strbuf_addbuf(out_buf,cur_buf);
+            return 1;
+        }
+
+        // case <!-- <tr></> -->
+        key.hash = LINE_KEY_FNV_BASE;
+        key.len = 0;
+        line_key_add(&key, "<!--", 4);
+        line_key_add(&key, pre_buf->buf, pre_buf->len);
+        line_key_add(&key, "-->", 3);
+        memset(&cur, 0, sizeof(cur));
+        memset(&text, 0, sizeof(text));
+        spaceless_add(&cur, cur_buf->buf, cur_buf->len);
+        spaceless_add(&text, "<!--", 4);
+        spaceless_add(&text, pre_buf->buf, pre_buf->len);
+        spaceless_add(&text, "-->", 3);
+        if (key.hash == cur_key->hash && key.len == cur_key->len &&
+            spaceless_equal(&cur, &text)) {
+            // two strings are equal
+            strbuf_addbuf(out_buf,cur_buf);
+            return 1;
+        }
+    }
+
+    fprintf_ln(stderr, _("No Comment Found"));
+    fprintf_ln(stderr, _("LOG_EXIT: control_html_comment"));
+    return -1;
+}
+
+static int control_line_character(struct conflict_shard *shard, const char *path,
+                                  struct string_list *list_A,struct string_list *list_B, struct strbuf *out_buf)
+{
+    //fprintf_ln(stderr, _("LOG_ENTER: control_line_character"));
+
+    struct strbuf buf_A = STRBUF_INIT, buf_B = STRBUF_INIT;
+    struct line_key *keys_A, *keys_B;
+
+    int cur = 0, pre = 0, res = 0;
+
+    ALLOC_ARRAY(keys_A, list_A->nr);
+    ALLOC_ARRAY(keys_B, list_B->nr);
+    for (int i = 0; i < list_A->nr; i++)
+        line_key_init(&keys_A[i], list_A->items[i].string);
+    for (int i = 0; i < list_B->nr; i++)
+        line_key_init(&keys_B[i], list_B->items[i].string);
+
+    //fprintf_ln(stderr, _("control_line_character: list_A size : %d"),list_A->nr);
+    //fprintf_ln(stderr, _("control_line_character: list_B size : %d"),list_B->nr);
+
+    while (cur < list_A->nr && pre < list_B->nr) {
+
+        strbuf_addstr(&buf_A,list_A->items[cur].string);
+        strbuf_addstr(&buf_B,list_B->items[pre].string);
+
+        //fprintf_ln(stderr, _("cur_buf : %s"),buf_A.buf);
+        //fprintf_ln(stderr, _("pre_buf : %s"),buf_B.buf);
+
+        if (strbuf_cmp(&buf_A, &buf_B) == 0) {
+            strbuf_addbuf(out_buf, &buf_A);
+            fprintf_ln(stderr, _("UGUALIIIII"));
+            cur += 1;
+            pre += 1;
+        } else if (!keys_A[cur].len) {
+            fprintf_ln(stderr, _("VUOTOOO"));
+            strbuf_addbuf(out_buf,&buf_A);
+            cur += 1;
+        } else if ((res = control_html_comment(&buf_A, &keys_A[cur], &buf_B, &keys_B[pre], out_buf)) >= 0) {
+            if (res == 0) //new line with comment
+                cur += 1;
+
+            if (res == 1) { // two strings are equal after adding comment(and removing all spaces)
+                cur += 1;
+                pre += 1;
+            }
+        } else if (control_whitespace_diff(buf_A.buf, &keys_A[cur], buf_B.buf, &keys_B[pre], out_buf)) {
+            cur += 1;
+            pre += 1;
+        } else {
+            fprintf_ln(stderr, _("TWO LINES ARE DIFFERENT."));
+            queue_suggestion(shard, path, buf_A.buf);
+            strbuf_release(&buf_A);
+            strbuf_release(&buf_B);
+            free(keys_A);
+            free(keys_B);
+            fprintf_ln(stderr, _("LOG_EXIT: control_line_character"));
+            return -1;
+        }
+        strbuf_reset(&buf_A);
+        strbuf_reset(&buf_B);
+
+        if (cur < list_A->nr && pre == list_B->nr) { // Assumption: list_A could be bigger than list_B
+            pre -= 1;
+        }
+
+        //fprintf_ln(stderr, _("control_line_character: CUR : %d"),cur);
+        //fprintf_ln(stderr, _("control_line_character: PRE : %d"),pre);
+    }
+    strbuf_release(&buf_A);
+    strbuf_release(&buf_B);
+    free(keys_A);
+    free(keys_B);
+    //fprintf_ln(stderr, _("LOG_EXIT: control_line_character"));
+    return 1;
+}
+
+static int separate_conflict_area(struct rerere_io *io,struct strbuf *buf_A,struct strbuf *buf_B,int marker_size,
+                                  struct string_list *list_A, struct string_list *list_B)
+{
+    //fprintf_ln(stderr, _("LOG_ENTER: separate_conflict_area"));
+    struct strbuf buf = STRBUF_INIT;
+
+    enum {
+        RR_SIDE_1 = 0,  // = 0
+        RR_SIDE_2,      // = 1
+        RR_ORIGINAL     // = 2
+    } hunk = RR_SIDE_1;
+
+    while (!io->getline(&buf,io)) {
+        if(my_cmarker(buf.buf,'<',marker_size)) {
+            continue;
+        } else if (my_cmarker(buf.buf,'|',marker_size)) {
+            if (hunk != RR_SIDE_1)
+                return -1;
+            hunk = RR_ORIGINAL;
+        } else if (my_cmarker(buf.buf, '=', marker_size)) {
+            if (hunk != RR_SIDE_1 && hunk != RR_ORIGINAL)
+                return -1;
+            hunk = RR_SIDE_2;
+        } else if (my_cmarker(buf.buf, '>', marker_size)) {
+            if (hunk != RR_SIDE_2)
+                return -1;
+            break;
+        } else if (hunk == RR_SIDE_1) {
+            strbuf_addbuf(buf_A, &buf);
+            string_list_append(list_A,buf.buf);
+        }
+        else if (hunk == RR_ORIGINAL)
+            ; /* discard */
+        else if (hunk == RR_SIDE_2) {
+            strbuf_addbuf(buf_B, &buf);
+            string_list_append(list_B,buf.buf);
+        }
+    }
+    strbuf_release(&buf);
+    //fprintf_ln(stderr, _("LOG_EXIT: separate_conflict_area"));
+    return 1;
+}
+
+
+/* cur = current file
+ * pre = preimage file
+ * <<<<<<<
+ *    A
+ * =======
+ *    B
+ * >>>>>>>
+ */
+
+static int control_conflict_area(struct conflict_shard *shard, const char *path,
+                                 struct rerere_io *cur,struct rerere_io *pre, struct rerere_io *post,
+                                 struct strbuf *pre_out_buf,struct strbuf *post_out_buf,int marker_size)
+{
+    //fprintf_ln(stderr, _("LOG_ENTER: control_conflict_area"));
+
+    struct rerere_io    *cur_io = cur,
+            *pre_io = pre;
+
+    struct strbuf   cur_buf_A = STRBUF_INIT, cur_buf_B = STRBUF_INIT,
+            pre_buf_A = STRBUF_INIT, pre_buf_B = STRBUF_INIT,
+            end_pre_buf = STRBUF_INIT,
+            post_buf = STRBUF_INIT;
+
+    struct string_list  cur_list_A = STRING_LIST_INIT_DUP, cur_list_B = STRING_LIST_INIT_DUP,
+            pre_list_A = STRING_LIST_INIT_DUP, pre_list_B = STRING_LIST_INIT_DUP,
+            post_list = STRING_LIST_INIT_DUP;
+    struct hashmap side_A, side_B;
+
+    enum {
+        RR_SIDE_1 = 0,  // = 0
+        RR_SIDE_2,      // = 1
+        RR_NO_SIDE,
+    } conflict_area = RR_NO_SIDE;
+
+    rerere_strbuf_putconflict(pre_out_buf, '<', marker_size);
+
+    // current file
+    if (separate_conflict_area(cur_io,&cur_buf_A,&cur_buf_B,marker_size,&cur_list_A,&cur_list_B) < 0)
+        return -1;
+
+    // preimage file
+    if (separate_conflict_area(pre_io,&pre_buf_A,&pre_buf_B,marker_size,&pre_list_A,&pre_list_B) <0)
+        return -1;
+
+    //get preimage line after '>' marker... this is necessary to understand where the conflict area ends in postimage
+    pre->getline(&end_pre_buf,pre);
+    //fprintf_ln(stderr, _("control_conflict_area: end_pre_buf: %s"),end_pre_buf.buf);
+    // < 0 : one < two
+    // = 0 : one = two
+    // > 0 : one > two
+    if (strbuf_cmp(&cur_buf_A, &cur_buf_B) > 0) {
+        strbuf_swap(&cur_buf_A,&cur_buf_B);
+        SWAP(cur_list_A,cur_list_B);
+    }
+
+    if (strbuf_cmp(&cur_buf_A, &pre_buf_B) == 0 && strbuf_cmp(&cur_buf_B, &pre_buf_A) != 0) {
+        strbuf_swap(&pre_buf_A,&pre_buf_B);
+        SWAP(pre_list_A,pre_list_B);
+    } else if (strbuf_cmp(&cur_buf_B, &pre_buf_A) == 0 && strbuf_cmp(&cur_buf_A, &pre_buf_B) != 0) {
+        strbuf_swap(&pre_buf_A,&pre_buf_B);
+        SWAP(pre_list_A,pre_list_B);
+    }
+
+    //get postimage line and compare it to preimage areas to determine the area to which it belongs
+    side_lines_init(&side_A, &pre_list_A);
+    side_lines_init(&side_B, &pre_list_B);
+    while(!post->getline(&post_buf,post)) {
+        //fprintf_ln(stderr, _("control_conflict_area: post_buf: %s"),post_buf.buf);
+        if (strbuf_cmp(&post_buf,&end_pre_buf) == 0) {
+            break;
+        }
+        string_list_append(&post_list,post_buf.buf);
+
+        switch (postimage_line_side(&side_A, &side_B, post_buf.buf)) {
+        case 0: // present in part A only
+            conflict_area = RR_SIDE_1; // set side A
+            break;
+        case 1: // present in part B only
+            conflict_area = RR_SIDE_2; // set side B
+            break;
+        }
+    }
+    hashmap_free(&side_A, 1);
+    hashmap_free(&side_B, 1);
+
+    if (conflict_area == RR_NO_SIDE)
+        return -1;
+
+    // compare part A of current and preimage file
+    if (control_line_character(shard, path, &cur_list_A,&pre_list_A,pre_out_buf) < 0){
+        return -1;
+    }
+
+    rerere_strbuf_putconflict(pre_out_buf, '=', marker_size);
+
+    // compare part B of current and preimage file
+    if (control_line_character(shard, path, &cur_list_B,&pre_list_B,pre_out_buf) < 0){
+        return -1;
+    }
+
+    rerere_strbuf_putconflict(pre_out_buf, '>', marker_size);
+
+    if (conflict_area == RR_SIDE_1) {
+        fprintf_ln(stderr, _("control_conflict_area: SIDE 11111111111"));
+        if (control_line_character(shard, path, &cur_list_A,&post_list,post_out_buf) < 0){
+            return -1;
+        }
+    }
+
+    if (conflict_area == RR_SIDE_2) {
+        fprintf_ln(stderr, _("control_conflict_area: SIDE 222222222222"));
+        if (control_line_character(shard, path, &cur_list_B,&post_list,post_out_buf) < 0){
+            return -1;
+        }
+    }
+
+    if (end_pre_buf.len >= 0){
+        strbuf_addbuf(pre_out_buf,&end_pre_buf);
+        strbuf_addbuf(post_out_buf,&end_pre_buf);
+    }
+
+    strbuf_release(&cur_buf_A);
+    strbuf_release(&cur_buf_B);
+    strbuf_release(&pre_buf_A);
+    strbuf_release(&pre_buf_B);
     strbuf_release(&end_pre_buf);
     strbuf_release(&post_buf);
 
-    string_list_clear(&cur_list_A,1);
-    string_list_clear(&cur_list_B,1);
-    string_list_clear(&pre_list_A,1);
-    string_list_clear(&pre_list_B,1);
-    string_list_clear(&post_list,1);
+    string_list_clear(&cur_list_A,1);
+    string_list_clear(&cur_list_B,1);
+    string_list_clear(&pre_list_A,1);
+    string_list_clear(&pre_list_B,1);
+    string_list_clear(&post_list,1);
+
+    //fprintf_ln(stderr, _("LOG_EXIT: control_conflict_area"));
+    return 1;
+}
+
+
+static int compare_n_update(struct conflict_shard *shard, const char *path,
+                            struct rerere_io *cur,struct rerere_io *pre,struct rerere_io *post,
+                            struct strbuf *pre_out_buf,struct strbuf *post_out_buf,int marker_size)
+{
+    //fprintf_ln(stderr, _("LOG_ENTER: compare_n_update"));
+
+    struct strbuf cur_buf = STRBUF_INIT, pre_buf = STRBUF_INIT, post_buf = STRBUF_INIT;
+    int pre_marker_found = 0;
+    int cur_marker_found = 0;
+
+    while (!pre->getline(&pre_buf, pre)) {
+        if (my_cmarker(pre_buf.buf, '<', marker_size)) {
+            pre_marker_found = 1;
+            break;
+        }
+        //increment postimage pointer
+        post->getline(&post_buf,post);
+
+        strbuf_addbuf(pre_out_buf, &pre_buf);
+        strbuf_addbuf(post_out_buf, &post_buf);
+    }
+    while (!cur->getline(&cur_buf, cur)) {
+        if (my_cmarker(cur_buf.buf, '<', marker_size)) {
+            cur_marker_found = 1;
+            break;
+        }
+    }
+
+    do {
+        if (!pre_marker_found && !cur_marker_found) //in preimage or curimage marker not found
+            return 0;
+
+        if (control_conflict_area(shard, path, cur, pre, post, pre_out_buf,post_out_buf, marker_size) < 0) {
+            return -1; //TWO DIFFERENT LINE FOUND, NO FURTHER ACTION
+        }
+
+        cur_marker_found = 0;
+        pre_marker_found = 0;
+
+        while (!pre->getline(&pre_buf, pre)) {
+            if (my_cmarker(pre_buf.buf, '<', marker_size)) {
+                pre_marker_found = 1;
+                break;
+            }
+            // increment postimage pointer
+            post->getline(&post_buf,post);
+            strbuf_addbuf(pre_out_buf, &pre_buf);
+            strbuf_addbuf(post_out_buf, &post_buf);
+        }
+        while (!cur->getline(&cur_buf, cur)) {
+            if (my_cmarker(cur_buf.buf, '<', marker_size)) {
+                cur_marker_found = 1;
+                break;
+            }
+        }
+    } while (my_cmarker(cur_buf.buf, '<', marker_size) && my_cmarker(pre_buf.buf, '<', marker_size));
+
+    strbuf_release(&cur_buf);
+    strbuf_release(&pre_buf);
+    strbuf_release(&post_buf);
+    //fprintf_ln(stderr, _("LOG_EXIT: compare_n_update"));
+    return 1;
+}
+
+/*
+ * Scan the path for conflicts, do the "handle_path()" thing above, and
+ * return the number of conflict hunks found.
+ */
+static int handle_file(struct index_state *istate,
+                       const char *path, unsigned char *hash, const char *output)
+{
+    //fprintf_ln(stderr, _("LOG_ENTER: handle_file function"));
+    int has_conflicts = 0;
+    struct rerere_io_file io;
+    int marker_size = ll_merge_marker_size(istate, path);
+
+    memset(&io, 0, sizeof(io));
+    io.io.getline = rerere_file_getline;
+    io.input = fopen(path, "r");
+    io.io.wrerror = 0;
+    if (!io.input)
+        return error_errno(_("could not open '%s'"), path);
+
+    if (output) {
+        io.io.output = fopen(output, "w");
+        if (!io.io.output) {
+            error_errno(_("could not write '%s'"), output);
+            fclose(io.input);
+            return -1;
+        }
+    }
+
+    has_conflicts = handle_path(hash, (struct rerere_io *)&io, marker_size);
+
+    fclose(io.input);
+    if (io.io.wrerror)
+        error(_("there were errors while writing '%s' (%s)"),
+              path, strerror(io.io.wrerror));
+    if (io.io.output && fclose(io.io.output))
+        io.io.wrerror = error_errno(_("failed to flush '%s'"), path);
+
+    if (has_conflicts < 0) {
+        if (output)
+            unlink_or_warn(output);
+        return error(_("could not parse conflict hunks in '%s'"), path);
+    }
+    if (io.io.wrerror)
+        return -1;
+    //fprintf_ln(stderr, _("LOG_EXIT: handle_file function"));
+    return has_conflicts;
+}
+
+/*
+ * Look at a cache entry at "i" and see if it is not conflicting,
+ * conflicting and we are willing to handle, or conflicting and
+ * we are unable to handle, and return the determination in *type.
+ * Return the cache index to be looked at next, by skipping the
+ * stages we have already looked at in this invocation of this
+ * function.
+ */
+static int check_one_conflict(struct index_state *istate, int i, int *type)
+{
+    const struct cache_entry *e = istate->cache[i];
+
+    if (!ce_stage(e)) {
+        *type = RESOLVED;
+        return i + 1;
+    }
+
+    *type = PUNTED;
+    while (i < istate->cache_nr && ce_stage(istate->cache[i]) == 1)
+        i++;
+
+    /* Only handle regular files with both stages #2 and #3 */
+    if (i + 1 < istate->cache_nr) {
+        const struct cache_entry *e2 = istate->cache[i];
+        const struct cache_entry *e3 = istate->cache[i + 1];
+        if (ce_stage(e2) == 2 &&
+            ce_stage(e3) == 3 &&
+            ce_same_name(e, e3) &&
+            S_ISREG(e2->ce_mode) &&
+            S_ISREG(e3->ce_mode))
+            *type = THREE_STAGED;
+    }
+
+    /* Skip the entries with the same name */
+    while (i < istate->cache_nr && ce_same_name(e, istate->cache[i]))
+        i++;
+    return i;
+}
+
+/*
+ * Scan the index and find paths that have conflicts that rerere can
+ * handle, i.e. the ones that has both stages #2 and #3.
+ *
+ * NEEDSWORK: we do not record or replay a previous "resolve by
+ * deletion" for a delete-modify conflict, as that is inherently risky
+ * without knowing what modification is being discarded.  The only
+ * safe case, i.e. both side doing the deletion and modification that
+ * are identical to the previous round, might want to be handled,
+ * though.
+ */
+static int find_conflict(struct repository *r, struct string_list *conflict)
+{
+    int i;
+
+    if (repo_read_index(r) < 0)
+        return error(_("index file corrupt"));
+
+    for (i = cache_tree_next_unmerged(r->index, 0); i < r->index->cache_nr;
+         i = cache_tree_next_unmerged(r->index, i)) {
+        int conflict_type;
+        const struct cache_entry *e = r->index->cache[i];
+        i = check_one_conflict(r->index, i, &conflict_type);
+        if (conflict_type == THREE_STAGED)
+            string_list_insert(conflict, (const char *)e->name);
+    }
+    return 0;
+}
+
+/*
+ * The merge_rr list is meant to hold outstanding conflicted paths
+ * that rerere could handle.  Abuse the list by adding other types of
+ * entries to allow the caller to show "rerere remaining".
+ *
+ * - Conflicted paths that rerere does not handle are added
+ * - Conflicted paths that have been resolved are marked as such
+ *   by storing RERERE_RESOLVED to .util field (where conflict ID
+ *   is expected to be stored).
+ *
+ * Do *not* write MERGE_RR file out after calling this function.
+ *
+ * NEEDSWORK: we may want to fix the caller that implements "rerere
+ * remaining" to do this without abusing merge_rr.
+ */
+int rerere_remaining(struct repository *r, struct string_list *merge_rr)
+{
+    int i;
+
+    if (setup_rerere(r, merge_rr, RERERE_READONLY))
+        return 0;
+    if (repo_read_index(r) < 0)
+        return error(_("index file corrupt"));
+
+    /* only the paths rerere knows about can have been resolved */
+    for (i = 0; i < merge_rr->nr; i++) {
+        struct string_list_item *it = &merge_rr->items[i];
+
+        if (index_name_pos(r->index, it->string, strlen(it->string)) >= 0) {
+            free_rerere_id(it);
+            it->util = RERERE_RESOLVED;
+        }
+    }
+    for (i = cache_tree_next_unmerged(r->index, 0); i < r->index->cache_nr;
+         i = cache_tree_next_unmerged(r->index, i)) {
+        int conflict_type;
+        const struct cache_entry *e = r->index->cache[i];
+        i = check_one_conflict(r->index, i, &conflict_type);
+        if (conflict_type == PUNTED)
+            string_list_insert(merge_rr, (const char *)e->name);
+    }
+    return 0;
+}
+
+/*
+ * Try using the given conflict resolution "ID" to see
+ * if that recorded conflict resolves cleanly what we
+ * got in the "cur".
+ */
+static int try_merge(struct index_state *istate,
+                     const struct rerere_id *id, const char *path,
+                     mmfile_t *cur, mmbuffer_t *result)
+{
+    //fprintf_ln(stderr, _("LOG_ENTER: try_merge function"));
+    int ret;
+    mmfile_t base = {NULL, 0}, other = {NULL, 0};
+
+    if (read_mmfile(&base, rerere_path(id, "preimage")) ||
+        read_mmfile(&other, rerere_path(id, "postimage")))
+        ret = 1;
+    else
+        /*
+         * A three-way merge. Note that this honors user-customizable
+         * low-level merge driver settings.
+         */
+        ret = ll_merge(result, path, &base, NULL, cur, "", &other, "",
+                       istate, NULL);
+
+    free(base.ptr);
+    free(other.ptr);
+    //fprintf_ln(stderr, _("LOG_EXIT: try_merge function"));
+    return ret;
+}
+
+/*
+ * Find the conflict identified by "id"; the change between its
+ * "preimage" (i.e. a previous contents with conflict markers) and its
+ * "postimage" (i.e. the corresponding contents with conflicts
+ * resolved) may apply cleanly to the contents stored in "path", i.e.
+ * the conflict this time around.
+ *
+ * Returns 0 for successful replay of recorded resolution, or non-zero
+ * for failure.
+ */
+static int merge(struct index_state *istate, const struct rerere_id *id, const char *path)
+{
+    //fprintf_ln(stderr, _("LOG_ENTER: merge function"));
+    FILE *f;
+    int ret;
+    mmfile_t cur = {NULL, 0};
+    mmbuffer_t result = {NULL, 0};
+
+    /*
+     * Normalize the conflicts in path and write it out to
+     * "thisimage" temporary file.
+     */
+    if ((handle_file(istate, path, NULL, rerere_path(id, "thisimage")) < 0) ||
+        read_mmfile(&cur, rerere_path(id, "thisimage"))) {
+        ret = 1;
+        goto out;
+    }
+
+    ret = try_merge(istate, id, path, &cur, &result);
+    if (ret)
+        goto out;
+
+    /*
+     * A successful replay of recorded resolution.
+     * Mark that "postimage" was used to help gc.
+     */
+    if (utime(rerere_path(id, "postimage"), NULL) < 0)
+        warning_errno(_("failed utime() on '%s'"),
+                      rerere_path(id, "postimage"));
+
+    /* Update "path" with the resolution */
+    f = fopen(path, "w");
+    if (!f)
+        return error_errno(_("could not open '%s'"), path);
+    if (fwrite(result.ptr, result.size, 1, f) != 1)
+        error_errno(_("could not write '%s'"), path);
+    if (fclose(f))
+        return error_errno(_("writing '%s' failed"), path);
+
+    out:
+    free(cur.ptr);
+    free(result.ptr);
+    //fprintf_ln(stderr, _("LOG_EXIT: merge function"));
+    return ret;
+}
+
+static void update_paths(struct repository *r, struct string_list *update)
+{
+    struct lock_file index_lock = LOCK_INIT;
+    int i;
+
+    repo_hold_locked_index(r, &index_lock, LOCK_DIE_ON_ERROR);
+
+    for (i = 0; i < update->nr; i++) {
+        struct string_list_item *item = &update->items[i];
+        if (add_file_to_index(r->index, item->string, 0))
+            exit(128);
+        fprintf_ln(stderr, _("Staged '%s' using previous resolution."),
+                   item->string);
+    }
+
+    if (write_locked_index(r->index, &index_lock,
+                           COMMIT_LOCK | SKIP_IF_UNCHANGED))
+        die(_("unable to write new index file"));
+}
+
+static void remove_variant(struct rerere_id *id)
+{
+    unlink_or_warn(rerere_path(id, "postimage"));
+    unlink_or_warn(rerere_path(id, "preimage"));
+    id->collection->status[id->variant] = 0;
+}
+
+static int write_image(const char *path, const struct strbuf *buf)
+{
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+
+    if (fd < 0)
+        return -1;
+    if (write_in_full(fd, buf->buf, buf->len) < 0) {
+        close(fd);
+        return -1;
+    }
+    return close(fd);
+}
+
+/*
+ * control if the hash of the conflict area is changed or not,
+ * if yes then control if what is the difference between preimage and current file.
+ * Return 1 when the resolution of "old_hash" was carried over to "new_hash".
+ */
+static int check_hash_change(struct index_state *istate,
+                             const char *path, const char *old_hash, const char *new_hash)
+{
+    //fprintf_ln(stderr, _("LOG_ENTER: check_hash_change"));
+
+    struct rerere_id *old_id = new_rerere_id_hex((char *)old_hash);
+    struct rerere_id *new_id = new_rerere_id_hex((char *)new_hash);
+    int marker_size = ll_merge_marker_size(istate, path);
+    int migrated = 0;
 
-    //fprintf_ln(stderr, _("LOG_EXIT: control_conflict_area"));
-    return 1;
-}
+    for (int variant = 0; !migrated && variant < old_id->collection->status_nr; variant++) {
 
+        const int both = RR_HAS_PREIMAGE | RR_HAS_POSTIMAGE;
+        struct rerere_id vold_id = *old_id;
+        struct rerere_io_file cur, pre, post;
+        char *cur_path, *pre_path, *post_path;
+        struct strbuf pre_out_buf = STRBUF_INIT;
+        struct strbuf post_out_buf = STRBUF_INIT;
 
-static int compare_n_update(struct rerere_io *cur,struct rerere_io *pre,struct rerere_io *post,
-                            struct strbuf *pre_out_buf,struct strbuf *post_out_buf,int marker_size)
-{
-    //fprintf_ln(stderr, _("LOG_ENTER: compare_n_update"));
+        if ((old_id->collection->status[variant] & both) != both)
+            continue;
+        vold_id.variant = variant;
 
-    struct strbuf cur_buf = STRBUF_INIT, pre_buf = STRBUF_INIT, post_buf = STRBUF_INIT;
-    int pre_marker_found = 0;
-    int cur_marker_found = 0;
+        cur_path = xstrdup(rerere_path(&vold_id, "curimage"));
+        pre_path = xstrdup(rerere_path(&vold_id, "preimage"));
+        post_path = xstrdup(rerere_path(&vold_id, "postimage"));
 
-    while (!pre->getline(&pre_buf, pre)) {
-        if (my_cmarker(pre_buf.buf, '<', marker_size)) {
-            pre_marker_found = 1;
-            break;
+        memset(&cur, 0, sizeof(cur));
+        memset(&pre, 0, sizeof(pre));
+        memset(&post, 0, sizeof(post));
+        cur.io.getline = pre.io.getline = post.io.getline = rerere_file_getline;
+
+        if (handle_file(istate, path, NULL, cur_path) < 0)
+            goto next;
+        cur.input = fopen(cur_path, "r");
+        pre.input = fopen(pre_path, "r");
+        post.input = fopen(post_path, "r");
+        if (!cur.input || !pre.input || !post.input) {
+            error_errno(_("could not open the images of '%s'"), old_hash);
+            goto next;
         }
-        //increment postimage pointer
-        post->getline(&post_buf,post);
 
-        strbuf_addbuf(pre_out_buf, &pre_buf);
-        strbuf_addbuf(post_out_buf, &post_buf);
-    }
-    while (!cur->getline(&cur_buf, cur)) {
-        if (my_cmarker(cur_buf.buf, '<', marker_size)) {
-            cur_marker_found = 1;
-            break;
+        if (compare_n_update(find_conflict_shard(istate, path), path,
+                             (struct rerere_io *)&cur,(struct rerere_io *)&pre,(struct rerere_io *)&post,
+                             &pre_out_buf,&post_out_buf,marker_size) <= 0)
+            goto next;
+
+        mkdir_in_gitdir(rerere_path(new_id, NULL));
+        if (write_image(rerere_path(new_id, "preimage"), &pre_out_buf) ||
+            write_image(rerere_path(new_id, "postimage"), &post_out_buf)) {
+            error_errno(_("could not write the images of '%s'"), new_hash);
+            goto next;
         }
+
+        // new_id has no variant yet, so the images above are its variant 0
+        fit_variant(new_id->collection, 0);
+        new_id->collection->status[0] |= both;
+        migrated = 1;
+        fprintf_ln(stderr, _("Carried the resolution of '%s' over to '%s'"), old_hash, new_hash);
+
+    next:
+        if (cur.input)
+            fclose(cur.input);
+        if (pre.input)
+            fclose(pre.input);
+        if (post.input)
+            fclose(post.input);
+        unlink_or_warn(cur_path);
+        free(cur_path);
+        free(pre_path);
+        free(post_path);
+        strbuf_release(&pre_out_buf);
+        strbuf_release(&post_out_buf);
     }
+    free(old_id);
+    free(new_id);
+    //fprintf_ln(stderr, _("LOG_EXIT: check_hash_change"));
+    return migrated;
+}
 
-    do {
-        if (!pre_marker_found && !cur_marker_found) //in preimage or curimage marker not found
-            return 0;
+/*
+ * A conflict ID changes with every byte of the hunks, so a conflict that
+ * only gained spaces or an html comment since it was resolved gets a new
+ * ID.  $GIT_DIR/rr-cache/fingerprints maps the "fingerprint" of the
+ * hunks, i.e. their hash once blank lines, spaces and html comments are
+ * left out, to the IDs of the conflicts resolved with it, as
+ * "<fingerprint> <conflict ID>" lines, so that such a conflict finds the
+ * resolutions worth carrying over with one lookup.
+ */
+static GIT_PATH_FUNC(git_path_fingerprints, "rr-cache/fingerprints")
 
-        if (control_conflict_area(cur, pre, post, pre_out_buf,post_out_buf, marker_size) < 0) {
-            return -1; //TWO DIFFERENT LINE FOUND, NO FURTHER ACTION
-        }
+struct fingerprint_entry {
+    struct hashmap_entry ent;
+    struct object_id fingerprint;
+    char conflict[GIT_MAX_HEXSZ + 1];
+};
 
-        cur_marker_found = 0;
-        pre_marker_found = 0;
+static struct hashmap fingerprints;
+static int fingerprints_loaded;
 
-        while (!pre->getline(&pre_buf, pre)) {
-            if (my_cmarker(pre_buf.buf, '<', marker_size)) {
-                pre_marker_found = 1;
-                break;
-            }
-            // increment postimage pointer
-            post->getline(&post_buf,post);
-            strbuf_addbuf(pre_out_buf, &pre_buf);
-            strbuf_addbuf(post_out_buf, &post_buf);
-        }
-        while (!cur->getline(&cur_buf, cur)) {
-            if (my_cmarker(cur_buf.buf, '<', marker_size)) {
-                cur_marker_found = 1;
-                break;
-            }
-        }
-    } while (my_cmarker(cur_buf.buf, '<', marker_size) && my_cmarker(pre_buf.buf, '<', marker_size));
+static int fingerprint_entry_cmp(const void *unused_cmp_data,
+                                 const void *entry, const void *entry_or_key,
+                                 const void *unused_keydata)
+{
+    const struct fingerprint_entry *a = entry, *b = entry_or_key;
 
-    strbuf_release(&cur_buf);
-    strbuf_release(&pre_buf);
-    strbuf_release(&post_buf);
-    //fprintf_ln(stderr, _("LOG_EXIT: compare_n_update"));
-    return 1;
+    return !oideq(&a->fingerprint, &b->fingerprint);
+}
+
+static struct fingerprint_entry *add_fingerprint(const struct object_id *fingerprint,
+                                                 const char *conflict)
+{
+    struct fingerprint_entry *e = xmalloc(sizeof(*e));
+
+    hashmap_entry_init(e, oidhash(fingerprint));
+    oidcpy(&e->fingerprint, fingerprint);
+    xsnprintf(e->conflict, sizeof(e->conflict), "%s", conflict);
+    hashmap_add(&fingerprints, e);
+    return e;
+}
+
+static void load_fingerprints(void)
+{
+    const unsigned hexsz = the_hash_algo->hexsz;
+    struct strbuf line = STRBUF_INIT;
+    FILE *in;
+
+    if (fingerprints_loaded)
+        return;
+    hashmap_init(&fingerprints, fingerprint_entry_cmp, NULL, 0);
+    fingerprints_loaded = 1;
+
+    in = fopen(git_path_fingerprints(), "r");
+    if (!in)
+        return;
+    while (strbuf_getline_lf(&line, in) != EOF) {
+        struct object_id fingerprint;
+
+        if (line.len != 2 * hexsz + 1 || line.buf[hexsz] != ' ' ||
+            get_oid_hex(line.buf, &fingerprint))
+            continue;
+        add_fingerprint(&fingerprint, line.buf + hexsz + 1);
+    }
+    strbuf_release(&line);
+    fclose(in);
+}
+
+static void clear_fingerprints(void)
+{
+    if (!fingerprints_loaded)
+        return;
+    hashmap_free(&fingerprints, 1);
+    fingerprints_loaded = 0;
+}
+
+/* add the non-space characters of a hunk line, without its html comment */
+static void add_fingerprint_line(struct strbuf *side, const char *line)
+{
+    const char *end = line + strlen(line);
+    size_t comment_len = 0, len = side->len;
+    const char *comment = get_html_comment(line, &comment_len);
+
+    for (; line < end; line++) {
+        if (line == comment)
+            line += comment_len - 1;
+        else if (!is_line_space(*line))
+            strbuf_addch(side, *line);
+    }
+    if (side->len != len)
+        strbuf_addch(side, '\n');
 }
 
 /*
- * Scan the path for conflicts, do the "handle_path()" thing above, and
- * return the number of conflict hunks found.
+ * Conflict markers of both a working tree file and a preimage, where
+ * they come without labels.
  */
-static int handle_file(struct index_state *istate,
-                       const char *path, unsigned char *hash, const char *output)
+static int image_marker(char *buf, int marker_char, int marker_size)
 {
-    //fprintf_ln(stderr, _("LOG_ENTER: handle_file function"));
-    int has_conflicts = 0;
+    return my_cmarker(buf, marker_char, marker_size) && isspace(buf[marker_size]);
+}
+
+/* add the normalized sides of one hunk, sorted */
+static void add_hunk_fingerprint(git_hash_ctx *ctx, struct strbuf *one, struct strbuf *two)
+{
+    if (strbuf_cmp(one, two) > 0)
+        strbuf_swap(one, two);
+    the_hash_algo->update_fn(ctx, one->buf, one->len + 1);
+    the_hash_algo->update_fn(ctx, two->buf, two->len + 1);
+}
+
+/*
+ * Compute the fingerprint of the conflict hunks in "path" the way
+ * handle_path() computes their ID, sides sorted, but out of the
+ * normalized lines.  Return the number of hunks, or -1 if the file
+ * cannot be read.
+ */
+static int conflict_fingerprint(const char *path, int marker_size,
+                                struct object_id *fingerprint)
+{
+    enum {
+        RR_CONTEXT = 0, RR_SIDE_1, RR_ORIGINAL, RR_SIDE_2
+    } hunk = RR_CONTEXT;
+    struct strbuf buf = STRBUF_INIT, one = STRBUF_INIT, two = STRBUF_INIT;
     struct rerere_io_file io;
-    int marker_size = ll_merge_marker_size(istate, path);
+    git_hash_ctx ctx;
+    int hunks = 0;
 
     memset(&io, 0, sizeof(io));
     io.io.getline = rerere_file_getline;
     io.input = fopen(path, "r");
-    io.io.wrerror = 0;
     if (!io.input)
-        return error_errno(_("could not open '%s'"), path);
+        return -1;
 
-    if (output) {
-        io.io.output = fopen(output, "w");
-        if (!io.io.output) {
-            error_errno(_("could not write '%s'"), output);
-            fclose(io.input);
-            return -1;
+    the_hash_algo->init_fn(&ctx);
+    while (!io.io.getline(&buf, &io.io)) {
+        if (image_marker(buf.buf, '<', marker_size)) {
+            strbuf_reset(&one);
+            strbuf_reset(&two);
+            hunk = RR_SIDE_1;
+        } else if (hunk == RR_CONTEXT) {
+            continue;
+        } else if (image_marker(buf.buf, '|', marker_size)) {
+            hunk = RR_ORIGINAL;
+        } else if (image_marker(buf.buf, '=', marker_size)) {
+            hunk = RR_SIDE_2;
+        } else if (image_marker(buf.buf, '>', marker_size)) {
+            add_hunk_fingerprint(&ctx, &one, &two);
+            hunks++;
+            hunk = RR_CONTEXT;
+        } else if (hunk == RR_SIDE_1) {
+            add_fingerprint_line(&one, buf.buf);
+        } else if (hunk == RR_SIDE_2) {
+            add_fingerprint_line(&two, buf.buf);
         }
     }
+    the_hash_algo->final_fn(fingerprint->hash, &ctx);
+    fclose(io.input);
+    strbuf_release(&buf);
+    strbuf_release(&one);
+    strbuf_release(&two);
+    return hunks;
+}
 
-    has_conflicts = handle_path(hash, (struct rerere_io *)&io, marker_size);
+/*
+ * Remember that "id" resolved a conflict with the fingerprint of its
+ * preimage.
+ */
+static void record_fingerprint(struct index_state *istate, const char *path,
+                               const struct rerere_id *id)
+{
+    struct lock_file lock = LOCK_INIT;
+    struct fingerprint_entry key, *e;
+    const char *fname = git_path_fingerprints();
+    struct strbuf line = STRBUF_INIT;
+    char hex[GIT_MAX_HEXSZ + 1];
+    int fd;
 
-    fclose(io.input);
-    if (io.io.wrerror)
-        error(_("there were errors while writing '%s' (%s)"),
-              path, strerror(io.io.wrerror));
-    if (io.io.output && fclose(io.io.output))
-        io.io.wrerror = error_errno(_("failed to flush '%s'"), path);
+    xsnprintf(hex, sizeof(hex), "%s", rerere_id_hex(id));
 
-    if (has_conflicts < 0) {
-        if (output)
-            unlink_or_warn(output);
-        return error(_("could not parse conflict hunks in '%s'"), path);
+    if (conflict_fingerprint(rerere_path(id, "preimage"),
+                             ll_merge_marker_size(istate, path), &key.fingerprint) < 1)
+        return;
+    load_fingerprints();
+    hashmap_entry_init(&key, oidhash(&key.fingerprint));
+    for (e = hashmap_get(&fingerprints, &key, NULL); e; e = hashmap_get_next(&fingerprints, e))
+        if (!strcmp(e->conflict, hex))
+            return;
+    add_fingerprint(&key.fingerprint, hex);
+
+    strbuf_addf(&line, "%s %s\n", oid_to_hex(&key.fingerprint), hex);
+    if (hold_lock_file_for_update_timeout(&lock, fname, 0, 1000) < 0) {
+        error_errno(_("could not lock '%s'"), fname);
+    } else {
+        fd = open(fname, O_WRONLY | O_APPEND | O_CREAT, 0666);
+        if (fd < 0 || write_in_full(fd, line.buf, line.len) < 0)
+            error_errno(_("could not write '%s'"), fname);
+        if (fd >= 0)
+            close(fd);
+        rollback_lock_file(&lock);
     }
-    if (io.io.wrerror)
-        return -1;
-    //fprintf_ln(stderr, _("LOG_EXIT: handle_file function"));
-    return has_conflicts;
+    strbuf_release(&line);
 }
 
 /*
- * Look at a cache entry at "i" and see if it is not conflicting,
- * conflicting and we are willing to handle, or conflicting and
- * we are unable to handle, and return the determination in *type.
- * Return the cache index to be looked at next, by skipping the
- * stages we have already looked at in this invocation of this
- * function.
+ * The conflict in "path" has no resolution recorded under "id"; carry
+ * over the resolution of a conflict with the same fingerprint, if
+ * compare_n_update() finds it still fits.
  */
-static int check_one_conflict(struct index_state *istate, int i, int *type)
+static void carry_over_fingerprinted_resolution(struct index_state *istate,
+                                                const char *path,
+                                                const struct rerere_id *id)
 {
-    const struct cache_entry *e = istate->cache[i];
+    const int both = RR_HAS_PREIMAGE | RR_HAS_POSTIMAGE;
+    struct fingerprint_entry key, *e;
+    char hex[GIT_MAX_HEXSZ + 1];
+    int variant;
 
-    if (!ce_stage(e)) {
-        *type = RESOLVED;
-        return i + 1;
+    for (variant = 0; variant < id->collection->status_nr; variant++)
+        if ((id->collection->status[variant] & both) == both)
+            return;
+    xsnprintf(hex, sizeof(hex), "%s", rerere_id_hex(id));
+    if (conflict_fingerprint(path, ll_merge_marker_size(istate, path), &key.fingerprint) < 1)
+        return;
+    load_fingerprints();
+    hashmap_entry_init(&key, oidhash(&key.fingerprint));
+    for (e = hashmap_get(&fingerprints, &key, NULL); e; e = hashmap_get_next(&fingerprints, e)) {
+        if (!strcmp(e->conflict, hex) || !is_directory(git_path("rr-cache/%s", e->conflict)))
+            continue;
+        if (check_hash_change(istate, path, e->conflict, hex))
+            break;
     }
+}
 
-    *type = PUNTED;
-    while (i < istate->cache_nr && ce_stage(istate->cache[i]) == 1)
-        i++;
+/*
+ * Drop the fingerprints of conflicts whose resolutions were garbage
+ * collected.
+ */
+static void prune_fingerprints(void)
+{
+    struct lock_file lock = LOCK_INIT;
+    const char *fname = git_path_fingerprints();
+    struct strbuf out = STRBUF_INIT;
+    struct hashmap_iter iter;
+    struct fingerprint_entry *e;
+    int fd;
 
-    /* Only handle regular files with both stages #2 and #3 */
-    if (i + 1 < istate->cache_nr) {
-        const struct cache_entry *e2 = istate->cache[i];
-        const struct cache_entry *e3 = istate->cache[i + 1];
-        if (ce_stage(e2) == 2 &&
-            ce_stage(e3) == 3 &&
-            ce_same_name(e, e3) &&
-            S_ISREG(e2->ce_mode) &&
-            S_ISREG(e3->ce_mode))
-            *type = THREE_STAGED;
+    if (!file_exists(fname))
+        return;
+    fd = hold_lock_file_for_update_timeout(&lock, fname, 0, 1000);
+    if (fd < 0) {
+        error_errno(_("could not lock '%s'"), fname);
+        return;
     }
-
-    /* Skip the entries with the same name */
-    while (i < istate->cache_nr && ce_same_name(e, istate->cache[i]))
-        i++;
-    return i;
+    clear_fingerprints();
+    load_fingerprints();
+    hashmap_iter_init(&fingerprints, &iter);
+    while ((e = hashmap_iter_next(&iter)))
+        if (is_directory(git_path("rr-cache/%s", e->conflict)))
+            strbuf_addf(&out, "%s %s\n", oid_to_hex(&e->fingerprint), e->conflict);
+    if (write_in_full(fd, out.buf, out.len) < 0 || commit_lock_file(&lock))
+        error_errno(_("could not write '%s'"), fname);
+    rollback_lock_file(&lock);
+    clear_fingerprints();
+    strbuf_release(&out);
 }
 
 /*
- * Scan the index and find paths that have conflicts that rerere can
- * handle, i.e. the ones that has both stages #2 and #3.
- *
- * NEEDSWORK: we do not record or replay a previous "resolve by
- * deletion" for a delete-modify conflict, as that is inherently risky
- * without knowing what modification is being discarded.  The only
- * safe case, i.e. both side doing the deletion and modification that
- * are identical to the previous round, might want to be handled,
- * though.
+ * The conflict ID covers all the hunks of a file, so a conflict that
+ * shares all but one of its hunks with a resolved one replays nothing.
+ * $GIT_DIR/rr-cache/hunks maps the fingerprint of each resolved hunk
+ * (see conflict_fingerprint()) to how it was resolved, as NUL terminated
+ * "<fingerprint>" and "<resolution>" fields, the last record of a
+ * fingerprint winning; "rerere forget" appends "-<fingerprint>" records
+ * that drop it, and "rerere gc" rewrites the file without them.  When
+ * no recorded resolution applies to a conflict, the hunks found here
+ * are resolved, and only the others go on to the clusters and the
+ * suggestions.
  */
-static int find_conflict(struct repository *r, struct string_list *conflict)
+static GIT_PATH_FUNC(git_path_hunk_resolutions, "rr-cache/hunks")
+
+struct hunk_resolution {
+    struct hashmap_entry ent;
+    struct object_id fingerprint;
+    char resolution[FLEX_ARRAY];
+};
+
+static struct hashmap hunk_resolutions;
+static int hunk_resolutions_loaded;
+
+static int hunk_resolution_cmp(const void *unused_cmp_data,
+                               const void *entry, const void *entry_or_key,
+                               const void *unused_keydata)
 {
-    int i;
+    const struct hunk_resolution *a = entry, *b = entry_or_key;
 
-    if (repo_read_index(r) < 0)
-        return error(_("index file corrupt"));
+    return !oideq(&a->fingerprint, &b->fingerprint);
+}
 
-    for (i = 0; i < r->index->cache_nr;) {
-        int conflict_type;
-        const struct cache_entry *e = r->index->cache[i];
-        i = check_one_conflict(r->index, i, &conflict_type);
-        if (conflict_type == THREE_STAGED)
-            string_list_insert(conflict, (const char *)e->name);
+static void add_hunk_resolution(const struct object_id *fingerprint, const char *resolution)
+{
+    struct hunk_resolution *e;
+
+    FLEX_ALLOC_STR(e, resolution, resolution);
+    hashmap_entry_init(e, oidhash(fingerprint));
+    oidcpy(&e->fingerprint, fingerprint);
+    free(hashmap_put(&hunk_resolutions, e));
+}
+
+static int remove_hunk_resolution(const struct object_id *fingerprint)
+{
+    struct hunk_resolution key, *e;
+
+    hashmap_entry_init(&key, oidhash(fingerprint));
+    oidcpy(&key.fingerprint, fingerprint);
+    e = hashmap_remove(&hunk_resolutions, &key, NULL);
+    free(e);
+    return !!e;
+}
+
+static const char *find_hunk_resolution(const struct object_id *fingerprint)
+{
+    struct hunk_resolution key, *e;
+
+    hashmap_entry_init(&key, oidhash(fingerprint));
+    oidcpy(&key.fingerprint, fingerprint);
+    e = hashmap_get(&hunk_resolutions, &key, NULL);
+    return e ? e->resolution : NULL;
+}
+
+static void load_hunk_resolutions(void)
+{
+    struct strbuf buf = STRBUF_INIT;
+    const char *p, *end;
+
+    if (hunk_resolutions_loaded)
+        return;
+    hashmap_init(&hunk_resolutions, hunk_resolution_cmp, NULL, 0);
+    hunk_resolutions_loaded = 1;
+
+    if (strbuf_read_file(&buf, git_path_hunk_resolutions(), 0) < 0)
+        return;
+    end = buf.buf + buf.len;
+    for (p = buf.buf; p < end;) {
+        const char *hex = p, *resolution = p + strlen(p) + 1;
+        struct object_id fingerprint;
+
+        if (resolution >= end)
+            break;
+        p = resolution + strlen(resolution) + 1;
+        if (*hex == '-' && !get_oid_hex(hex + 1, &fingerprint) &&
+            !hex[the_hash_algo->hexsz + 1])
+            remove_hunk_resolution(&fingerprint);
+        else if (!get_oid_hex(hex, &fingerprint) && !hex[the_hash_algo->hexsz])
+            add_hunk_resolution(&fingerprint, resolution);
     }
-    return 0;
+    strbuf_release(&buf);
+}
+
+static void clear_hunk_resolutions(void)
+{
+    if (!hunk_resolutions_loaded)
+        return;
+    hashmap_free(&hunk_resolutions, 1);
+    hunk_resolutions_loaded = 0;
 }
 
-/*
- * The merge_rr list is meant to hold outstanding conflicted paths
- * that rerere could handle.  Abuse the list by adding other types of
- * entries to allow the caller to show "rerere remaining".
- *
- * - Conflicted paths that rerere does not handle are added
- * - Conflicted paths that have been resolved are marked as such
- *   by storing RERERE_RESOLVED to .util field (where conflict ID
- *   is expected to be stored).
- *
- * Do *not* write MERGE_RR file out after calling this function.
- *
- * NEEDSWORK: we may want to fix the caller that implements "rerere
- * remaining" to do this without abusing merge_rr.
- */
-int rerere_remaining(struct repository *r, struct string_list *merge_rr)
+/* the fingerprint of a single hunk, out of its normalized sides */
+static void hunk_fingerprint(struct strbuf *one, struct strbuf *two,
+                             struct object_id *fingerprint)
+{
+    git_hash_ctx ctx;
+
+    the_hash_algo->init_fn(&ctx);
+    add_hunk_fingerprint(&ctx, one, two);
+    the_hash_algo->final_fn(fingerprint->hash, &ctx);
+}
+
+static void add_fingerprint_text(struct strbuf *side, const char *text)
 {
+    struct string_list lines = STRING_LIST_INIT_DUP;
     int i;
 
-    if (setup_rerere(r, merge_rr, RERERE_READONLY))
-        return 0;
-    if (repo_read_index(r) < 0)
-        return error(_("index file corrupt"));
+    string_list_split(&lines, text, '\n', -1);
+    for (i = 0; i < lines.nr; i++)
+        add_fingerprint_line(side, lines.items[i].string);
+    string_list_clear(&lines, 0);
+}
 
-    for (i = 0; i < r->index->cache_nr;) {
-        int conflict_type;
-        const struct cache_entry *e = r->index->cache[i];
-        i = check_one_conflict(r->index, i, &conflict_type);
-        if (conflict_type == PUNTED)
-            string_list_insert(merge_rr, (const char *)e->name);
-        else if (conflict_type == RESOLVED) {
-            struct string_list_item *it;
-            it = string_list_lookup(merge_rr, (const char *)e->name);
-            if (it != NULL) {
-                free_rerere_id(it);
-                it->util = RERERE_RESOLVED;
-            }
-        }
-    }
-    return 0;
+/* the text of the sides of a hunk, and of its base in the diff3 style */
+struct hunk_text {
+    struct strbuf side[2];
+    struct strbuf base;
+    int has_base;
+};
+#define HUNK_TEXT_INIT { { STRBUF_INIT, STRBUF_INIT }, STRBUF_INIT, 0 }
+
+static void hunk_text_release(struct hunk_text *text)
+{
+    strbuf_release(&text->side[0]);
+    strbuf_release(&text->side[1]);
+    strbuf_release(&text->base);
 }
 
 /*
- * Try using the given conflict resolution "ID" to see
- * if that recorded conflict resolves cleanly what we
- * got in the "cur".
+ * Read the sides of the hunk whose "<<<<<<<" line was just read, up to
+ * and including its ">>>>>>>" line, into "one" and "two" normalized and
+ * into "raw" as they are; "text", if not NULL, gets the text of each side
+ * and of the base.  Return -1 if the file ends first.
  */
-static int try_merge(struct index_state *istate,
-                     const struct rerere_id *id, const char *path,
-                     mmfile_t *cur, mmbuffer_t *result)
+static int read_hunk(struct rerere_io *io, int marker_size, struct strbuf *raw,
+                     struct strbuf *one, struct strbuf *two, struct hunk_text *text)
 {
-    //fprintf_ln(stderr, _("LOG_ENTER: try_merge function"));
-    int ret;
-    mmfile_t base = {NULL, 0}, other = {NULL, 0};
+    struct strbuf line = STRBUF_INIT;
+    struct strbuf *side = one;
+    int ret = -1;
+
+    strbuf_reset(one);
+    strbuf_reset(two);
+    if (text) {
+        strbuf_reset(&text->side[0]);
+        strbuf_reset(&text->side[1]);
+        strbuf_reset(&text->base);
+        text->has_base = 0;
+    }
+    while (!io->getline(&line, io)) {
+        strbuf_addbuf(raw, &line);
+        if (image_marker(line.buf, '<', marker_size))
+            break; /* nested conflicts are left alone */
+        if (image_marker(line.buf, '>', marker_size)) {
+            ret = 0;
+            break;
+        }
+        if (image_marker(line.buf, '|', marker_size)) {
+            side = NULL;
+            if (text)
+                text->has_base = 1;
+        } else if (image_marker(line.buf, '=', marker_size)) {
+            side = two;
+        } else if (side) {
+            add_fingerprint_line(side, line.buf);
+            if (text)
+                strbuf_addbuf(&text->side[side == two], &line);
+        } else if (text) {
+            strbuf_addbuf(&text->base, &line);
+        }
+    }
+    strbuf_release(&line);
+    return ret;
+}
 
-    if (read_mmfile(&base, rerere_path(id, "preimage")) ||
-        read_mmfile(&other, rerere_path(id, "postimage")))
-        ret = 1;
-    else
-        /*
-         * A three-way merge. Note that this honors user-customizable
-         * low-level merge driver settings.
-         */
-        ret = ll_merge(result, path, &base, NULL, cur, "", &other, "",
-                       istate, NULL);
+static void append_hunk_resolutions(const struct strbuf *records)
+{
+    struct lock_file lock = LOCK_INIT;
+    const char *fname = git_path_hunk_resolutions();
+    int fd;
 
-    free(base.ptr);
-    free(other.ptr);
-    //fprintf_ln(stderr, _("LOG_EXIT: try_merge function"));
-    return ret;
+    if (!records->len)
+        return;
+    if (hold_lock_file_for_update_timeout(&lock, fname, 0, 1000) < 0) {
+        error_errno(_("could not lock '%s'"), fname);
+        return;
+    }
+    fd = open(fname, O_WRONLY | O_APPEND | O_CREAT, 0666);
+    if (fd < 0 || write_in_full(fd, records->buf, records->len) < 0)
+        error_errno(_("could not write '%s'"), fname);
+    if (fd >= 0)
+        close(fd);
+    rollback_lock_file(&lock);
 }
 
 /*
- * Find the conflict identified by "id"; the change between its
- * "preimage" (i.e. a previous contents with conflict markers) and its
- * "postimage" (i.e. the corresponding contents with conflicts
- * resolved) may apply cleanly to the contents stored in "path", i.e.
- * the conflict this time around.
- *
- * Returns 0 for successful replay of recorded resolution, or non-zero
- * for failure.
+ * Record how each hunk of the preimage of "id" was resolved in its
+ * postimage.  As conflict_index_file() does, a resolution runs up to the
+ * line that follows its hunk in the preimage.  A resolution that itself
+ * contains that line would be cut short there, so nothing is recorded
+ * unless the rest of the postimage lines up with the preimage too.
  */
-static int merge(struct index_state *istate, const struct rerere_id *id, const char *path)
+static void record_hunk_resolutions(const struct rerere_id *id, int marker_size)
 {
-    //fprintf_ln(stderr, _("LOG_ENTER: merge function"));
-    FILE *f;
-    int ret;
-    mmfile_t cur = {NULL, 0};
-    mmbuffer_t result = {NULL, 0};
+    struct strbuf pre_line = STRBUF_INIT, post_line = STRBUF_INIT, raw = STRBUF_INIT;
+    struct strbuf one = STRBUF_INIT, two = STRBUF_INIT;
+    struct strbuf resolution = STRBUF_INIT, out = STRBUF_INIT;
+    struct string_list records = STRING_LIST_INIT_DUP;
+    struct rerere_io_file pre;
+    FILE *post;
+    int i, synced = 0;
 
-    /*
-     * Normalize the conflicts in path and write it out to
-     * "thisimage" temporary file.
-     */
-    if ((handle_file(istate, path, NULL, rerere_path(id, "thisimage")) < 0) ||
-        read_mmfile(&cur, rerere_path(id, "thisimage"))) {
-        ret = 1;
-        goto out;
+    memset(&pre, 0, sizeof(pre));
+    pre.io.getline = rerere_file_getline;
+    pre.input = fopen(rerere_path(id, "preimage"), "r");
+    if (!pre.input)
+        return;
+    post = fopen(rerere_path(id, "postimage"), "r");
+    if (!post) {
+        fclose(pre.input);
+        return;
     }
+    load_hunk_resolutions();
 
-    ret = try_merge(istate, id, path, &cur, &result);
-    if (ret)
-        goto out;
+    for (;;) {
+        struct object_id fingerprint;
+        const char *known;
+        int has_next, eof;
 
-    /*
-     * A successful replay of recorded resolution.
-     * Mark that "postimage" was used to help gc.
-     */
-    if (utime(rerere_path(id, "postimage"), NULL) < 0)
-        warning_errno(_("failed utime() on '%s'"),
-                      rerere_path(id, "postimage"));
+        if (pre.io.getline(&pre_line, &pre.io)) {
+            synced = strbuf_getwholeline(&post_line, post, '\n') == EOF;
+            break;
+        }
+        if (!image_marker(pre_line.buf, '<', marker_size)) {
+            if (strbuf_getwholeline(&post_line, post, '\n') == EOF ||
+                strbuf_cmp(&pre_line, &post_line))
+                break;
+            continue;
+        }
+        strbuf_reset(&raw);
+        if (read_hunk(&pre.io, marker_size, &raw, &one, &two, NULL))
+            break;
+        has_next = !pre.io.getline(&pre_line, &pre.io);
+        if (has_next && image_marker(pre_line.buf, '<', marker_size))
+            break; /* back to back hunks cannot be told apart */
+
+        strbuf_reset(&resolution);
+        while (!(eof = strbuf_getwholeline(&post_line, post, '\n') == EOF) &&
+               (!has_next || strbuf_cmp(&pre_line, &post_line)))
+            strbuf_addbuf(&resolution, &post_line);
+        if (has_next && eof)
+            break;
 
-    /* Update "path" with the resolution */
-    f = fopen(path, "w");
-    if (!f)
-        return error_errno(_("could not open '%s'"), path);
-    if (fwrite(result.ptr, result.size, 1, f) != 1)
-        error_errno(_("could not write '%s'"), path);
-    if (fclose(f))
-        return error_errno(_("writing '%s' failed"), path);
+        hunk_fingerprint(&one, &two, &fingerprint);
+        known = find_hunk_resolution(&fingerprint);
+        if (!known || strcmp(known, resolution.buf))
+            string_list_append(&records, oid_to_hex(&fingerprint))->util =
+                strbuf_detach(&resolution, NULL);
+        if (!has_next) {
+            synced = 1;
+            break;
+        }
+    }
+    fclose(pre.input);
+    fclose(post);
 
-    out:
-    free(cur.ptr);
-    free(result.ptr);
-    //fprintf_ln(stderr, _("LOG_EXIT: merge function"));
-    return ret;
+    for (i = 0; synced && i < records.nr; i++) {
+        struct object_id fingerprint;
+
+        if (get_oid_hex(records.items[i].string, &fingerprint))
+            continue;
+        add_hunk_resolution(&fingerprint, records.items[i].util);
+        add_suggestion_field(&out, records.items[i].string);
+        add_suggestion_field(&out, records.items[i].util);
+    }
+    append_hunk_resolutions(&out);
+    strbuf_release(&pre_line);
+    strbuf_release(&post_line);
+    strbuf_release(&raw);
+    strbuf_release(&one);
+    strbuf_release(&two);
+    strbuf_release(&resolution);
+    strbuf_release(&out);
+    string_list_clear(&records, 1);
 }
 
-static void update_paths(struct repository *r, struct string_list *update)
+/* Drop the recorded resolutions of the hunks of the preimage of "id". */
+static void forget_hunk_resolutions(const struct rerere_id *id, int marker_size)
 {
-    struct lock_file index_lock = LOCK_INIT;
-    int i;
+    struct strbuf line = STRBUF_INIT, raw = STRBUF_INIT, out = STRBUF_INIT;
+    struct strbuf one = STRBUF_INIT, two = STRBUF_INIT;
+    struct rerere_io_file pre;
 
-    repo_hold_locked_index(r, &index_lock, LOCK_DIE_ON_ERROR);
+    memset(&pre, 0, sizeof(pre));
+    pre.io.getline = rerere_file_getline;
+    pre.input = fopen(rerere_path(id, "preimage"), "r");
+    if (!pre.input)
+        return;
+    load_hunk_resolutions();
+    while (!pre.io.getline(&line, &pre.io)) {
+        struct object_id fingerprint;
 
-    for (i = 0; i < update->nr; i++) {
-        struct string_list_item *item = &update->items[i];
-        if (add_file_to_index(r->index, item->string, 0))
-            exit(128);
-        fprintf_ln(stderr, _("Staged '%s' using previous resolution."),
-                   item->string);
+        if (!image_marker(line.buf, '<', marker_size))
+            continue;
+        if (read_hunk(&pre.io, marker_size, &raw, &one, &two, NULL))
+            break;
+        hunk_fingerprint(&one, &two, &fingerprint);
+        if (!remove_hunk_resolution(&fingerprint))
+            continue;
+        strbuf_addch(&out, '-');
+        add_suggestion_field(&out, oid_to_hex(&fingerprint));
+        add_suggestion_field(&out, "");
     }
+    fclose(pre.input);
+    append_hunk_resolutions(&out);
+    strbuf_release(&line);
+    strbuf_release(&raw);
+    strbuf_release(&one);
+    strbuf_release(&two);
+    strbuf_release(&out);
+}
 
-    if (write_locked_index(r->index, &index_lock,
-                           COMMIT_LOCK | SKIP_IF_UNCHANGED))
-        die(_("unable to write new index file"));
+/* Rewrite rr-cache/hunks with only the last record of each fingerprint. */
+static void compact_hunk_resolutions(void)
+{
+    struct lock_file lock = LOCK_INIT;
+    const char *fname = git_path_hunk_resolutions();
+    struct strbuf out = STRBUF_INIT;
+    struct hashmap_iter iter;
+    struct hunk_resolution *e;
+    int fd;
+
+    if (!file_exists(fname))
+        return;
+    fd = hold_lock_file_for_update_timeout(&lock, fname, 0, 1000);
+    if (fd < 0) {
+        error_errno(_("could not lock '%s'"), fname);
+        return;
+    }
+    clear_hunk_resolutions();
+    load_hunk_resolutions();
+    hashmap_iter_init(&hunk_resolutions, &iter);
+    while ((e = hashmap_iter_next(&iter))) {
+        add_suggestion_field(&out, oid_to_hex(&e->fingerprint));
+        add_suggestion_field(&out, e->resolution);
+    }
+    if (write_in_full(fd, out.buf, out.len) < 0 || commit_lock_file(&lock))
+        error_errno(_("could not write '%s'"), fname);
+    rollback_lock_file(&lock);
+    clear_hunk_resolutions();
+    strbuf_release(&out);
 }
 
-static void remove_variant(struct rerere_id *id)
+static int has_hunk_resolution(const char *side_one, const char *side_two)
 {
-    unlink_or_warn(rerere_path(id, "postimage"));
-    unlink_or_warn(rerere_path(id, "preimage"));
-    id->collection->status[id->variant] = 0;
+    struct strbuf one = STRBUF_INIT, two = STRBUF_INIT;
+    struct object_id fingerprint;
+
+    load_hunk_resolutions();
+    if (!hashmap_get_size(&hunk_resolutions))
+        return 0;
+    add_fingerprint_text(&one, side_one);
+    add_fingerprint_text(&two, side_two);
+    hunk_fingerprint(&one, &two, &fingerprint);
+    strbuf_release(&one);
+    strbuf_release(&two);
+    return !!find_hunk_resolution(&fingerprint);
 }
 
 /*
- * control if the hash of the conflict area is changed or not,
- * if yes then control if what is the difference between preimage and current file
+ * Many conflicts only are two sides adding lines to the same block of
+ * imports, and are resolved by keeping the lines of both.  Such a hunk
+ * needs no recorded resolution, nor clustering or learned rules: with
+ * the "conflict-imports" attribute, it is resolved right away to the
+ * union of its sides, sorted unless the attribute is "union".
  */
-static int check_hash_change(struct index_state *istate,
-                             const char *path,char* old_hash,char * new_hash)
-{
-    //fprintf_ln(stderr, _("LOG_ENTER: check_hash_change"));
+enum import_resolution {
+    IMPORTS_KEEP = 0,
+    IMPORTS_UNION,
+    IMPORTS_SORT
+};
 
-    struct rerere_id *old_id = new_rerere_id_hex(old_hash);
-    struct rerere_id *new_id = new_rerere_id_hex(new_hash);
-    int marker_size = ll_merge_marker_size(istate, path);
+static enum import_resolution import_resolution(struct index_state *istate, const char *path)
+{
+    static struct attr_check *check;
+    const char *value;
+
+    if (!check)
+        check = attr_check_initl("conflict-imports", NULL);
+    git_check_attr(istate, path, check);
+    value = check->items[0].value;
+    if (ATTR_TRUE(value))
+        return IMPORTS_SORT;
+    if (ATTR_UNSET(value) || ATTR_FALSE(value))
+        return IMPORTS_KEEP;
+    if (!strcmp(value, "union"))
+        return IMPORTS_UNION;
+    if (!strcmp(value, "sort"))
+        return IMPORTS_SORT;
+    return IMPORTS_KEEP;
+}
 
-    for (int variant = 0; variant < old_id->collection->status_nr; variant++) {
+/* Java, Kotlin, Scala, Go and Python imports, C# usings, C includes */
+static int is_import_line(const char *line)
+{
+    const char *rest;
 
-        const int both = RR_HAS_PREIMAGE | RR_HAS_POSTIMAGE;
-        struct rerere_id vold_id = *old_id;
+    while (isspace(*line))
+        line++;
+    if (skip_prefix(line, "import", &rest) && (isspace(*rest) || *rest == '('))
+        return 1;
+    if (skip_prefix(line, "#", &rest)) {
+        while (*rest == ' ' || *rest == '\t')
+            rest++;
+        return starts_with(rest, "include") || starts_with(rest, "import");
+    }
+    if (skip_prefix(line, "using", &rest) && isspace(*rest))
+        return !!strchr(rest, ';') && !strchr(rest, '(');
+    if (skip_prefix(line, "from", &rest) && isspace(*rest))
+        return !!strstr(rest, " import ");
+    return 0;
+}
 
-        if ((old_id->collection->status[variant] & both) != both)
+/*
+ * Append the import lines of "text" to "lines", each with the number of
+ * the group of lines it is in as util, groups being separated by blank
+ * lines, and add them trimmed to "keys".  Return -1 if one of them,
+ * blank lines aside, is no import.
+ */
+static int split_import_lines(struct string_list *lines, struct string_list *keys,
+                              const char *text)
+{
+    struct string_list split = STRING_LIST_INIT_NODUP;
+    struct strbuf key = STRBUF_INIT;
+    char *copy = xstrdup(text);
+    intptr_t group = 0;
+    int i, nr = 0, blank = 0, ret = 0;
+
+    string_list_split_in_place(&split, copy, '\n', -1);
+    for (i = 0; i < split.nr; i++) {
+        strbuf_reset(&key);
+        strbuf_addstr(&key, split.items[i].string);
+        strbuf_trim(&key);
+        if (!key.len) {
+            blank = 1;
             continue;
-        vold_id.variant = variant;
-
-        if (handle_file(istate, path, NULL, rerere_path(&vold_id, "curimage")) < 0) {
-            return  0;
         }
+        if (!is_import_line(key.buf)) {
+            ret = -1;
+            continue;
+        }
+        if (blank && nr)
+            group++;
+        blank = 0;
+        nr++;
+        if (lines)
+            string_list_append(lines, split.items[i].string)->util = (void *)group;
+        string_list_insert(keys, key.buf);
+    }
+    string_list_clear(&split, 0);
+    strbuf_release(&key);
+    free(copy);
+    return ret;
+}
 
-        struct rerere_io_file cur;
-        const char *cur_path = rerere_path(&vold_id, "curimage");
-        memset(&cur, 0, sizeof(cur));
-        cur.io.getline = rerere_file_getline;
-        cur.input = fopen(cur_path, "r");
-        cur.io.wrerror = 0;
-        if (!cur.input)
-            return error_errno(_("could not open '%s'"), cur_path);
-
-        struct rerere_io_file pre;
-        const char *pre_path = rerere_path(&vold_id, "preimage");
-        memset(&pre, 0, sizeof(pre));
-        pre.io.getline = rerere_file_getline;
-        pre.input = fopen(pre_path, "r");
-        pre.io.wrerror = 0;
-        if (!pre.input)
-            return error_errno(_("could not open '%s'"), pre_path);
-
-        struct rerere_io_file post;
-        const char *post_path = rerere_path(&vold_id, "postimage");
-        memset(&post, 0, sizeof(post));
-        post.io.getline = rerere_file_getline;
-        post.input = fopen(post_path, "r");
-        post.io.wrerror = 0;
-        if (!post.input)
-            return error_errno(_("could not open '%s'"), post_path);
+/*
+ * Resolve the hunk whose sides are "one" and "two" if both are only made
+ * of imports, into "out".  Return -1 if it is not.
+ *
+ * The lines of both sides are kept, group by group: the first groups of
+ * both sides make the first group of the resolution, and so on, with a
+ * blank line between them.  With the "base" of the hunk, which only the
+ * diff3 style shows, a line that one side deleted from it is left out;
+ * without it, nothing tells a deleted line from one the other side
+ * added, and the line is kept.
+ */
+static int resolve_import_hunk(enum import_resolution how, const char *one,
+                               const char *two, const char *base, struct strbuf *out)
+{
+    struct string_list lines[2] = { STRING_LIST_INIT_DUP, STRING_LIST_INIT_DUP };
+    struct string_list keys[2] = { STRING_LIST_INIT_DUP, STRING_LIST_INIT_DUP };
+    struct string_list base_keys = STRING_LIST_INIT_DUP;
+    struct string_list seen = STRING_LIST_INIT_DUP;
+    struct string_list group = STRING_LIST_INIT_NODUP;
+    struct strbuf key = STRBUF_INIT;
+    intptr_t g, nr_groups = 0;
+    int i, side, emitted = 0, ret = -1;
+
+    if (how == IMPORTS_KEEP ||
+        split_import_lines(&lines[0], &keys[0], one) ||
+        split_import_lines(&lines[1], &keys[1], two) ||
+        (!lines[0].nr && !lines[1].nr))
+        goto out;
+    ret = 0;
+    if (!out)
+        goto out;
+    if (base)
+        split_import_lines(NULL, &base_keys, base);
+    for (side = 0; side < 2; side++) {
+        intptr_t last;
 
-        struct strbuf pre_out_buf = STRBUF_INIT;
-        struct strbuf post_out_buf = STRBUF_INIT;
+        if (!lines[side].nr)
+            continue;
+        last = (intptr_t)lines[side].items[lines[side].nr - 1].util;
+        if (nr_groups <= last)
+            nr_groups = last + 1;
+    }
 
-        int res = compare_n_update((struct rerere_io *)&cur,(struct rerere_io *)&pre,(struct rerere_io *)&post,
-                                   &pre_out_buf,&post_out_buf,marker_size);
-
-        if (res > 0){
-            struct rerere_io_file out;
-            const char *out_path = rerere_path(new_id, "preimage");
-            mkdir_in_gitdir(rerere_path(new_id, NULL));
-            memset(&out, 0, sizeof(out));
-            out.io.output = fopen(out_path, "w");
-            if (!out.io.output) {
-                error_errno(_("could not write '%s'"), out_path);
+    for (g = 0; g < nr_groups; g++) {
+        group.nr = 0;
+        for (side = 0; side < 2; side++) {
+            for (i = 0; i < lines[side].nr; i++) {
+                const char *line = lines[side].items[i].string;
+
+                if ((intptr_t)lines[side].items[i].util != g)
+                    continue;
+                strbuf_reset(&key);
+                strbuf_addstr(&key, line);
+                strbuf_trim(&key);
+                if (string_list_has_string(&seen, key.buf))
+                    continue;
+                string_list_insert(&seen, key.buf);
+                if (string_list_has_string(&base_keys, key.buf) &&
+                    !(string_list_has_string(&keys[0], key.buf) &&
+                      string_list_has_string(&keys[1], key.buf)))
+                    continue;
+                string_list_append(&group, line);
             }
+        }
+        if (!group.nr)
+            continue;
+        if (how == IMPORTS_SORT)
+            string_list_sort(&group);
+        if (emitted++)
+            strbuf_addch(out, '\n');
+        for (i = 0; i < group.nr; i++)
+            strbuf_addf(out, "%s\n", group.items[i].string);
+    }
+out:
+    string_list_clear(&lines[0], 0);
+    string_list_clear(&lines[1], 0);
+    string_list_clear(&keys[0], 0);
+    string_list_clear(&keys[1], 0);
+    string_list_clear(&base_keys, 0);
+    string_list_clear(&seen, 0);
+    string_list_clear(&group, 0);
+    strbuf_release(&key);
+    return ret;
+}
 
-            strbuf_write(&pre_out_buf,out.io.output);
-
-            if (out.io.wrerror)
-                error(_("there were errors while writing '%s' (%s)"),
-                      out_path, strerror(out.io.wrerror));
-            if (out.io.output && fclose(out.io.output))
-                out.io.wrerror = error_errno(_("failed to flush '%s'"), out_path);
-
-            //copy_file(rerere_path(new_id, "postimage"), post_path, 0666);
-            //.......................POSTIMAGE .................................
-
-            out_path = rerere_path(new_id, "postimage");
-            mkdir_in_gitdir(rerere_path(new_id, NULL));
-            memset(&out, 0, sizeof(out));
-            out.io.output = fopen(out_path, "w");
-            if (!out.io.output) {
-                error_errno(_("could not write '%s'"), out_path);
-            }
+/*
+ * Copy what "io" reads to "out", with the hunks that have a recorded
+ * resolution resolved, and the import blocks resolved as "imports"
+ * says.  Return how many hunks are left, or -1 if none was resolved;
+ * "recorded" is set to how many had a recorded resolution.
+ */
+static int resolve_recorded_hunks(struct rerere_io *io, int marker_size,
+                                  enum import_resolution imports, struct strbuf *out,
+                                  int *recorded)
+{
+    struct strbuf line = STRBUF_INIT, raw = STRBUF_INIT;
+    struct strbuf one = STRBUF_INIT, two = STRBUF_INIT;
+    struct hunk_text text = HUNK_TEXT_INIT;
+    int resolved = 0, left = 0;
 
-            strbuf_write(&post_out_buf,out.io.output);
+    *recorded = 0;
+    load_hunk_resolutions();
+    if (!hashmap_get_size(&hunk_resolutions) && imports == IMPORTS_KEEP)
+        return -1;
+    while (!io->getline(&line, io)) {
+        struct object_id fingerprint;
+        const char *known;
 
-            if (out.io.wrerror)
-                error(_("there were errors while writing '%s' (%s)"),
-                      out_path, strerror(out.io.wrerror));
-            if (out.io.output && fclose(out.io.output))
-                out.io.wrerror = error_errno(_("failed to flush '%s'"), out_path);
+        if (!image_marker(line.buf, '<', marker_size)) {
+            strbuf_addbuf(out, &line);
+            continue;
+        }
+        strbuf_reset(&raw);
+        strbuf_addbuf(&raw, &line);
+        if (read_hunk(io, marker_size, &raw, &one, &two, &text)) {
+            resolved = 0;
             break;
         }
-        unlink_or_warn(rerere_path(&vold_id, "curimage"));
-        free_rerere_dirs();
-        fclose(cur.input);
-        fclose(pre.input);
-        fclose(post.input);
-        strbuf_release(&pre_out_buf);
-        strbuf_release(&post_out_buf);
-        break;
+        hunk_fingerprint(&one, &two, &fingerprint);
+        known = find_hunk_resolution(&fingerprint);
+        if (known) {
+            strbuf_addstr(out, known);
+            resolved++;
+            (*recorded)++;
+        } else if (!resolve_import_hunk(imports, text.side[0].buf, text.side[1].buf,
+                                        text.has_base ? text.base.buf : NULL, out)) {
+            resolved++;
+        } else {
+            strbuf_addbuf(out, &raw);
+            left++;
+        }
     }
-    //fprintf_ln(stderr, _("LOG_EXIT: check_hash_change"));
-    return  1;
+    strbuf_release(&line);
+    strbuf_release(&raw);
+    strbuf_release(&one);
+    strbuf_release(&two);
+    hunk_text_release(&text);
+    return resolved ? left : -1;
 }
 
 /*
- * write or update path and hash index file
+ * Resolve the hunks of "path" that have a recorded resolution, or are
+ * import blocks, leaving the others in place.  "recorded" is set to how
+ * many had a recorded resolution.
  */
-static int hash_index_file(const char *fname,const char *path,const char *hash) {
-
-    //fprintf_ln(stderr, _("LOG ENTER: hash_index_file "));
-
-    int found = 0;
-    char buffer[256];
-
-    //fprintf_ln(stderr, _("hash_index_file: PATH: %s "),path);
-    //fprintf_ln(stderr, _("hash_index_file: HASH: %s "),hash);
-    struct strbuf buf = STRBUF_INIT;
+static int replay_hunk_resolutions(struct index_state *istate, const char *path,
+                                   int *recorded)
+{
+    struct strbuf out = STRBUF_INIT;
     struct rerere_io_file io;
+    FILE *f;
+    int left;
+
     memset(&io, 0, sizeof(io));
     io.io.getline = rerere_file_getline;
-    io.input = fopen(fname, "r");
-
-    FILE *temp;
-    temp = fopen(".git/rr-cache/temp", "w");
+    io.input = fopen(path, "r");
+    if (!io.input)
+        return -1;
+    left = resolve_recorded_hunks(&io.io, ll_merge_marker_size(istate, path),
+                                  import_resolution(istate, path), &out, recorded);
+    fclose(io.input);
+    if (left < 0)
+        goto out;
 
-    io.io.wrerror = 0;
-    if (io.input && temp) {
-        while (!io.io.getline(&buf, &io.io)) {
-
-            if (strstr(buf.buf, path) != NULL) { // if path is already present in file then update it
-                found = 1;
-                fprintf(temp, "%s;%s\n", path, hash); // write in temp file
-            } else {
-                fprintf(temp, "%s", buf.buf); // write in temp file
-            }
-        }
-        fclose(io.input);
-        fclose(temp);
+    f = fopen(path, "w");
+    if (!f) {
+        left = error_errno(_("could not open '%s'"), path);
+        goto out;
     }
+    if (fwrite(out.buf, out.len, 1, f) != 1)
+        left = error_errno(_("could not write '%s'"), path);
+    if (fclose(f))
+        left = error_errno(_("writing '%s' failed"), path);
+out:
+    strbuf_release(&out);
+    return left;
+}
 
-    if (!found) { //not found, add new line
-
-        //fprintf_ln(stderr, _("hash_index_file: NOT FOUND !!! "));
-        FILE *input  = fopen(fname, "a+");
-
-        if(input) {
-            fprintf(input, "%s;%s\n", path, hash);
-            fclose(input);
-        }
-
-    } else { // found, copy temp
+/* fingerprint the "len" bytes of one side of a hunk at "text" */
+static void add_fingerprint_side(struct strbuf *side, const char *text, size_t len)
+{
+    char *copy = xmemdupz(text, len);
 
-        //fprintf_ln(stderr, _("hash_index_file: FOUND !!! "));
-        FILE *input  = fopen(fname, "w");
-        temp = fopen(".git/rr-cache/temp", "r");
+    add_fingerprint_text(side, copy);
+    free(copy);
+}
 
-        if (input && temp) {
+int rerere_resolve_conflicts(const char *buf, size_t len,
+                             const struct s_xmconflicts *conflicts, struct strbuf *out)
+{
+    struct strbuf one = STRBUF_INIT, two = STRBUF_INIT;
+    size_t pos = 0;
+    long i, resolved = 0;
 
-            while (fgets(buffer, sizeof(buffer), temp))
-                fputs(buffer, input);
+    if (!startup_info->have_repository)
+        return -1;
+    load_hunk_resolutions();
+    if (!hashmap_get_size(&hunk_resolutions))
+        return -1;
 
-            fclose(temp);
-            fclose(input);
-        }
+    for (i = 0; i < conflicts->nr; i++) {
+        const xmconflict_t *c = &conflicts->conflict[i];
+        struct object_id fingerprint;
+        const char *known;
+
+        if (c->start < pos || c->start + c->size > len)
+            BUG("conflict out of the merge result");
+        strbuf_reset(&one);
+        strbuf_reset(&two);
+        add_fingerprint_side(&one, buf + c->start1, c->size1);
+        add_fingerprint_side(&two, buf + c->start2, c->size2);
+        hunk_fingerprint(&one, &two, &fingerprint);
+        known = find_hunk_resolution(&fingerprint);
+        if (!known)
+            continue;
+        strbuf_add(out, buf + pos, c->start - pos);
+        strbuf_addstr(out, known);
+        pos = c->start + c->size;
+        resolved++;
     }
-    unlink_or_warn(".git/rr-cache/temp");
-
-    //fprintf_ln(stderr, _("LOG EXIT: hash_index_file "));
-    return found;
+    strbuf_add(out, buf + pos, len - pos);
+    strbuf_release(&one);
+    strbuf_release(&two);
+    return resolved ? conflicts->nr - resolved : -1;
 }
 
 /*
  * write or update conflict index file
  */
-static int conflict_index_file(struct rerere_id *id, int marker_size)
+static int conflict_index_file(struct conflict_shard *shard, struct rerere_id *id, int marker_size)
 {
     //fprintf_ln(stderr, _("LOG_ENTER: conflict_index_file function"));
 
@@ -1944,6 +4592,7 @@ static int conflict_index_file(struct rerere_id *id, int marker_size)
     //int pre_marker_found = 1;
     struct strbuf pre_buf_A = STRBUF_INIT, pre_buf_B = STRBUF_INIT, post_buf = STRBUF_INIT, post_buf_out = STRBUF_INIT;
     struct string_list pre_list_A = STRING_LIST_INIT_DUP, pre_list_B = STRING_LIST_INIT_DUP, post_list = STRING_LIST_INIT_DUP;
+    struct hashmap side_A, side_B;
     enum {
         RR_SIDE_1 = 0,  // = 0
         RR_SIDE_2,      // = 1
@@ -1977,6 +4626,8 @@ static int conflict_index_file(struct rerere_id *id, int marker_size)
             pre.io.getline(&pre_buf, &pre.io);
 
             //get postimage line and compare it to preimage areas to determine the area to which it belongs
+            side_lines_init(&side_A, &pre_list_A);
+            side_lines_init(&side_B, &pre_list_B);
             while(!post.io.getline(&post_buf,&post.io)) {
                 //fprintf_ln(stderr, _("conflict_index_file: post_buf: %s"),post_buf.buf);
                 if (strbuf_cmp(&post_buf,&pre_buf) == 0) {
@@ -1985,36 +4636,35 @@ static int conflict_index_file(struct rerere_id *id, int marker_size)
                 string_list_append(&post_list,post_buf.buf);
                 strbuf_addbuf(&post_buf_out,&post_buf);
 
-                if (unsorted_string_list_has_string(&pre_list_A,post_buf.buf)) { // present in part A
-                    if (!unsorted_string_list_has_string(&pre_list_B,post_buf.buf)) { // non present in part B
-                        conflict_area = RR_SIDE_1; // set side A
-                    }
-                }else if (unsorted_string_list_has_string(&pre_list_B,post_buf.buf)) { // present in part B
-                    if (unsorted_string_list_has_string(&pre_list_B,post_buf.buf)) { // not present in part A
-                        conflict_area = RR_SIDE_2; // set side B
-                    }
+                switch (postimage_line_side(&side_A, &side_B, post_buf.buf)) {
+                case 0: // present in part A only
+                    conflict_area = RR_SIDE_1; // set side A
+                    break;
+                case 1: // present in part B only
+                    conflict_area = RR_SIDE_2; // set side B
+                    break;
                 }
             }
+            hashmap_free(&side_A, 1);
+            hashmap_free(&side_B, 1);
 
             if (conflict_area == RR_SIDE_1) {
-                //write_conflict_index(pre_buf_B.buf,post_buf_out.buf);
                 if(!is_multiline_string(pre_buf_B.buf) && !is_multiline_string(post_buf_out.buf)) {
                     strbuf_trim(&pre_buf_B);
                     strbuf_trim(&post_buf_out);
                     strbuf_trim_trailing_newline(&pre_buf_B);
                     strbuf_trim_trailing_newline(&post_buf_out);
-                    write_json_conflict_index(pre_buf_B.buf, post_buf_out.buf);
+                    write_json_conflict_index(shard, pre_buf_B.buf, post_buf_out.buf);
                 }
             }
 
             if (conflict_area == RR_SIDE_2) {
-                //write_conflict_index(pre_buf_A.buf,post_buf_out.buf);
                 if(!is_multiline_string(pre_buf_A.buf) && !is_multiline_string(post_buf_out.buf)) {
                     strbuf_trim(&pre_buf_A);
                     strbuf_trim(&post_buf_out);
                     strbuf_trim_trailing_newline(&pre_buf_A);
                     strbuf_trim_trailing_newline(&post_buf_out);
-                    write_json_conflict_index(pre_buf_A.buf, post_buf_out.buf);
+                    write_json_conflict_index(shard, pre_buf_A.buf, post_buf_out.buf);
                 }
             }
         } else {
@@ -2052,7 +4702,9 @@ static int conflict_index_file(struct rerere_id *id, int marker_size)
 static int check_conflict_suggestion(struct index_state *istate, struct rerere_id *id,const char* path)
 {
     //fprintf_ln(stderr, _("LOG_ENTER: check_conflict_suggestion"));
-    if(access(git_path("rr-cache/%s", "conflict_index.json"), F_OK ) == -1) {
+    struct conflict_shard *shard = find_conflict_shard(istate, path);
+
+    if (!shard_index(shard)) {
         fprintf_ln(stderr, _("check_conflict_suggestion: No file Conflict_index.json"));
         return 0;
     }
@@ -2066,6 +4718,7 @@ static int check_conflict_suggestion(struct index_state *istate, struct rerere_i
     struct strbuf cur_buf_A = STRBUF_INIT, cur_buf_B = STRBUF_INIT;
     struct string_list cur_list_A = STRING_LIST_INIT_DUP, cur_list_B = STRING_LIST_INIT_DUP;
     int marker_size = ll_merge_marker_size(istate, path);
+    enum import_resolution imports = import_resolution(istate, path);
 
     struct rerere_io_file cur;
     const char *cur_path = rerere_path(id, "curimage");
@@ -2079,15 +4732,19 @@ static int check_conflict_suggestion(struct index_state *istate, struct rerere_i
     while (!cur.io.getline(&cur_buf, &cur.io)) {
         if (my_cmarker(cur_buf.buf, '<', marker_size)) {
             separate_conflict_area(&cur.io, &cur_buf_A, &cur_buf_B, marker_size, &cur_list_A, &cur_list_B);
-            //conflict_suggestion(cur_buf_A.buf);
-            //conflict_suggestion(cur_buf_B.buf);
-            if(!is_multiline_string(cur_buf_A.buf) && !is_multiline_string(cur_buf_B.buf)) {
+            /*
+             * hunks with a recorded resolution are replayed instead,
+             * and import blocks are resolved without any suggestion
+             */
+            if(!is_multiline_string(cur_buf_A.buf) && !is_multiline_string(cur_buf_B.buf) &&
+               !has_hunk_resolution(cur_buf_A.buf, cur_buf_B.buf) &&
+               resolve_import_hunk(imports, cur_buf_A.buf, cur_buf_B.buf, NULL, NULL)) {
                 strbuf_trim(&cur_buf_A);
                 strbuf_trim_trailing_newline(&cur_buf_A);
-                regex_repalce_suggestion(cur_buf_A.buf);
+                queue_suggestion(shard, path, cur_buf_A.buf);
                 strbuf_trim(&cur_buf_B);
                 strbuf_trim_trailing_newline(&cur_buf_B);
-                regex_repalce_suggestion(cur_buf_B.buf);
+                queue_suggestion(shard, path, cur_buf_B.buf);
             }
         }
         strbuf_reset(&cur_buf_A);
@@ -2106,44 +4763,496 @@ static int check_conflict_suggestion(struct index_state *istate, struct rerere_i
     return 1;
 }
 
-static void executeRegexJar()
+/*
+ * Run the jar on the clusters "groups" of the shard, and wait for it,
+ * so that its JVM is reaped and the jobs of a worker do not pile up.
+ */
+static int executeRegexJar_shard(struct conflict_shard *shard, struct string_list *groups)
+{
+    struct child_process cp = CHILD_PROCESS_INIT;
+    int i;
+
+    argv_array_pushl(&cp.args, "/usr/bin/java", "-jar",
+                     search_replace_path("RandomSearchReplaceTurtle.jar"),
+                     shard->jar_dir, NULL); //config.properties path
+    for (i = 0; i < groups->nr; i++)
+        argv_array_push(&cp.args, groups->items[i].string);
+    cp.no_stdin = 1;
+    cp.no_stdout = 1;
+    return run_command(&cp);
+}
+
+/*
+ * The search parameters are those of the configuration the jar would
+ * have used (regex_configuration in its config.properties), if any.
+ */
+static void read_synth_options(struct conflict_shard *shard, struct synth_options *opts,
+                               struct argv_array *constants, struct argv_array *ranges)
 {
-    //fprintf_ln(stderr, _("LOG_ENTER: executeRegexJar"));
-    if (groupId_list.nr) {
-        int length = 5 + groupId_list.nr; //groupId_list.nr know only at runtime
-        const char **id_array = malloc(sizeof(*id_array) * length);
+    char *file = jar_config_value(shard, "regex_configuration");
+    struct json_object *config = file ? json_object_from_file(file) : NULL;
+    struct json_object *v, *params, *search, *evolution;
+    int i;
 
-        id_array[0] = "/usr/bin/java";
-        id_array[1] = "-jar";
-        id_array[2] = "/Users/manan/CLionProjects/git/search-and-replace/RandomSearchReplaceTurtle.jar";
-        id_array[3] = "/Users/manan/CLionProjects/git/search-and-replace/"; //config.properties path
+    free(file);
+    if (!config)
+        return;
+    if (json_object_object_get_ex(config, "initialSeed", &v))
+        opts->seed = json_object_get_int64(v);
+    if (json_object_object_get_ex(config, "jobs", &v))
+        opts->jobs = json_object_get_int(v);
+    if (json_object_object_get_ex(config, "generations", &v))
+        opts->generations = json_object_get_int(v);
+    if (json_object_object_get_ex(config, "strategyParameters", &params)) {
+        if (json_object_object_get_ex(params, "threads", &v))
+            opts->threads = json_object_get_int(v);
+        if (json_object_object_get_ex(params, "tournamentSize", &v))
+            opts->tournament = json_object_get_int(v);
+    }
 
-        fprintf_ln(stderr, _("GROUD_LIST_NR: %u"),groupId_list.nr);
-        for (int j = 0; j < groupId_list.nr; j++) {
-            id_array[j+4] = groupId_list.items[j].string;
+    /* the first configuration evolves the regexes */
+    if (json_object_object_get_ex(config, "configurations", &v) &&
+        (search = json_object_array_get_idx(v, 0))) {
+        if (json_object_object_get_ex(search, "evolutionParameters", &evolution)) {
+            if (json_object_object_get_ex(evolution, "populationSize", &v))
+                opts->population = json_object_get_int(v);
+            if (json_object_object_get_ex(evolution, "crossoverProbability", &v))
+                opts->crossover = json_object_get_double(v);
+            if (json_object_object_get_ex(evolution, "mutationPobability", &v))
+                opts->mutation = json_object_get_double(v);
+            if (json_object_object_get_ex(evolution, "elitarism", &v))
+                opts->elitism = json_object_get_int(v);
+            if (json_object_object_get_ex(evolution, "maxCreationDepth", &v))
+                opts->max_creation_depth = json_object_get_int(v);
+            if (json_object_object_get_ex(evolution, "maxDepthAfterCrossover", &v))
+                opts->max_depth = json_object_get_int(v);
         }
-        id_array[length - 1] = NULL; //terminator need for execv
+        if (json_object_object_get_ex(search, "constants", &v))
+            for (i = 0; i < json_object_array_length(v); i++)
+                argv_array_push(constants, json_object_get_string(json_object_array_get_idx(v, i)));
+        if (json_object_object_get_ex(search, "ranges", &v))
+            for (i = 0; i < json_object_array_length(v); i++)
+                argv_array_push(ranges, json_object_get_string(json_object_array_get_idx(v, i)));
+    }
+    json_object_put(config);
+}
 
-        //TODO adjust the path to jar file
-        pid_t pid = fork();
-        //fprintf_ln(stderr, _("AFTER PID FORK:"));
-        if (pid == 0) { // child process
-            /* open /dev/null for writing */
-            int fd = open("/dev/null", O_WRONLY);
-            dup2(fd, 1);    /* make stdout a copy of fd (> /dev/null) */
-            //dup2(fd, 2);    /* ...and same with stderr */
-            close(fd);
-            fprintf_ln(stderr, _("\n\n\nJAR PROCESS IS STARTING IN BACKGROUND!!!!!\n\n\n"));
-            execv("/usr/bin/java",(void*)id_array);
-        } else { //parent process
-            //int status;
-            //(void)waitpid(pid, &status, 0);
-            //fprintf_ln(stderr, _("\n\n\nGIT PROCESS GO ON !!!!!\n\n\n"));
+/*
+ * Learn the rules of the clusters "groups" of the shard from the pairs
+ * in its index, and store them in its regex_file, where the jar would
+ * have put them.
+ */
+static int synthesize_shard_rules(struct conflict_shard *shard, struct string_list *groups)
+{
+    struct synth_options opts = SYNTH_OPTIONS_INIT;
+    struct argv_array constants = ARGV_ARRAY_INIT, ranges = ARGV_ARRAY_INIT;
+    struct json_object *index = shard_index(shard), *regex_index;
+    struct lock_file lock = LOCK_INIT;
+    struct synth_cluster *clusters;
+    char *regex_file;
+    const char *content;
+    int i, j, nr = 0, fd, ret = 0;
+
+    if (!index)
+        return 0;
+    CALLOC_ARRAY(clusters, groups->nr);
+    for (i = 0; i < groups->nr; i++) {
+        struct json_object *pairs = json_object_object_get(index, groups->items[i].string);
+        int len = pairs ? json_object_array_length(pairs) : 0;
+        struct synth_cluster *cluster = &clusters[nr];
+
+        if (!len)
+            continue;
+        cluster->name = groups->items[i].string;
+        ALLOC_ARRAY(cluster->examples, len);
+        for (j = 0; j < len; j++) {
+            struct json_object *pair = json_object_array_get_idx(pairs, j);
+            struct synth_example *example = &cluster->examples[cluster->nr];
+
+            example->conflict = json_object_get_string(json_object_object_get(pair, "conflict"));
+            example->resolution = json_object_get_string(json_object_object_get(pair, "resolution"));
+            if (example->conflict && example->resolution)
+                cluster->nr++;
         }
-        free(id_array);
+        nr++;
+    }
+
+    read_synth_options(shard, &opts, &constants, &ranges);
+    if (constants.argc)
+        opts.constants = constants.argv;
+    if (ranges.argc)
+        opts.ranges = ranges.argv;
+    synthesize_rules(clusters, nr, &opts);
+
+    regex_file = shard_regex_file(shard);
+    fd = hold_lock_file_for_update_timeout(&lock, regex_file, 0, 1000);
+    if (fd < 0) {
+        ret = error_errno(_("could not lock '%s'"), regex_file);
+        goto out;
+    }
+    regex_index = json_object_from_file(regex_file);
+    if (!regex_index)
+        regex_index = json_object_new_object();
+    for (i = 0; i < nr; i++) {
+        struct json_object *rules, *rule;
+
+        if (!clusters[i].regex)
+            continue;
+        rule = json_object_new_object();
+        json_object_object_add(rule, "regex", json_object_new_string(clusters[i].regex));
+        json_object_object_add(rule, "replacement", json_object_new_string(clusters[i].replacement));
+        rules = json_object_new_array();
+        json_object_array_add(rules, rule);
+        json_object_object_add(regex_index, clusters[i].name, rules);
+    }
+    content = json_object_to_json_string_ext(regex_index, JSON_C_TO_STRING_PRETTY);
+    if (write_in_full(fd, content, strlen(content)) < 0 || commit_lock_file(&lock))
+        ret = error_errno(_("could not write '%s'"), regex_file);
+    rollback_lock_file(&lock);
+    json_object_put(regex_index);
+
+    free_rule_prefilter(shard->rules);
+    shard->rules = NULL;
+    shard->rules_loaded = 0;
+out:
+    for (i = 0; i < nr; i++) {
+        clear_synth_cluster(&clusters[i]);
+        free(clusters[i].examples);
+    }
+    free(clusters);
+    free(regex_file);
+    argv_array_clear(&constants);
+    argv_array_clear(&ranges);
+    return ret;
+}
+
+/*
+ * Learning the rules of a cluster takes long, and a cluster usually
+ * gains several pairs in a row.  Clusters that changed are queued in
+ * $GIT_DIR/rr-cache/synth-queue as NUL terminated "shard", "cluster id"
+ * and "queued at" fields, a cluster that is queued already is not
+ * queued again, and at most rerere.synthesisJobs workers take them off
+ * the queue.  A worker only learns the rules of a cluster again once
+ * it has grown by an eighth since the last time, and appends how long
+ * the cluster waited and how long learning took to
+ * $GIT_DIR/rr-cache/synth-log.
+ */
+#define SYNTH_QUEUE_FIELDS 3
+#define SYNTH_MIN_GROWTH 8
+
+static GIT_PATH_FUNC(git_path_synth_queue, "rr-cache/synth-queue")
+static GIT_PATH_FUNC(git_path_synth_log, "rr-cache/synth-log")
+
+/* split the next record of "nr" NUL terminated fields off "*p" */
+static int read_record(const char **p, const char *end, const char **field, int nr)
+{
+    int i;
+
+    for (i = 0; i < nr && *p < end; i++) {
+        field[i] = *p;
+        *p += strlen(*p) + 1;
+    }
+    return i == nr ? 0 : -1;
+}
+
+static void queued_cluster_key(struct strbuf *key, const char *shard, const char *group_id)
+{
+    strbuf_reset(key);
+    strbuf_addf(key, "%s %s", group_id, shard);
+}
+
+static int queue_changed_clusters(void)
+{
+    struct lock_file lock = LOCK_INIT;
+    struct strbuf queue = STRBUF_INIT, key = STRBUF_INIT;
+    struct string_list queued = STRING_LIST_INIT_DUP;
+    const char *path = git_path_synth_queue(), *p, *field[SYNTH_QUEUE_FIELDS];
+    char now[64];
+    int i, j, fd, ret = 0;
+
+    fd = hold_lock_file_for_update_timeout(&lock, path, 0, 1000);
+    if (fd < 0)
+        return error_errno(_("could not lock '%s'"), path);
+    if (strbuf_read_file(&queue, path, 0) < 0 && errno != ENOENT) {
+        rollback_lock_file(&lock);
+        return error_errno(_("could not read '%s'"), path);
+    }
+    for (p = queue.buf; !read_record(&p, queue.buf + queue.len, field, SYNTH_QUEUE_FIELDS);) {
+        queued_cluster_key(&key, field[0], field[1]);
+        string_list_insert(&queued, key.buf);
+    }
+
+    xsnprintf(now, sizeof(now), "%"PRIuMAX, (uintmax_t)getnanotime());
+    for (i = 0; i < conflict_shards.nr; i++) {
+        struct conflict_shard *shard = conflict_shards.items[i].util;
+
+        for (j = 0; j < shard->changed_groups.nr; j++) {
+            const char *group_id = shard->changed_groups.items[j].string;
+
+            queued_cluster_key(&key, shard->name, group_id);
+            if (string_list_has_string(&queued, key.buf))
+                continue;
+            string_list_insert(&queued, key.buf);
+            add_suggestion_field(&queue, shard->name);
+            add_suggestion_field(&queue, group_id);
+            add_suggestion_field(&queue, now);
+        }
+    }
+    if (write_in_full(fd, queue.buf, queue.len) < 0 || commit_lock_file(&lock) < 0)
+        ret = error_errno(_("could not write '%s'"), path);
+    rollback_lock_file(&lock);
+    string_list_clear(&queued, 0);
+    strbuf_release(&queue);
+    strbuf_release(&key);
+    return ret;
+}
+
+/*
+ * Take the oldest cluster off the queue, leaving the others for the
+ * next call or for the other workers.
+ */
+static int take_synthesis_job(struct strbuf *job)
+{
+    struct lock_file lock = LOCK_INIT;
+    struct strbuf queue = STRBUF_INIT;
+    const char *path = git_path_synth_queue(), *p, *end, *field[SYNTH_QUEUE_FIELDS];
+    int fd, ret = 0;
+
+    fd = hold_lock_file_for_update_timeout(&lock, path, 0, 1000);
+    if (fd < 0)
+        return error_errno(_("could not lock '%s'"), path);
+    if (strbuf_read_file(&queue, path, 0) < 0) {
+        if (errno != ENOENT)
+            ret = error_errno(_("could not read '%s'"), path);
+        goto out;
+    }
+    p = queue.buf;
+    end = queue.buf + queue.len;
+    if (read_record(&p, end, field, SYNTH_QUEUE_FIELDS)) {
+        if (queue.len)
+            error(_("corrupt '%s'"), path);
+        unlink_or_warn(path);
+        goto out;
+    }
+    strbuf_reset(job);
+    strbuf_add(job, queue.buf, p - queue.buf);
+    if (p == end) {
+        unlink_or_warn(path);
+    } else if (write_in_full(fd, p, end - p) < 0 || commit_lock_file(&lock) < 0) {
+        ret = error_errno(_("could not write '%s'"), path);
+        goto out;
+    }
+    ret = 1;
+out:
+    rollback_lock_file(&lock);
+    strbuf_release(&queue);
+    return ret;
+}
+
+static int cluster_size(struct conflict_shard *shard, const char *group_id)
+{
+    struct json_object *index = shard_index(shard), *pairs;
+
+    if (!index || !json_object_object_get_ex(index, group_id, &pairs))
+        return 0;
+    return json_object_array_length(pairs);
+}
+
+/*
+ * How many pairs went into the cluster: its size, plus the members
+ * that were replaced once it was full, which a full cluster still
+ * changes with.
+ */
+static int cluster_generation(struct conflict_shard *shard, const char *group_id)
+{
+    struct string_list_item *item;
+
+    load_cluster_summaries(shard);
+    item = string_list_lookup(&shard->summaries, group_id);
+    return cluster_size(shard, group_id) +
+        (item ? ((struct cluster_summary *)item->util)->replaced : 0);
+}
+
+/*
+ * The generations (see cluster_generation()) of the clusters of the
+ * shard when their rules were last learned, as "<cluster id> <size>"
+ * lines; the util of each cluster is its size.
+ */
+static void read_synthesized_sizes(struct conflict_shard *shard, struct strbuf *buf,
+                                   struct string_list *sizes)
+{
+    struct string_list lines = STRING_LIST_INIT_NODUP;
+    int i;
+
+    if (strbuf_read_file(buf, shard->synth_file, 0) < 0)
+        return;
+    string_list_split_in_place(&lines, buf->buf, '\n', -1);
+    for (i = 0; i < lines.nr; i++) {
+        char *size = strchr(lines.items[i].string, ' ');
+
+        if (!size)
+            continue;
+        *size++ = '\0';
+        string_list_insert(sizes, lines.items[i].string)->util =
+            (void *)(intptr_t)atoi(size);
+    }
+    string_list_clear(&lines, 0);
+}
+
+static int synthesized_size(struct conflict_shard *shard, const char *group_id)
+{
+    struct strbuf buf = STRBUF_INIT;
+    struct string_list sizes = STRING_LIST_INIT_NODUP;
+    struct string_list_item *item;
+    int size;
+
+    read_synthesized_sizes(shard, &buf, &sizes);
+    item = string_list_lookup(&sizes, group_id);
+    size = item ? (intptr_t)item->util : 0;
+    string_list_clear(&sizes, 0);
+    strbuf_release(&buf);
+    return size;
+}
+
+static void record_synthesized_size(struct conflict_shard *shard, const char *group_id, int size)
+{
+    struct lock_file lock = LOCK_INIT;
+    struct strbuf buf = STRBUF_INIT, out = STRBUF_INIT;
+    struct string_list sizes = STRING_LIST_INIT_NODUP;
+    int i, fd;
+
+    fd = hold_lock_file_for_update_timeout(&lock, shard->synth_file, 0, 1000);
+    if (fd < 0) {
+        error_errno(_("could not lock '%s'"), shard->synth_file);
+        return;
+    }
+    read_synthesized_sizes(shard, &buf, &sizes);
+    string_list_insert(&sizes, group_id)->util = (void *)(intptr_t)size;
+    for (i = 0; i < sizes.nr; i++)
+        strbuf_addf(&out, "%s %d\n", sizes.items[i].string, (int)(intptr_t)sizes.items[i].util);
+    if (write_in_full(fd, out.buf, out.len) < 0 || commit_lock_file(&lock) < 0)
+        error_errno(_("could not write '%s'"), shard->synth_file);
+    rollback_lock_file(&lock);
+    string_list_clear(&sizes, 0);
+    strbuf_release(&buf);
+    strbuf_release(&out);
+}
+
+/*
+ * A cluster is worth learning again when it shrank (it was reclustered)
+ * or gained at least an eighth of its size, and at least one pair.
+ */
+static int cluster_changed(int size, int last)
+{
+    return size < last || size >= last + (last / SYNTH_MIN_GROWTH ? last / SYNTH_MIN_GROWTH : 1);
+}
+
+static void run_synthesis_job(const char **field)
+{
+    struct conflict_shard *shard = conflict_shard_named(field[0]);
+    const char *group_id = field[1];
+    struct string_list groups = STRING_LIST_INIT_NODUP;
+    uint64_t queued = strtoumax(field[2], NULL, 10), start, end;
+    FILE *log;
+    int size, generation, ret;
+
+    /* the index may have grown since this worker read it */
+    if (shard->index)
+        json_object_put(shard->index);
+    shard->index = NULL;
+    shard->loaded = 0;
+    write_cluster_summaries(shard);
+    string_list_clear(&shard->summaries, 1);
+    shard->summaries_loaded = 0;
+
+    size = cluster_size(shard, group_id);
+    generation = cluster_generation(shard, group_id);
+    /* an evicted cluster has no rules to learn */
+    if (!size || !cluster_changed(generation, synthesized_size(shard, group_id)))
+        return;
+
+    /* the jar only reads conflict_index.json */
+    if (compact_journal(shard->index_file, shard->journal_file))
+        return;
+    string_list_append(&groups, group_id);
+    start = getnanotime();
+    if (rerere_jar_synthesis)
+        ret = executeRegexJar_shard(shard, &groups);
+    else
+        ret = synthesize_shard_rules(shard, &groups);
+    end = getnanotime();
+    string_list_clear(&groups, 0);
+    if (ret)
+        return;
+    record_synthesized_size(shard, group_id, generation);
+
+    log = fopen(git_path_synth_log(), "a");
+    if (log) {
+        fprintf(log, "%s\t%s\t%d\t%"PRIuMAX"\t%"PRIuMAX"\n", shard->name, group_id, size,
+                (uintmax_t)(start > queued ? (start - queued) / 1000000 : 0),
+                (uintmax_t)((end - start) / 1000000));
+        fclose(log);
+    }
+}
+
+static void process_synthesis_queue(void)
+{
+    struct strbuf job = STRBUF_INIT;
+    int ret;
+
+    do {
+        struct lock_file worker = LOCK_INIT;
+        int slot;
+
+        for (slot = 0; slot < rerere_synthesis_jobs; slot++)
+            if (hold_lock_file_for_update(&worker, git_path("rr-cache/synth-worker.%d", slot), 0) >= 0)
+                break;
+        /* as many workers as allowed are draining the queue already */
+        if (slot == rerere_synthesis_jobs)
+            break;
+        while ((ret = take_synthesis_job(&job)) > 0) {
+            const char *field[SYNTH_QUEUE_FIELDS], *p = job.buf;
+
+            if (!read_record(&p, job.buf + job.len, field, SYNTH_QUEUE_FIELDS))
+                run_synthesis_job(field);
+        }
+        rollback_lock_file(&worker);
+        /*
+         * A cluster may have been queued after we last looked but before
+         * we let go of the worker lock, with its own worker giving up.
+         */
+    } while (!ret && file_exists(git_path_synth_queue()));
+    strbuf_release(&job);
+}
+
+/*
+ * Queue the clusters that changed for new rules; they are learned in
+ * the background by the worker flush_suggestion_queue() starts, or
+ * right away when the suggestions are wanted before "git rerere"
+ * returns.
+ */
+static void learn_cluster_rules(void)
+{
+    int i, changed = 0;
+
+    for (i = 0; i < conflict_shards.nr; i++) {
+        struct conflict_shard *shard = conflict_shards.items[i].util;
+
+        if (shard->changed_groups.nr)
+            changed = 1;
+    }
+    if (!changed || queue_changed_clusters())
+        goto out;
+    if (rerere_suggest_async)
+        synthesis_queued = 1;
+    else
+        process_synthesis_queue();
+out:
+    for (i = 0; i < conflict_shards.nr; i++) {
+        struct conflict_shard *shard = conflict_shards.items[i].util;
+
+        string_list_clear(&shard->changed_groups, 0);
     }
-    //fprintf_ln(stderr, _("LOG_EXIT: executeRegexJar"));
-    return;
 }
 
 /*
@@ -2161,24 +5270,24 @@ static void do_rerere_one_path(struct index_state *istate,
     const char *path = rr_item->string;
     struct rerere_id *id = rr_item->util;
     struct rerere_dir *rr_dir = id->collection;
-    int variant;
+    int variant, left, recorded;
 
     variant = id->variant;
 
-    const char *hash = rerere_id_hex(id);
 //    fprintf_ln(stderr, _("VARIANT: %d"),variant);
 //    fprintf_ln(stderr, _("PATH: %s"),path);
     /* Has the user resolved it already? */
     if (variant >= 0) {
         if (!handle_file(istate, path, NULL, NULL)) {
+            int marker_size = ll_merge_marker_size(istate, path);
+
             copy_file(rerere_path(id, "postimage"), path, 0666);
             id->collection->status[variant] |= RR_HAS_POSTIMAGE;
             fprintf_ln(stderr, _("Recorded resolution for '%s'."), path);
 
-            hash_index_file(".git/rr-cache/hash_index",path,hash);
-
-            int marker_size = ll_merge_marker_size(istate, path);
-            conflict_index_file(id,marker_size);
+            record_fingerprint(istate, path, id);
+            record_hunk_resolutions(id, marker_size);
+            conflict_index_file(find_conflict_shard(istate, path), id, marker_size);
 
             free_rerere_id(rr_item);
             rr_item->util = NULL;
@@ -2205,8 +5314,6 @@ static void do_rerere_one_path(struct index_state *istate,
         if (merge(istate, &vid, path))
             continue; /* failed to replay */
 
-        hash_index_file(".git/rr-cache/hash_index",path,hash);
-
         /*
          * If there already is a different variant that applies
          * cleanly, there is no point maintaining our own variant.
@@ -2238,6 +5345,25 @@ static void do_rerere_one_path(struct index_state *istate,
     }
     id->collection->status[variant] |= RR_HAS_PREIMAGE;
     fprintf_ln(stderr, _("Recorded preimage for '%s'"), path);
+
+    /* resolve what we can hunk by hunk */
+    left = replay_hunk_resolutions(istate, path, &recorded);
+    if (left < 0)
+        return;
+    if (left && recorded)
+        fprintf_ln(stderr, Q_("Resolved all but %d hunk of '%s' using previous resolutions.",
+                              "Resolved all but %d hunks of '%s' using previous resolutions.",
+                              left), left, path);
+    else if (left)
+        fprintf_ln(stderr, Q_("Resolved all but %d hunk of '%s' as import blocks.",
+                              "Resolved all but %d hunks of '%s' as import blocks.",
+                              left), left, path);
+    else if (rerere_autoupdate)
+        string_list_insert(update, path);
+    else if (recorded)
+        fprintf_ln(stderr, _("Resolved '%s' using previous hunk resolutions."), path);
+    else
+        fprintf_ln(stderr, _("Resolved the import blocks of '%s'."), path);
 }
 
 static int do_plain_rerere(struct repository *r,
@@ -2247,10 +5373,10 @@ static int do_plain_rerere(struct repository *r,
 
     struct string_list conflict = STRING_LIST_INIT_DUP;
     struct string_list update = STRING_LIST_INIT_DUP;
+    struct string_list unchanged = STRING_LIST_INIT_NODUP;
     int i;
 
     find_conflict(r, &conflict);
-    string_list_init(&groupId_list,1);
     /*
      * MERGE_RR records paths with conflicts immediately after
      * merge failed.  Some of the conflicted paths might have been
@@ -2263,6 +5389,13 @@ static int do_plain_rerere(struct repository *r,
         const char *path = conflict.items[i].string;
         int ret;
 
+        /* still the conflict we looked at last time, nothing to redo */
+        if (merge_rr_unchanged(rr, path)) {
+            string_list_insert(&unchanged, path);
+            continue;
+        }
+        remember_merge_rr_stat(path);
+
         /*
          * Ask handle_file() to scan and assign a
          * conflict ID.  No need to write anything out
@@ -2276,15 +5409,8 @@ static int do_plain_rerere(struct repository *r,
         if (ret < 1)
             continue;
 
-        char *old_hash = get_file_hash(path);
-        //fprintf_ln(stderr, _("old hash: %s"),old_hash);
-        //fprintf_ln(stderr, _("new hash: %s"),sha1_to_hex(hash));
-
-        if (old_hash && strcmp(old_hash,sha1_to_hex(hash)) != 0) {
-            //check_hash_change(r->index,path, old_hash,sha1_to_hex(hash));
-        }
-
         id = new_rerere_id(hash); //create new id here !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+        carry_over_fingerprinted_resolution(r->index, path, id);
         string_list_insert(rr, path)->util = id;
 
         /* Ensure that the directory exists. */
@@ -2296,23 +5422,50 @@ static int do_plain_rerere(struct repository *r,
     }
 
     for (i = 0; i < rr->nr; i++) {
+        if (string_list_has_string(&unchanged, rr->items[i].string))
+            continue;
         do_rerere_one_path(r->index, &rr->items[i], &update);
         //fprintf_ln(stderr, _("LOG_EXIT: do_rerere_one_path function"));
     }
 
-    executeRegexJar();
+    learn_cluster_rules();
+    flush_suggestion_queue();
 
     if (update.nr)
         update_paths(r, &update);
 
+    string_list_clear(&unchanged, 0);
     fprintf_ln(stderr, _("______LOG_EXIT: do_plain_rerere function before write_rr(rr, fd)"));
     return write_rr(rr, fd);
 }
 
 static void git_rerere_config(void)
 {
+    const char *synthesizer, *dir;
+
     git_config_get_bool("rerere.enabled", &rerere_enabled);
     git_config_get_bool("rerere.autoupdate", &rerere_autoupdate);
+    git_config_get_bool("rerere.suggestasync", &rerere_suggest_async);
+    if (!git_config_get_string_const("rerere.synthesizer", &synthesizer)) {
+        if (!strcmp(synthesizer, "jar"))
+            rerere_jar_synthesis = 1;
+        else if (!strcmp(synthesizer, "native"))
+            rerere_jar_synthesis = 0;
+        else
+            warning(_("unknown rerere.synthesizer '%s'"), synthesizer);
+    }
+    if (!git_config_get_int("rerere.synthesisjobs", &rerere_synthesis_jobs) &&
+        rerere_synthesis_jobs < 1)
+        rerere_synthesis_jobs = 1;
+    git_config_get_ulong("rerere.journalsize", &rerere_journal_size);
+    git_config_get_int("rerere.maxclusters", &rerere_max_clusters);
+    git_config_get_int("rerere.clustermembers", &rerere_cluster_members);
+    git_config_get_bool("rerere.cachedaemon", &rerere_cache_daemon);
+    if (!git_config_get_pathname("rerere.searchreplacedir", &dir)) {
+        free(search_replace_dir);
+        search_replace_dir = xstrfmt("%s%s", dir, ends_with(dir, "/") ? "" : "/");
+        free((char *)dir);
+    }
     git_config(git_default_config, NULL);
 }
 
@@ -2354,6 +5507,108 @@ int setup_rerere(struct repository *r, struct string_list *merge_rr, int flags)
     return fd;
 }
 
+int rerere_suggest(struct repository *r, int process, int detach)
+{
+    git_rerere_config();
+    if (!is_rerere_enabled())
+        return 0;
+    if (!process) {
+        show_suggestions();
+        return 0;
+    }
+    /* failure to daemonize is ok, we'll continue in foreground */
+    if (detach)
+        daemonize();
+    /* the rules first, the suggestions are computed with them */
+    process_synthesis_queue();
+    process_suggestion_queue();
+    clear_conflict_shards();
+    return 0;
+}
+
+/*
+ * The daemon keeps the shards it read, and reads one again when another
+ * process (a compaction, "git rerere gc", a git without the daemon)
+ * changed its index or its journal behind its back.
+ */
+static void remember_shard_files(struct conflict_shard *shard)
+{
+    int fd;
+
+    fd = open(shard->index_file, O_RDONLY);
+    stat_validity_update(&shard->index_validity, fd);
+    if (fd >= 0)
+        close(fd);
+    fd = open(shard->journal_file, O_RDONLY);
+    stat_validity_update(&shard->journal_validity, fd);
+    if (fd >= 0)
+        close(fd);
+}
+
+static void refresh_cached_shard(struct conflict_shard *shard)
+{
+    if (stat_validity_check(&shard->index_validity, shard->index_file) &&
+        stat_validity_check(&shard->journal_validity, shard->journal_file))
+        return;
+    if (shard->index)
+        json_object_put(shard->index);
+    shard->index = NULL;
+    shard->loaded = 0;
+    if (shard->digests_loaded)
+        oidset_clear(&shard->digests);
+    shard->digests_loaded = 0;
+    write_cluster_summaries(shard);
+    string_list_clear(&shard->summaries, 1);
+    shard->summaries_loaded = 0;
+    remember_shard_files(shard);
+}
+
+void rerere_cache_serve(struct strbuf *request, struct strbuf *reply)
+{
+    const char *p = request->buf, *end = request->buf + request->len, *field[4];
+    struct conflict_shard *shard;
+    const char *group_id = NULL;
+
+    if (!serving_cache) {
+        git_rerere_config();
+        serving_cache = 1;
+    }
+    strbuf_reset(reply);
+    if (read_record(&p, end, field, 3))
+        return;
+    shard = conflict_shard_named(field[1]);
+    refresh_cached_shard(shard);
+
+    if (!strcmp(field[0], "match")) {
+        group_id = get_conflict_json_id(shard, (char *)field[2], NULL);
+    } else if (!strcmp(field[0], "record") && !read_record(&p, end, field + 3, 1)) {
+        string_list_clear(&shard->changed_groups, 0);
+        if (write_json_conflict_index(shard, (char *)field[2], (char *)field[3]) &&
+            shard->changed_groups.nr)
+            group_id = shard->changed_groups.items[0].string;
+        remember_shard_files(shard);
+    } else {
+        return;
+    }
+    add_suggestion_field(reply, group_id ? "1" : "0");
+    if (group_id)
+        add_suggestion_field(reply, group_id);
+    string_list_clear(&shard->changed_groups, 0);
+}
+
+void rerere_cache_flush(void)
+{
+    int i;
+
+    for (i = 0; i < conflict_shards.nr; i++) {
+        struct conflict_shard *shard = conflict_shards.items[i].util;
+
+        write_cluster_summaries(shard);
+        compact_journal_if_large(shard->index_file, shard->journal_file);
+        remember_shard_files(shard);
+    }
+}
+
 /*
  * The main entry point that is called internally from codepaths that
  * perform mergy operations, possibly leaving conflicted index entries
@@ -2371,6 +5626,9 @@ int repo_rerere(struct repository *r, int flags)
         return 0;
     status = do_plain_rerere(r, &merge_rr, fd);
     free_rerere_dirs();
+    clear_conflict_shards();
+    clear_fingerprints();
+    clear_hunk_resolutions();
     fprintf_ln(stderr, _("LOG_EXIT: repo_rerere function"));
     return status;
 }
@@ -2538,6 +5796,7 @@ static int rerere_forget_one_path(struct index_state *istate,
      * conflict in the working tree, run us again to record
      * the postimage.
      */
+    forget_hunk_resolutions(id, ll_merge_marker_size(istate, path));
     handle_cache(istate, path, hash, rerere_path(id, "preimage"));
     fprintf_ln(stderr, _("Updated preimage for '%s'"), path);
 
@@ -2633,6 +5892,28 @@ static void prune_one(struct rerere_id *id,
         unlink_rr_item(id);
 }
 
+static void compact_conflict_journals(void)
+{
+    struct conflict_shard *shard = conflict_shard_named("");
+    DIR *dir;
+    struct dirent *e;
+
+    compact_journal(shard->index_file, shard->journal_file);
+    compute_conflict_digests(shard);
+    dir = opendir(git_path("rr-cache/shards"));
+    while (dir && (e = readdir(dir))) {
+        if (is_dot_or_dotdot(e->d_name))
+            continue;
+        shard = conflict_shard_named(e->d_name);
+        compact_journal(shard->index_file, shard->journal_file);
+        compute_conflict_digests(shard);
+    }
+    if (dir)
+        closedir(dir);
+    compact_journal(git_path_conflict_list(), git_path_conflict_list_journal());
+    clear_conflict_shards();
+}
+
 void rerere_gc(struct repository *r, struct string_list *rr)
 {
     struct string_list to_remove = STRING_LIST_INIT_DUP;
@@ -2681,6 +5962,10 @@ void rerere_gc(struct repository *r, struct string_list *rr)
     for (i = 0; i < to_remove.nr; i++)
         rmdir(git_path("rr-cache/%s", to_remove.items[i].string));
     string_list_clear(&to_remove, 0);
+    compact_conflict_journals();
+    prune_fingerprints();
+    compact_hunk_resolutions();
+    compact_suggestions(rr);
     rollback_lock_file(&write_lock);
 }
 
@@ -2706,5 +5991,8 @@ void rerere_clear(struct repository *r, struct string_list *merge_rr)
         }
     }
     unlink_or_warn(git_path_merge_rr(r));
+    unlink_or_warn(git_path_merge_rr_stat());
+    unlink_or_warn(git_path_suggest_queue());
+    unlink_or_warn(git_path_suggestions());
     rollback_lock_file(&write_lock);
 }
@@ -5,6 +5,8 @@
 
 struct pathspec;
 struct repository;
+struct s_xmconflicts;
+struct strbuf;
 
 #define RERERE_AUTOUPDATE   01
 #define RERERE_NOAUTOUPDATE 02
@@ -39,6 +41,30 @@ int rerere_forget(struct repository *, struct pathspec *);
 int rerere_remaining(struct repository *, struct string_list *);
 void rerere_clear(struct repository *, struct string_list *);
 void rerere_gc(struct repository *, struct string_list *);
+/*
+ * Show the search/replace suggestions computed so far for the
+ * conflicted hunks, or, with "process" set, compute the ones that are
+ * still queued, in the background unless "detach" is unset.
+ */
+int rerere_suggest(struct repository *, int process, int detach);
+
+/*
+ * For the "almost-rerere" merge driver: copy the merge result "buf" to
+ * "out" with the "conflicts" xdl_merge() left in it that were resolved
+ * before resolved the same way.  Return how many conflicts are left, or
+ * -1 if none was resolved (and "out" is to be ignored).
+ */
+int rerere_resolve_conflicts(const char *buf, size_t len,
+			     const struct s_xmconflicts *conflicts, struct strbuf *out);
+
+/*
+ * For "git rerere-cache--daemon": answer a request of another git
+ * process from the cluster indexes kept in memory, and write back what
+ * is only kept in memory.
+ */
+const char *git_path_rerere_cache_socket(void);
+void rerere_cache_serve(struct strbuf *request, struct strbuf *reply);
+void rerere_cache_flush(void);
 
 #define OPT_RERERE_AUTOUPDATE(v) OPT_UYN(0, "rerere-autoupdate", (v), \
 	N_("update the index with reused conflict resolution if possible"))
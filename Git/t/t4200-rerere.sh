@@ -671,4 +671,593 @@ test_expect_success 'test simple stage 1 handling' '
 	)
 '
 
+test_expect_success 'rerere suggest shows the suggestions a merge queued' '
+	test_create_repo suggest &&
+	(
+		cd suggest &&
+		git config rerere.enabled true &&
+		printf "a\\nint x = 1;\\nb\\n" >a.java &&
+		cp a.java b.java &&
+		git add a.java b.java &&
+		git commit -q -m base &&
+		git checkout -q -b side &&
+		printf "a\\nint x = 3;\\nb\\n" >a.java &&
+		git commit -q -a -m side &&
+		git checkout -q -b side2 master &&
+		printf "a\\nint x = 5;\\nb\\n" >b.java &&
+		git commit -q -a -m side2 &&
+		git checkout -q master &&
+		printf "a\\nint x = 2;\\nb\\n" >a.java &&
+		cp a.java b.java &&
+		git commit -q -a -m master &&
+		test_must_fail git merge side &&
+		git checkout --theirs a.java &&
+		git rerere &&
+		git commit -q -a -m resolved &&
+
+		# keep the worker from draining the queue
+		>.git/rr-cache/suggest-worker.lock &&
+		test_must_fail git merge side2 &&
+		tr "\0" "\n" <.git/rr-cache/suggest-queue >queue &&
+		printf "%s\n" b.java java 1 "int x = 2;" b.java java 1 "int x = 5;" >expect &&
+		test_cmp expect queue &&
+		git rerere suggest >actual 2>err &&
+		test_must_be_empty actual &&
+		test_i18ngrep "2 suggestions are still being computed" err &&
+
+		rm .git/rr-cache/suggest-worker.lock &&
+		git rerere suggest --process --no-detach &&
+		test_path_is_missing .git/rr-cache/suggest-queue &&
+		git rerere suggest 2>err &&
+		test_i18ngrep ! "still being computed" err &&
+
+		>.git/rr-cache/suggest-worker.lock &&
+		git reset -q --hard &&
+		test_must_fail git merge side2 &&
+		test_path_is_file .git/rr-cache/suggest-queue &&
+		printf "%s\0" b.java java 1 x y z b.java gone.java java 1 x y z gone.java \
+			>.git/rr-cache/suggestions &&
+		git rerere gc &&
+		git rerere suggest >out &&
+		grep "^b.java\$" out &&
+		! grep gone.java out &&
+		git rerere clear &&
+		test_path_is_missing .git/rr-cache/suggest-queue &&
+		test_path_is_missing .git/rr-cache/suggestions &&
+		rm .git/rr-cache/suggest-worker.lock
+	)
+'
+
+test_expect_success 'rerere records an identical pair only once' '
+	test_create_repo digests &&
+	(
+		cd digests &&
+		git config rerere.enabled true &&
+		git config rerere.suggestAsync false &&
+		git config rerere.synthesizer native &&
+		printf "a\\nx = 1;\\nb\\n" >a.c &&
+		cp a.c b.c &&
+		git add a.c b.c &&
+		git commit -q -m base &&
+		git checkout -q -b side &&
+		sed -e "s/1/3/" a.c >b.c &&
+		cp b.c a.c &&
+		git commit -q -a -m side &&
+		git checkout -q master &&
+		sed -e "s/1/2/" a.c >b.c &&
+		cp b.c a.c &&
+		git commit -q -a -m master &&
+		test_must_fail git merge side &&
+		git checkout --ours a.c b.c &&
+		git rerere 2>err &&
+		shard=.git/rr-cache/shards/c &&
+		test_line_count = 1 $shard/conflict_index.digests &&
+		grep -c "\"conflict\"" $shard/conflict_index.json >count &&
+		echo 1 >expect &&
+		test_cmp expect count
+	)
+'
+
+test_expect_success 'rerere computes the digests again when the index is gone' '
+	test_create_repo stale-digests &&
+	(
+		cd stale-digests &&
+		git config rerere.enabled true &&
+		git config rerere.suggestAsync false &&
+		printf "a\\nx = 1;\\nb\\n" >a.c &&
+		git add a.c &&
+		git commit -q -m base &&
+		git checkout -q -b side &&
+		printf "a\\nx = 3;\\nb\\n" >a.c &&
+		git commit -q -a -m side &&
+		git checkout -q master &&
+		printf "a\\nx = 2;\\nb\\n" >a.c &&
+		git commit -q -a -m master &&
+		test_must_fail git merge side &&
+		git checkout --ours a.c &&
+		git rerere &&
+		shard=.git/rr-cache/shards/c &&
+		test_line_count = 1 $shard/conflict_index.digests &&
+		rm -f $shard/conflict_index.json $shard/conflict_index.journal &&
+		git rerere forget a.c &&
+		git rerere &&
+		grep -c "\"conflict\"" $shard/conflict_index.json >count &&
+		echo 1 >expect &&
+		test_cmp expect count
+	)
+'
+
+test_expect_success 'rerere records a pair in the shard of its file' '
+	test_create_repo shards &&
+	(
+		cd shards &&
+		git config rerere.enabled true &&
+		git config rerere.suggestAsync false &&
+		echo "*.txt conflict-class=Docs" >.git/info/attributes &&
+		mkdir -p .git/rr-cache &&
+		echo "{ \"1\": [ { \"conflict\": \"old\", \"resolution\": \"older\" } ] }" \
+			>.git/rr-cache/conflict_index.json &&
+		for f in a.c b.txt c
+		do
+			printf "a\\nx = 1;\\nb\\n" >$f || return 1
+		done &&
+		git add . &&
+		git commit -q -m base &&
+		git checkout -q -b side &&
+		for f in a.c b.txt c
+		do
+			printf "a\\nx = 3;\\nb\\n" >$f || return 1
+		done &&
+		git commit -q -a -m side &&
+		git checkout -q master &&
+		printf "a\\nx = 2;\\nb\\n" >a.c &&
+		printf "a\\ny = 2;\\nb\\n" >b.txt &&
+		printf "a\\nz = 2;\\nb\\n" >c &&
+		git commit -q -a -m master &&
+		test_must_fail git merge side &&
+		git checkout --ours a.c b.txt c &&
+		git rerere &&
+		git rerere gc &&
+		index=.git/rr-cache/conflict_index.json &&
+		c=.git/rr-cache/shards/c/conflict_index.json &&
+		docs=.git/rr-cache/shards/docs/conflict_index.json &&
+		grep "x = 2;" $c &&
+		grep "y = 2;" $docs &&
+		grep "z = 2;" $index &&
+		! grep "[yz] = 2;" $c &&
+		! grep "[xz] = 2;" $docs &&
+		! grep "[xy] = 2;" $index &&
+
+		# the pairs recorded before the index was sharded
+		grep "older" $index &&
+		! grep "older" $c &&
+		! grep "older" $docs &&
+		test_path_is_missing .git/rr-cache/conflict_index.unsharded.json
+	)
+'
+
+test_expect_success 'rerere learns the same rule for the same conflicts' '
+	rules=.git/rr-cache/shards/c/regex_replace_index.json &&
+	grep "\"regex\":\"3\"" digests/$rules &&
+	grep "\"replacement\":\"2\"" digests/$rules &&
+	git clone -q digests synth &&
+	(
+		cd synth &&
+		git config rerere.enabled true &&
+		git config rerere.suggestAsync false &&
+		git config rerere.synthesizer native &&
+		git checkout -q -b side origin/side &&
+		git checkout -q master &&
+		test_must_fail git merge side &&
+		git checkout --ours a.c b.c &&
+		git rerere &&
+		test_cmp ../digests/$rules $rules
+	)
+'
+
+test_expect_success 'rerere remembers the size it learned a cluster at' '
+	(
+		cd synth &&
+		echo "1 1" >expect &&
+		test_cmp expect .git/rr-cache/shards/c/conflict_index.synthesized &&
+		test_path_is_missing .git/rr-cache/synth-queue &&
+		test_line_count = 1 .git/rr-cache/synth-log &&
+		cut -f 1-3 .git/rr-cache/synth-log >actual &&
+		printf "c\t1\t1\n" >expect &&
+		test_cmp expect actual
+	)
+'
+
+test_expect_success 'rerere gc folds the journal into conflict_list.json' '
+	(
+		cd digests &&
+		test_path_is_file .git/rr-cache/conflict_list.journal &&
+		test_path_is_missing .git/rr-cache/shards/c/conflict_index.journal &&
+		git rerere gc &&
+		test_path_is_missing .git/rr-cache/conflict_list.journal &&
+		grep "\"resolution\":\"x = 2;\"" .git/rr-cache/conflict_list.json
+	)
+'
+
+test_expect_success 'rerere replays a resolution on a conflict that only gained spaces' '
+	test_create_repo fingerprints &&
+	(
+		cd fingerprints &&
+		git config rerere.enabled true &&
+		git config rerere.suggestAsync false &&
+		printf "a\\nb\\nc\\n" >f.txt &&
+		git add f.txt &&
+		git commit -q -m base &&
+		git checkout -q -b side &&
+		printf "a\\nside\\nc\\n" >f.txt &&
+		git commit -q -a -m side &&
+		git checkout -q -b spaced master &&
+		printf "a\\nside  \\nc\\n" >f.txt &&
+		git commit -q -a -m spaced &&
+		git checkout -q master &&
+		printf "a\\nmain\\nc\\n" >f.txt &&
+		git commit -q -a -m master &&
+		test_must_fail git merge side &&
+		git checkout --ours f.txt &&
+		git rerere &&
+		test_line_count = 1 .git/rr-cache/fingerprints &&
+		git reset -q --hard &&
+		test_must_fail git merge spaced &&
+		printf "a\\nmain\\nc\\n" >expect &&
+		test_cmp expect f.txt
+	)
+'
+
+test_expect_success 'rerere keeps the cluster index within its budget' '
+	test_create_repo budget &&
+	(
+		cd budget &&
+		git config rerere.enabled true &&
+		git config rerere.suggestAsync false &&
+		git config rerere.maxClusters 2 &&
+		git config rerere.clusterMembers 1 &&
+		printf "a\\nx = 1;\\nb\\n" >a.c &&
+		printf "a\\nreturn list;\\nb\\n" >b.c &&
+		printf "a\\nprintf(name);\\nb\\n" >c.c &&
+		cp c.c d.c &&
+		git add . &&
+		git commit -q -m base &&
+		git checkout -q -b side &&
+		printf "a\\nx = 3;\\nb\\n" >a.c &&
+		printf "a\\nwhile (p) p++;\\nb\\n" >b.c &&
+		printf "a\\nfoo(bar, baz);\\nb\\n" >c.c &&
+		printf "a\\nfoo(bar, bay);\\nb\\n" >d.c &&
+		git commit -q -a -m side &&
+		git checkout -q master &&
+		printf "a\\nx = 2;\\nb\\n" >a.c &&
+		printf "a\\nreturn NULL;\\nb\\n" >b.c &&
+		printf "a\\nputs(name);\\nb\\n" >c.c &&
+		printf "a\\nputs(name2);\\nb\\n" >d.c &&
+		git commit -q -a -m master &&
+		test_must_fail git merge side &&
+		git checkout --ours a.c b.c c.c d.c &&
+		git rerere &&
+		shard=.git/rr-cache/shards/c &&
+		grep "^-" $shard/conflict_index.digests &&
+		git rerere gc &&
+		cat >expect <<-\EOF &&
+		4 4
+		2 1 2 0
+		EOF
+		head -n 2 $shard/conflict_index.clusters >actual &&
+		test_cmp expect actual &&
+		# whether the second pair replaced the first is left to chance
+		sed -n 3p $shard/conflict_index.clusters >actual &&
+		grep "^3 2 4 [01]\$" actual &&
+		grep -c "\"conflict\"" $shard/conflict_index.json >count &&
+		echo 2 >expect &&
+		test_cmp expect count &&
+		test_line_count = 2 $shard/conflict_index.digests &&
+		! grep "x = 3;" $shard/conflict_index.json
+	)
+'
+
+test_expect_success 'rerere records through a cache daemon shared by the worktrees' '
+	test_create_repo cached &&
+	(
+		cd cached &&
+		git config rerere.enabled true &&
+		git config rerere.suggestAsync false &&
+		git config rerere.cacheDaemon true &&
+		test_when_finished "git rerere-cache--daemon --exit" &&
+		printf "a\\nx = 1;\\nb\\n" >a.c &&
+		git add a.c &&
+		git commit -q -m base &&
+		git checkout -q -b side &&
+		printf "a\\nx = 3;\\nb\\n" >a.c &&
+		git commit -q -a -m side &&
+		git checkout -q -b other master &&
+		printf "a\\nx = 4;\\nb\\n" >a.c &&
+		git commit -q -a -m other &&
+		git checkout -q master &&
+		printf "a\\nx = 2;\\nb\\n" >a.c &&
+		git commit -q -a -m master &&
+		test_must_fail git merge side &&
+		git checkout --ours a.c &&
+		git rerere &&
+		test -S .git/rr-cache/daemon/socket &&
+		git worktree add -q --detach ../cached-worktree master &&
+		(
+			cd ../cached-worktree &&
+			test_must_fail git merge other &&
+			git checkout --ours a.c &&
+			git rerere
+		) &&
+		git rerere gc &&
+		grep -c "\"conflict\"" .git/rr-cache/shards/c/conflict_index.json >count &&
+		echo 2 >expect &&
+		test_cmp expect count &&
+		git rerere-cache--daemon --exit &&
+		test_path_is_missing .git/rr-cache/daemon/socket
+	)
+'
+
+test_expect_success 'rerere does not examine an unchanged conflicted file again' '
+	test_create_repo unchanged &&
+	(
+		cd unchanged &&
+		git config rerere.enabled true &&
+		git config rerere.suggestAsync false &&
+		printf "a\\nx = 1;\\nb\\n" >a.c &&
+		git add a.c &&
+		git commit -q -m base &&
+		git checkout -q -b side &&
+		printf "a\\nx = 3;\\nb\\n" >a.c &&
+		git commit -q -a -m side &&
+		git checkout -q master &&
+		printf "a\\nx = 2;\\nb\\n" >a.c &&
+		git commit -q -a -m master &&
+		test_must_fail git merge side &&
+		test-tool chmtime =-60 a.c &&
+		git rerere 2>err &&
+		test_i18ngrep "Recorded preimage" err &&
+		git rerere 2>err &&
+		test_i18ngrep ! "Recorded preimage" err &&
+		echo >>a.c &&
+		git rerere 2>err &&
+		test_i18ngrep "Recorded preimage" err
+	)
+'
+
+test_expect_success 'rerere replays the hunks it has a resolution for' '
+	test_create_repo hunks &&
+	(
+		cd hunks &&
+		git config rerere.enabled true &&
+		git config rerere.suggestAsync false &&
+		printf "a\\nx = 1;\\nb\\nc\\nd\\ne\\ny = 1;\\nf\\n" >a.c &&
+		git add a.c &&
+		git commit -q -m base &&
+		git checkout -q -b side &&
+		printf "a\\nx = 3;\\nb\\nc\\nd\\ne\\ny = 3;\\nf\\n" >a.c &&
+		git commit -q -a -m side &&
+		git checkout -q -b other master &&
+		printf "a\\nx = 4;\\nb\\nc\\nd\\ne\\ny = 3;\\nf\\n" >a.c &&
+		git commit -q -a -m other &&
+		git checkout -q master &&
+		printf "a\\nx = 2;\\nb\\nc\\nd\\ne\\ny = 2;\\nf\\n" >a.c &&
+		git commit -q -a -m master &&
+		test_must_fail git merge side &&
+		printf "a\\nx = 23;\\nb\\nc\\nd\\ne\\ny = 23;\\nf\\n" >a.c &&
+		git rerere &&
+		git reset -q --hard &&
+		test_must_fail git merge other 2>err &&
+		test_i18ngrep "Resolved all but 1 hunk of .a.c." err &&
+		grep "^y = 23;" a.c &&
+		grep "^x = 4;" a.c &&
+		test_i18ngrep ! "y = 3;" a.c
+	)
+'
+
+test_expect_success 'rerere records no hunk it cannot find the end of' '
+	test_create_repo hunk-end &&
+	(
+		cd hunk-end &&
+		git config rerere.enabled true &&
+		git config rerere.suggestAsync false &&
+		printf "a\\nx = 1;\\n}\\nb\\n" >a.c &&
+		git add a.c &&
+		git commit -q -m base &&
+		git checkout -q -b side &&
+		printf "a\\nx = 3;\\n}\\nb\\n" >a.c &&
+		git commit -q -a -m side &&
+		git checkout -q master &&
+		printf "a\\nx = 2;\\n}\\nb\\n" >a.c &&
+		git commit -q -a -m master &&
+		test_must_fail git merge side &&
+		printf "a\\nif (y) {\\nx = 23;\\n}\\n}\\nb\\n" >a.c &&
+		git rerere &&
+		test_path_is_missing .git/rr-cache/hunks
+	)
+'
+
+test_expect_success 'rerere forget drops the resolutions of the hunks' '
+	test_create_repo hunk-forget &&
+	(
+		cd hunk-forget &&
+		git config rerere.enabled true &&
+		git config rerere.suggestAsync false &&
+		printf "a\\nx = 1;\\nb\\n" >a.c &&
+		git add a.c &&
+		git commit -q -m base &&
+		git checkout -q -b side &&
+		printf "a\\nx = 3;\\nb\\n" >a.c &&
+		git commit -q -a -m side &&
+		git checkout -q master &&
+		printf "a\\nx = 2;\\nb\\n" >a.c &&
+		git commit -q -a -m master &&
+		test_must_fail git merge side &&
+		printf "a\\nx = 23;\\nb\\n" >a.c &&
+		git rerere &&
+		tr "\\000" "\\n" <.git/rr-cache/hunks >records &&
+		grep "^x = 23;" records &&
+		git rerere forget a.c &&
+		tr "\\000" "\\n" <.git/rr-cache/hunks >records &&
+		grep "^-" records &&
+		git rerere gc &&
+		test_must_be_empty .git/rr-cache/hunks
+	)
+'
+
+test_expect_success 'rerere finds the conflicts among the merged subtrees' '
+	test_create_repo subtrees &&
+	(
+		cd subtrees &&
+		git config rerere.enabled true &&
+		git config rerere.suggestAsync false &&
+		for d in a b c d
+		do
+			mkdir -p $d/sub &&
+			echo $d >$d/file &&
+			echo $d >$d/sub/file || return 1
+		done &&
+		git add . &&
+		git commit -q -m base &&
+		git checkout -q -b side &&
+		echo side >b/sub/file &&
+		echo side >d/file &&
+		git commit -q -a -m side &&
+		git checkout -q master &&
+		echo master >b/sub/file &&
+		git rm -q d/file &&
+		git commit -q -a -m master &&
+		test_must_fail git merge side &&
+		git rerere status >actual &&
+		echo b/sub/file >expect &&
+		test_cmp expect actual &&
+		git rerere remaining >actual &&
+		printf "b/sub/file\\nd/file\\n" >expect &&
+		test_cmp expect actual &&
+		echo resolved >b/sub/file &&
+		git add b/sub/file &&
+		git rerere remaining >actual &&
+		echo d/file >expect &&
+		test_cmp expect actual
+	)
+'
+
+test_expect_success 'the almost-rerere merge driver resolves the recorded hunks' '
+	(
+		cd hunks &&
+		git reset -q --hard &&
+		echo "a.c merge=almost-rerere" >.git/info/attributes &&
+		git checkout -q -b only-y side &&
+		printf "a\\nx = 2;\\nb\\nc\\nd\\ne\\ny = 3;\\nf\\n" >a.c &&
+		git commit -q -a -m only-y &&
+		git checkout -q master &&
+		test_must_fail git merge other 2>err &&
+		test_i18ngrep ! "Resolved all but" err &&
+		grep "^y = 23;" a.c &&
+		grep -c "^<<<<<<<" a.c >count &&
+		echo 1 >expect &&
+		test_cmp expect count &&
+		git reset -q --hard &&
+		git merge only-y &&
+		grep "^y = 23;" a.c &&
+		grep "^x = 2;" a.c &&
+		rm .git/info/attributes
+	)
+'
+
+test_expect_success 'rerere resolves import blocks with the conflict-imports attribute' '
+	test_create_repo imports &&
+	(
+		cd imports &&
+		git config rerere.enabled true &&
+		git config rerere.suggestAsync false &&
+		printf "import a.A;\\nimport b.B;\\n\\nclass C {}\\n" >C.java &&
+		git add C.java &&
+		git commit -q -m base &&
+		git checkout -q -b side &&
+		printf "import a.A;\\nimport b.B;\\nimport d.D;\\n\\nclass C {}\\n" >C.java &&
+		git commit -q -a -m side &&
+		git checkout -q master &&
+		printf "import a.A;\\nimport b.B;\\nimport z.Z;\\n\\nclass C {}\\n" >C.java &&
+		git commit -q -a -m master &&
+
+		test_must_fail git merge side &&
+		grep "^<<<<<<<" C.java &&
+		git reset -q --hard &&
+
+		echo "*.java conflict-imports" >.gitattributes &&
+		test_must_fail git merge side 2>err &&
+		test_i18ngrep "Resolved the import blocks of .C.java." err &&
+		printf "import a.A;\\nimport b.B;\\nimport d.D;\\nimport z.Z;\\n\\nclass C {}\\n" >expect &&
+		test_cmp expect C.java &&
+		git reset -q --hard &&
+
+		echo "*.java conflict-imports=union" >.gitattributes &&
+		test_must_fail git merge side &&
+		printf "import a.A;\\nimport b.B;\\nimport z.Z;\\nimport d.D;\\n\\nclass C {}\\n" >expect &&
+		test_cmp expect C.java
+	)
+'
+
+test_expect_success 'rerere keeps the groups of import blocks and what diff3 shows deleted' '
+	(
+		cd imports &&
+		git reset -q --hard &&
+		echo "*.java conflict-imports" >.gitattributes &&
+		git checkout -q -b groups-base master &&
+		printf "import a.A;\\nimport b.B;\\n\\nimport x.X;\\n\\nclass C {}\\n" >C.java &&
+		git commit -q -a -m groups-base &&
+		git checkout -q -b groups-side &&
+		printf "import a.A;\\nimport d.D;\\n\\nimport x.X;\\nimport y.Y;\\n\\nclass C {}\\n" >C.java &&
+		git commit -q -a -m groups-side &&
+		git checkout -q groups-base &&
+		printf "import a.A;\\nimport b.B;\\nimport c.C;\\n\\nimport w.W;\\nimport x.X;\\n\\nclass C {}\\n" >C.java &&
+		git commit -q -a -m groups-ours &&
+
+		test_must_fail git -c merge.conflictStyle=diff3 merge groups-side &&
+		printf "import a.A;\\nimport c.C;\\nimport d.D;\\n\\nimport w.W;\\nimport x.X;\\nimport y.Y;\\n\\nclass C {}\\n" >expect &&
+		test_cmp expect C.java &&
+		git reset -q --hard &&
+
+		test_must_fail git merge groups-side &&
+		printf "import a.A;\\nimport b.B;\\nimport c.C;\\nimport d.D;\\n\\nimport w.W;\\nimport x.X;\\nimport y.Y;\\n\\nclass C {}\\n" >expect &&
+		test_cmp expect C.java
+	)
+'
+
+test_expect_success 'rerere does not replay a journal that was folded already' '
+	test_create_repo snapshots &&
+	(
+		cd snapshots &&
+		git config rerere.enabled true &&
+		git config rerere.suggestAsync false &&
+		printf "a\\nx = 1;\\nb\\n" >a.c &&
+		git add a.c &&
+		git commit -q -m base &&
+		git checkout -q -b side &&
+		sed -e "s/1/3/" a.c >b &&
+		mv b a.c &&
+		git commit -q -a -m side &&
+		git checkout -q master &&
+		sed -e "s/1/2/" a.c >b &&
+		mv b a.c &&
+		git commit -q -a -m master &&
+		test_must_fail git merge side &&
+		git checkout --ours a.c &&
+		git rerere &&
+		journal=.git/rr-cache/conflict_list.journal &&
+		head -n 1 $journal >head &&
+		grep "^{\"base\":\"" head &&
+		cp $journal stale &&
+		git rerere gc &&
+		test_path_is_missing $journal &&
+		cp .git/rr-cache/conflict_list.json expect &&
+
+		# as if the compaction died before removing the journal
+		mv stale $journal &&
+		git rerere gc &&
+		test_path_is_missing $journal &&
+		test_cmp expect .git/rr-cache/conflict_list.json
+	)
+'
+
 test_done
@@ -123,6 +123,25 @@ long xdl_mmfile_size(mmfile_t *mmf);
 int xdl_diff(mmfile_t *mf1, mmfile_t *mf2, xpparam_t const *xpp,
 	     xdemitconf_t const *xecfg, xdemitcb_t *ecb);
 
+/*
+ * A conflict left in the result of xdl_merge(): the lines each input
+ * has in it, and where the hunk (markers included) and the text of
+ * each side are in the result buffer.
+ */
+typedef struct s_xmconflict {
+	long i0, chg0;		/* lines of orig */
+	long i1, chg1;		/* lines of mf1 */
+	long i2, chg2;		/* lines of mf2 */
+	long start, size;	/* bytes of the hunk in the result */
+	long start1, size1;	/* bytes of the side of mf1 */
+	long start2, size2;	/* bytes of the side of mf2 */
+} xmconflict_t;
+
+typedef struct s_xmconflicts {
+	xmconflict_t *conflict;
+	long nr, alloc;
+} xmconflicts_t;
+
 typedef struct s_xmparam {
 	xpparam_t xpp;
 	int marker_size;
@@ -132,6 +151,8 @@ typedef struct s_xmparam {
 	const char *ancestor;	/* label for orig */
 	const char *file1;	/* label for mf1 */
 	const char *file2;	/* label for mf2 */
+	/* if set, the conflicts of the result are stored there, in order */
+	xmconflicts_t *conflicts;
 } xmparam_t;
 
 #define DEFAULT_CONFLICT_MARKER_SIZE 7
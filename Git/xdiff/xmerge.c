@@ -193,16 +193,42 @@ static int is_cr_needed(xdfenv_t *xe1, xdfenv_t *xe2, xdmerge_t *m)
 	return needs_cr < 0 ? 0 : needs_cr;
 }
 
+static xmconflict_t *xdl_add_conflict(xmconflicts_t *conflicts, xdmerge_t *m)
+{
+	xmconflict_t *c;
+
+	if (conflicts->nr == conflicts->alloc) {
+		long alloc = conflicts->alloc ? conflicts->alloc * 2 : 8;
+
+		c = xdl_realloc(conflicts->conflict, alloc * sizeof(*c));
+		if (!c)
+			return NULL;
+		conflicts->conflict = c;
+		conflicts->alloc = alloc;
+	}
+	c = &conflicts->conflict[conflicts->nr++];
+	memset(c, 0, sizeof(*c));
+	c->i0 = m->i0;
+	c->chg0 = m->chg0;
+	c->i1 = m->i1;
+	c->chg1 = m->chg1;
+	c->i2 = m->i2;
+	c->chg2 = m->chg2;
+	return c;
+}
+
 static int fill_conflict_hunk(xdfenv_t *xe1, const char *name1,
 			      xdfenv_t *xe2, const char *name2,
 			      const char *name3,
 			      int size, int i, int style,
-			      xdmerge_t *m, char *dest, int marker_size)
+			      xdmerge_t *m, char *dest, int marker_size,
+			      xmconflicts_t *conflicts)
 {
 	int marker1_size = (name1 ? strlen(name1) + 1 : 0);
 	int marker2_size = (name2 ? strlen(name2) + 1 : 0);
 	int marker3_size = (name3 ? strlen(name3) + 1 : 0);
 	int needs_cr = is_cr_needed(xe1, xe2, m);
+	xmconflict_t *c = NULL;
 
 	if (marker_size <= 0)
 		marker_size = DEFAULT_CONFLICT_MARKER_SIZE;
@@ -211,6 +237,13 @@ static int fill_conflict_hunk(xdfenv_t *xe1, const char *name1,
 	size += xdl_recs_copy(xe1, i, m->i1 - i, 0, 0,
 			      dest ? dest + size : NULL);
 
+	if (dest && conflicts) {
+		c = xdl_add_conflict(conflicts, m);
+		if (!c)
+			return -1;
+		c->start = size;
+	}
+
 	if (!dest) {
 		size += marker_size + 1 + needs_cr + marker1_size;
 	} else {
@@ -227,8 +260,12 @@ static int fill_conflict_hunk(xdfenv_t *xe1, const char *name1,
 	}
 
 	/* Postimage from side #1 */
+	if (c)
+		c->start1 = size;
 	size += xdl_recs_copy(xe1, m->i1, m->chg1, needs_cr, 1,
 			      dest ? dest + size : NULL);
+	if (c)
+		c->size1 = size - c->start1;
 
 	if (style == XDL_MERGE_DIFF3) {
 		/* Shared preimage */
@@ -261,8 +298,12 @@ static int fill_conflict_hunk(xdfenv_t *xe1, const char *name1,
 	}
 
 	/* Postimage from side #2 */
+	if (c)
+		c->start2 = size;
 	size += xdl_recs_copy(xe2, m->i2, m->chg2, needs_cr, 1,
 			      dest ? dest + size : NULL);
+	if (c)
+		c->size2 = size - c->start2;
 	if (!dest) {
 		size += marker_size + 1 + needs_cr + marker2_size;
 	} else {
@@ -277,6 +318,8 @@ static int fill_conflict_hunk(xdfenv_t *xe1, const char *name1,
 			dest[size++] = '\r';
 		dest[size++] = '\n';
 	}
+	if (c)
+		c->size = size - c->start;
 	return size;
 }
 
@@ -285,7 +328,7 @@ static int xdl_fill_merge_buffer(xdfenv_t *xe1, const char *name1,
 				 const char *ancestor_name,
 				 int favor,
 				 xdmerge_t *m, char *dest, int style,
-				 int marker_size)
+				 int marker_size, xmconflicts_t *conflicts)
 {
 	int size, i;
 
@@ -293,12 +336,14 @@ static int xdl_fill_merge_buffer(xdfenv_t *xe1, const char *name1,
 		if (favor && !m->mode)
 			m->mode = favor;
 
-		if (m->mode == 0)
+		if (m->mode == 0) {
 			size = fill_conflict_hunk(xe1, name1, xe2, name2,
 						  ancestor_name,
 						  size, i, style, m, dest,
-						  marker_size);
-		else if (m->mode & 3) {
+						  marker_size, conflicts);
+			if (size < 0)
+				return -1;
+		} else if (m->mode & 3) {
 			/* Before conflicting part */
 			size += xdl_recs_copy(xe1, i, m->i1 - i, 0, 0,
 					      dest ? dest + size : NULL);
@@ -616,16 +661,23 @@ static int xdl_do_merge(xdfenv_t *xe1, xdchange_t *xscr1,
 		int size = xdl_fill_merge_buffer(xe1, name1, xe2, name2,
 						 ancestor_name,
 						 favor, changes, NULL, style,
-						 marker_size);
+						 marker_size, NULL);
 		result->ptr = xdl_malloc(size);
 		if (!result->ptr) {
 			xdl_cleanup_merge(changes);
 			return -1;
 		}
 		result->size = size;
-		xdl_fill_merge_buffer(xe1, name1, xe2, name2,
-				      ancestor_name, favor, changes,
-				      result->ptr, style, marker_size);
+		if (xdl_fill_merge_buffer(xe1, name1, xe2, name2,
+					  ancestor_name, favor, changes,
+					  result->ptr, style, marker_size,
+					  xmp->conflicts) < 0) {
+			xdl_free(result->ptr);
+			result->ptr = NULL;
+			result->size = 0;
+			xdl_cleanup_merge(changes);
+			return -1;
+		}
 	}
 	return xdl_cleanup_merge(changes);
 }
@@ -640,6 +692,8 @@ int xdl_merge(mmfile_t *orig, mmfile_t *mf1, mmfile_t *mf2,
 
 	result->ptr = NULL;
 	result->size = 0;
+	if (xmp->conflicts)
+		xmp->conflicts->nr = 0;
 
 	if (xdl_do_diff(orig, mf1, xpp, &xe1) < 0) {
 		return -1;
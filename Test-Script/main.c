@@ -7,6 +7,10 @@
 #include <stdlib.h>  // rand(), srand()
 #include <time.h>    // time()
 #include <errno.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #define SCALING_FACTOR 0.1
 //#define similarity_th 0.80
@@ -21,6 +25,9 @@
 #define STRING_REPLACE_RESULT_FILENAME  ".git/rr-cache/regex_replace_result.txt"
 #define PERFORMANCE_FILENAME ".git/rr-cache/performance.txt"
 #define CLUSTER_STATISTICS_FILENAME ".git/rr-cache/statistics.txt"
+#define CONFLICT_DIGEST_FILENAME ".git/rr-cache/conflict_index.digests"
+#define RESULTS_BINARY_FILENAME ".git/rr-cache/results.bin"
+#define SWEEP_FILENAME ".git/rr-cache/sweep.txt"
 
 #define REGEX_REPLACEMENT_JAR "RegexReplacement.jar"
 #define RANDOM_SEARCH_REPLACE_JAR "RandomSearchReplaceTurtle.jar"
@@ -31,12 +38,16 @@
 #define STRING_REPLACE_RESULT 3
 #define PERFORMANCE 4
 #define CLUSTER_STATISTICS 5
+#define CONFLICT_DIGEST 6
+#define RESULTS_BINARY 7
+#define SWEEP 8
+#define FILE_NAMES 9
 
 double similarity_th=0.80;
 char *groupId_list = NULL;
 int cluster_population = 0;
 
-char *file_names[5];
+char *file_names[FILE_NAMES];
 
 //loaded from config.properties
 char *workdir_path = NULL;
@@ -59,22 +70,267 @@ static char *concat(const char *str1, const char *str2) {
 }
 
 
-static char *escapeCSV(char *in) {
-    int in_len = strlen(in);
-    char *out_buf = malloc(in_len * 2 + 3);
-    int out_idx = 0;
-    int in_idx = 0;
+/*
+ * The result, statistics and performance files are written through one
+ * sink: each file is opened once with a large buffer, a producer builds
+ * its rows in a buffer it reuses, a row is escaped in the same pass
+ * that renders it as CSV, and rows of concurrent producers do not
+ * interleave.
+ *
+ * With --binary the rows of all three files go to results.bin instead,
+ * as typed columns that are neither formatted nor escaped, and
+ * "--convert" renders that file as the CSV files afterwards.  A
+ * "--sweep" run only writes the sweep file.
+ */
+#define SINK_BUFFER_SIZE (1 << 20)
+#define SINK_MAGIC "ARRS"
+
+enum sink_stream {
+    SINK_RESULT,
+    SINK_STATISTICS,
+    SINK_PERFORMANCE,
+    SINK_SWEEP,
+    SINK_STREAMS
+};
+
+/* the file of each stream, and whether a run starts it afresh */
+static const struct {
+    int file;
+    const char *mode;
+} sink_files[SINK_STREAMS] = {
+    { STRING_REPLACE_RESULT, "a" },
+    { CLUSTER_STATISTICS, "a" },
+    { PERFORMANCE, "w" },
+    { SWEEP, "w" },
+};
+
+enum sink_column {
+    SINK_STRING = 's',  /* uint32_t length and the bytes */
+    SINK_INT = 'i',     /* int32_t */
+    SINK_DOUBLE = 'd'   /* double, written with "%f" */
+};
+
+struct sink_row {
+    char *buf;          /* the typed columns */
+    size_t len;
+    size_t alloc;
+    char *csv;          /* the row rendered as a CSV line */
+    size_t csv_len;
+    size_t csv_alloc;
+};
+
+struct result_sink {
+    pthread_mutex_t lock;
+    FILE *fp[SINK_STREAMS];
+    FILE *binary;
+};
+
+static struct result_sink results = { PTHREAD_MUTEX_INITIALIZER };
+
+static void sink_grow(char **buf, size_t *alloc, size_t need) {
+    if (need <= *alloc)
+        return;
+    *alloc = need > 2 * *alloc ? need : 2 * *alloc;
+    *buf = realloc(*buf, *alloc);
+    if (!*buf)
+        exit(EXIT_FAILURE);
+}
 
-    for (in_idx = 0; in_idx < in_len; in_idx++) {
-        if (in[in_idx] == '"') {
-            out_buf[out_idx++] = '\"';
-            out_buf[out_idx++] = '\"';
-        } else {
-            out_buf[out_idx++] = in[in_idx];
+static void sink_add(struct sink_row *row, const void *data, size_t len) {
+    sink_grow(&row->buf, &row->alloc, row->len + len);
+    memcpy(row->buf + row->len, data, len);
+    row->len += len;
+}
+
+static void sink_reset(struct sink_row *row) {
+    row->len = 0;
+}
+
+static void sink_release(struct sink_row *row) {
+    free(row->buf);
+    free(row->csv);
+}
+
+static void sink_add_string(struct sink_row *row, const char *s) {
+    char type = SINK_STRING;
+    uint32_t len = s ? (uint32_t) strlen(s) : 0;
+
+    sink_add(row, &type, 1);
+    sink_add(row, &len, sizeof(len));
+    sink_add(row, s, len);
+}
+
+static void sink_add_int(struct sink_row *row, int value) {
+    char type = SINK_INT;
+    int32_t v = value;
+
+    sink_add(row, &type, 1);
+    sink_add(row, &v, sizeof(v));
+}
+
+static void sink_add_double(struct sink_row *row, double value) {
+    char type = SINK_DOUBLE;
+
+    sink_add(row, &type, 1);
+    sink_add(row, &value, sizeof(value));
+}
+
+/*
+ * Render the typed columns in "buf" as a line of quoted CSV fields into
+ * row->csv, escaping the strings as they are copied.
+ */
+static int sink_render_csv(struct sink_row *row, const char *buf, size_t len) {
+    size_t pos = 0;
+
+    row->csv_len = 0;
+    while (pos < len) {
+        char type = buf[pos++];
+        uint32_t slen;
+        int32_t i;
+        double d;
+
+        /* room for the separator, the quotes and a number */
+        sink_grow(&row->csv, &row->csv_alloc, row->csv_len + 400);
+        if (row->csv_len)
+            row->csv[row->csv_len++] = ',';
+        row->csv[row->csv_len++] = '"';
+        switch (type) {
+            case SINK_STRING:
+                if (len - pos < sizeof(slen))
+                    return -1;
+                memcpy(&slen, buf + pos, sizeof(slen));
+                pos += sizeof(slen);
+                if (len - pos < slen)
+                    return -1;
+                sink_grow(&row->csv, &row->csv_alloc, row->csv_len + 2 * (size_t) slen + 4);
+                for (const char *s = buf + pos; s < buf + pos + slen; s++) {
+                    if (*s == '"')
+                        row->csv[row->csv_len++] = '"';
+                    row->csv[row->csv_len++] = *s;
+                }
+                pos += slen;
+                break;
+            case SINK_INT:
+                if (len - pos < sizeof(i))
+                    return -1;
+                memcpy(&i, buf + pos, sizeof(i));
+                pos += sizeof(i);
+                row->csv_len += sprintf(row->csv + row->csv_len, "%d", (int) i);
+                break;
+            case SINK_DOUBLE:
+                if (len - pos < sizeof(d))
+                    return -1;
+                memcpy(&d, buf + pos, sizeof(d));
+                pos += sizeof(d);
+                row->csv_len += snprintf(row->csv + row->csv_len, 360, "%f", d);
+                break;
+            default:
+                return -1;
+        }
+        row->csv[row->csv_len++] = '"';
+    }
+    sink_grow(&row->csv, &row->csv_alloc, row->csv_len + 1);
+    row->csv[row->csv_len++] = '\n';
+    return 0;
+}
+
+static int sink_open(int binary, int sweep) {
+    if (sweep) {
+        results.fp[SINK_SWEEP] = fopen(file_names[SWEEP], sink_files[SINK_SWEEP].mode);
+        return results.fp[SINK_SWEEP] ? 0 : -1;
+    }
+    if (binary) {
+        results.binary = fopen(file_names[RESULTS_BINARY], "wb");
+        if (!results.binary)
+            return -1;
+        setvbuf(results.binary, NULL, _IOFBF, SINK_BUFFER_SIZE);
+        fwrite(SINK_MAGIC, 1, strlen(SINK_MAGIC), results.binary);
+        return 0;
+    }
+    for (int i = 0; i < SINK_SWEEP; i++) {
+        results.fp[i] = fopen(file_names[sink_files[i].file], sink_files[i].mode);
+        if (!results.fp[i])
+            return -1;
+        setvbuf(results.fp[i], NULL, _IOFBF, SINK_BUFFER_SIZE);
+    }
+    return 0;
+}
+
+static void sink_write_row(enum sink_stream stream, struct sink_row *row) {
+    if (!results.binary && sink_render_csv(row, row->buf, row->len))
+        return;
+
+    pthread_mutex_lock(&results.lock);
+    if (results.binary) {
+        unsigned char s = stream;
+        uint32_t len = row->len;
+
+        fwrite(&s, 1, 1, results.binary);
+        fwrite(&len, sizeof(len), 1, results.binary);
+        fwrite(row->buf, 1, row->len, results.binary);
+    } else if (results.fp[stream]) {
+        fwrite(row->csv, 1, row->csv_len, results.fp[stream]);
+    }
+    pthread_mutex_unlock(&results.lock);
+}
+
+static void sink_close() {
+    pthread_mutex_lock(&results.lock);
+    if (results.binary)
+        fclose(results.binary);
+    results.binary = NULL;
+    for (int i = 0; i < SINK_STREAMS; i++) {
+        if (results.fp[i])
+            fclose(results.fp[i]);
+        results.fp[i] = NULL;
+    }
+    pthread_mutex_unlock(&results.lock);
+}
+
+/* render results.bin as the CSV files a run without --binary writes */
+static int sink_convert() {
+    struct sink_row row = { 0 };
+    char magic[4];
+    unsigned char stream;
+    uint32_t len;
+    int ret = 0;
+    FILE *fp = fopen(file_names[RESULTS_BINARY], "rb");
+
+    if (!fp)
+        return -1;
+    if (fread(magic, 1, sizeof(magic), fp) != sizeof(magic) || memcmp(magic, SINK_MAGIC, sizeof(magic)) ||
+        sink_open(0, 0)) {
+        fclose(fp);
+        return -1;
+    }
+    while (fread(&stream, 1, 1, fp) == 1) {
+        if (stream >= SINK_SWEEP || fread(&len, sizeof(len), 1, fp) != 1) {
+            ret = -1;
+            break;
         }
+        sink_grow(&row.buf, &row.alloc, len);
+        row.len = len;
+        if (fread(row.buf, 1, len, fp) != len) {
+            ret = -1;
+            break;
+        }
+        sink_write_row(stream, &row);
     }
-    out_buf[out_idx++] = 0;
-    return out_buf;
+    fclose(fp);
+    sink_close();
+    sink_release(&row);
+    return ret;
+}
+
+static void sink_performance_header() {
+    struct sink_row row = { 0 };
+
+    sink_add_string(&row, "Cluster");
+    sink_add_string(&row, "Cluster Size");
+    sink_add_string(&row, "Execution time [s]");
+    sink_add_string(&row, "Queue time [s]");
+    sink_write_row(SINK_PERFORMANCE, &row);
+    sink_release(&row);
 }
 
 static int max(int x, int y) {
@@ -290,76 +546,317 @@ static double jaro_winkler_distance(const char *s, const char *a) {
     return dw;
 }
 
-static void executeRegexJar(const char *group_id, int recluster, size_t cluster_size) {
-    time_t start;
+/*
+ * Set of 64-bit FNV-1a digests of the (conflict, resolution) pairs in the
+ * conflict index, so that a pair recorded again is rejected before any
+ * similarity is computed.  Kept one hex digest per line in
+ * CONFLICT_DIGEST_FILENAME next to the index; 0 marks an empty slot.
+ */
+struct digest_set {
+    uint64_t *slots;
+    size_t nr;
+    size_t alloc;
+};
+
+static struct digest_set conflict_digests;
+
+static uint64_t conflict_digest(const char *conflict, const char *resolution) {
+    const char *parts[2] = {conflict, resolution};
+    uint64_t h = 14695981039346656037ULL;
+
+    for (int k = 0; k < 2; k++) {
+        const unsigned char *p = (const unsigned char *) parts[k];
+        do {
+            h ^= *p;
+            h *= 1099511628211ULL;
+        } while (*p++);
+    }
+    return h ? h : 1;
+}
+
+static uint64_t *digest_set_slot(struct digest_set *set, uint64_t digest) {
+    size_t i = digest & (set->alloc - 1);
+
+    while (set->slots[i] && set->slots[i] != digest)
+        i = (i + 1) & (set->alloc - 1);
+    return &set->slots[i];
+}
+
+static int digest_set_contains(struct digest_set *set, uint64_t digest) {
+    return set->alloc && *digest_set_slot(set, digest) == digest;
+}
+
+/* return 1 if digest was added, 0 if it was already there */
+static int digest_set_insert(struct digest_set *set, uint64_t digest) {
+    uint64_t *slot;
+
+    if (2 * (set->nr + 1) > set->alloc) {
+        struct digest_set grown = {NULL, 0, set->alloc ? 2 * set->alloc : 1024};
+
+        grown.slots = calloc(grown.alloc, sizeof(*grown.slots));
+        if (!grown.slots)
+            exit(EXIT_FAILURE);
+        for (size_t i = 0; i < set->alloc; i++)
+            if (set->slots[i])
+                *digest_set_slot(&grown, set->slots[i]) = set->slots[i];
+        grown.nr = set->nr;
+        free(set->slots);
+        *set = grown;
+    }
+    slot = digest_set_slot(set, digest);
+    if (*slot)
+        return 0;
+    *slot = digest;
+    set->nr++;
+    return 1;
+}
+
+static void append_digest(uint64_t digest) {
+    FILE *fp = fopen(file_names[CONFLICT_DIGEST], "a");
+
+    if (!fp)
+        return;
+    fprintf(fp, "%016llx\n", (unsigned long long) digest);
+    fclose(fp);
+}
+
+/* Compute the digests from the conflict index, and write them all out. */
+static void compute_conflict_digests() {
+    FILE *fp;
+
+    free(conflict_digests.slots);
+    memset(&conflict_digests, 0, sizeof(conflict_digests));
+    fp = fopen(file_names[CONFLICT_DIGEST], "w");
+    if (fp)
+        fclose(fp);
+
+    struct json_object *file_json = json_object_from_file(file_names[CONFLICT_INDEX]);
+    if (!file_json)
+        return;
+    json_object_object_foreach(file_json, key, val) {
+        int arraylen = json_object_array_length(val);
+        for (int i = 0; i < arraylen; i++) {
+            struct json_object *obj = json_object_array_get_idx(val, i);
+            uint64_t d = conflict_digest(json_object_get_string(json_object_object_get(obj, "conflict")),
+                                         json_object_get_string(json_object_object_get(obj, "resolution")));
+            if (digest_set_insert(&conflict_digests, d))
+                append_digest(d);
+        }
+    }
+    json_object_put(file_json);
+}
+
+/*
+ * Load the digests, or compute them from the conflict index when they
+ * are older than it (it was recorded before they were kept, or replaced
+ * since) or it is gone.
+ */
+static void init_conflict_digests() {
+    struct stat digest_st, index_st;
+    unsigned long long digest;
+    FILE *fp;
+
+    if (stat(file_names[CONFLICT_DIGEST], &digest_st) ||
+        stat(file_names[CONFLICT_INDEX], &index_st) ||
+        digest_st.st_mtime < index_st.st_mtime ||
+        !(fp = fopen(file_names[CONFLICT_DIGEST], "r"))) {
+        compute_conflict_digests();
+        return;
+    }
+    while (fscanf(fp, "%llx", &digest) == 1)
+        digest_set_insert(&conflict_digests, digest);
+    fclose(fp);
+}
+
+/*
+ * Learning the rules of a cluster keeps a JVM busy for a long time,
+ * while a cluster usually gains several pairs in a row.  So the clusters
+ * are queued instead of waited for after every insert: a cluster that
+ * is queued already is not queued again, it is only learned again once
+ * it grew by an eighth since the last time, at most MAX_SYNTH_JOBS JVMs
+ * run at once, and the performance file gets how long each cluster
+ * waited and ran.  The jars all read ./config.properties and read,
+ * update and write back the one regex_replace_index.json it names, so
+ * that two of them at once would lose the rules of one another: they
+ * are run one at a time.
+ */
+#define MAX_SYNTH_JOBS 1
+#define SYNTH_MIN_GROWTH 8
+
+struct synth_job {
+    char *group_id;
+    size_t size;            /* of the cluster, at its last update */
+    size_t learned_size;    /* when its rules were last learned */
+    size_t running_size;    /* of the run in progress */
+    time_t queued;          /* 0 when not queued */
+    time_t queued_at_start; /* of the run in progress */
+    time_t started;
+    pid_t pid;              /* 0 when not running */
+};
+
+static struct synth_job *synth_jobs = NULL;
+static int synth_jobs_nr = 0;
+static int synth_jobs_alloc = 0;
+static int running_synth_jobs = 0;
+
+static struct synth_job *get_synth_job(const char *group_id) {
+    for (int i = 0; i < synth_jobs_nr; i++)
+        if (!strcmp(synth_jobs[i].group_id, group_id))
+            return &synth_jobs[i];
+    if (synth_jobs_nr == synth_jobs_alloc) {
+        synth_jobs_alloc = synth_jobs_alloc ? 2 * synth_jobs_alloc : 16;
+        synth_jobs = realloc(synth_jobs, synth_jobs_alloc * sizeof(*synth_jobs));
+        if (!synth_jobs)
+            exit(EXIT_FAILURE);
+    }
+    memset(&synth_jobs[synth_jobs_nr], 0, sizeof(*synth_jobs));
+    synth_jobs[synth_jobs_nr].group_id = strdup(group_id);
+    return &synth_jobs[synth_jobs_nr++];
+}
+
+/*
+ * A cluster is worth learning again when it shrank (it was reclustered)
+ * or gained at least an eighth of its size, and at least one pair.
+ */
+static int cluster_changed(size_t size, size_t last) {
+    size_t growth = last / SYNTH_MIN_GROWTH ? last / SYNTH_MIN_GROWTH : 1;
+
+    return size < last || size >= last + growth;
+}
+
+static void start_synth_job(struct synth_job *job) {
+    const char *id_array[] = {
+        "/usr/bin/java", //TODO make configurable javagent
+        "-jar",
+        RANDOM_SEARCH_REPLACE_JAR,
+        "./", //config.properties path
+        job->group_id,
+        NULL //terminator need for execv
+    };
+
+    printf("JAVA COMMAND:%s \n", job->group_id);
+    pid_t pid = fork();
+    if (pid < 0) {
+        printf("fork failed\n");
+        return;
+    }
+    if (pid == 0) { // child process
+        /* open /dev/null for writing */
+        int fd = open("/dev/null", O_WRONLY);
+        dup2(fd, 1);    /* make stdout a copy of fd (> /dev/null) */
+        close(fd);
+        execv("/usr/bin/java", (void *) id_array);
+        _exit(127);
+    }
+    job->pid = pid;
+    job->running_size = job->size;
+    job->queued_at_start = job->queued;
+    job->queued = 0;
+    time(&job->started);
+    running_synth_jobs++;
+}
+
+static void finish_synth_job(pid_t pid, int status) {
+    struct synth_job *job = NULL;
     time_t end;
-    FILE *performance_log = fopen(file_names[PERFORMANCE], "a+");
 
-    if (group_id) {
+    for (int i = 0; i < synth_jobs_nr; i++)
+        if (synth_jobs[i].pid == pid)
+            job = &synth_jobs[i];
+    if (!job)
+        return;
+    job->pid = 0;
+    running_synth_jobs--;
+    time(&end);
+
+    if (WIFEXITED(status) && !WEXITSTATUS(status)) {
+        struct sink_row row = { 0 };
+
+        printf("Program execution successful!!!! in %.f secs \n", difftime(end, job->started));
+        job->learned_size = job->running_size;
+        sink_add_string(&row, job->group_id);
+        sink_add_int(&row, (int) job->running_size);
+        sink_add_int(&row, (int) difftime(end, job->started));
+        sink_add_int(&row, (int) difftime(job->started, job->queued_at_start));
+        sink_write_row(SINK_PERFORMANCE, &row);
+        sink_release(&row);
+    } else if (WIFEXITED(status) && WEXITSTATUS(status) == 127) {
+        // execv failed
+        printf("execv failed\n");
+    } else if (WIFEXITED(status)) {
+        printf("Program terminated normally,"
+               " but returned a non-zero status:%f \n", difftime(end, job->started));
+        exit(-666);
+    } else {
+        printf("program didn't terminate normally\n");
+    }
+}
 
-        int length = 5 + 1; //groupId_list.nr know only at runtime
-        const char **id_array = malloc(sizeof(*id_array) * length);
+/*
+ * Reap the JVMs that are done (waiting for one when "block" is set),
+ * and start the clusters that waited the longest while there is room.
+ */
+static void run_synth_jobs(int block) {
+    int status;
+    pid_t pid;
 
-        id_array[0] = "/usr/bin/java"; //TODO make configurable javagent
-        id_array[1] = "-jar";
-        id_array[2] = RANDOM_SEARCH_REPLACE_JAR;
-        if (recluster == 0) { //TODO check
-            id_array[3] = "./"; //config.properties path
-        } else {
-            id_array[3] = "./";
-        }
-
-        id_array[4] = group_id;
-        id_array[length - 1] = NULL; //terminator need for execv
-        printf("JAVA COMMAND:%s \n", id_array[4]);
-
-        //TODO adjust the path to jar file
-        time(&start);
-        pid_t pid = fork();
-        if (pid == 0) { // child process
-            /* open /dev/null for writing */
-            //printf("\n\n\nJAR PROCESS IS STARTING IN BACKGROUND!!!!!\n\n\n");
-            int fd = open("/dev/null", O_WRONLY);
-            dup2(fd, 1);    /* make stdout a copy of fd (> /dev/null) */
-            close(fd);
-            execv("/usr/bin/java", (void *) id_array);
-            time(&start);
-        } else { //parent process
-            int status;
-            //sleep(1);
-            printf("Parent is waiting for the Recluster.........");
-            if (waitpid(pid, &status, 0) > 0) {
-
-                if (WIFEXITED(status) && !WEXITSTATUS(status)) {
-                    time(&end);
-                    printf("Program execution successful!!!! in %.f secs \n", difftime(end, start));
-                    fprintf(performance_log, "\"%s\",\"%zu\",\"%.f\"\n", group_id,
-                            cluster_size, difftime(end, start));
-
-                } else if (WIFEXITED(status) && WEXITSTATUS(status)) {
-                    if (WEXITSTATUS(status) == 127) {
-                        // execv failed
-                        printf("execv failed\n");
-                    } else {
-                        time(&end);
-                        printf("Program terminated normally,"
-                               " but returned a non-zero status:%f \n", difftime(end, start));
-                        exit(-666);
-                    }
-                } else {
-                    printf("program didn't terminate normally\n");
-                }
-            } else {
-                // waitpid() failed
-                printf("waitpid() failed\n");
-            }
+    while (running_synth_jobs &&
+           (pid = waitpid(-1, &status, block ? 0 : WNOHANG)) > 0) {
+        finish_synth_job(pid, status);
+        block = 0;
+    }
+    while (running_synth_jobs < MAX_SYNTH_JOBS) {
+        struct synth_job *next = NULL;
+
+        for (int i = 0; i < synth_jobs_nr; i++) {
+            struct synth_job *job = &synth_jobs[i];
 
+            if (job->queued && !job->pid &&
+                (!next || job->queued < next->queued))
+                next = job;
         }
-        free(id_array);
-        fclose(performance_log);
+        if (!next)
+            break;
+        start_synth_job(next);
+    }
+}
+
+static void schedule_synthesis(const char *group_id, size_t cluster_size) {
+    struct synth_job *job = get_synth_job(group_id);
+
+    job->size = cluster_size;
+    if (!job->queued && cluster_changed(cluster_size, job->pid ? job->running_size : job->learned_size))
+        time(&job->queued);
+    run_synth_jobs(0);
+}
+
+/*
+ * The clusters were renumbered: what was learned or queued under their
+ * old ids says nothing of the clusters now behind those ids.  A JVM that
+ * runs still is reaped, but the sizes it and the others learned at are
+ * forgotten, so that every cluster is queued again.
+ */
+static void reset_synth_jobs() {
+    for (int i = 0; i < synth_jobs_nr; i++) {
+        synth_jobs[i].size = 0;
+        synth_jobs[i].learned_size = 0;
+        synth_jobs[i].running_size = 0;
+        synth_jobs[i].queued = 0;
     }
 }
 
+static void wait_for_synth_jobs() {
+    while (running_synth_jobs) {
+        printf("Waiting for REGEXJAR...\n");
+        run_synth_jobs(1);
+    }
+    for (int i = 0; i < synth_jobs_nr; i++)
+        free(synth_jobs[i].group_id);
+    free(synth_jobs);
+    synth_jobs = NULL;
+    synth_jobs_nr = synth_jobs_alloc = 0;
+}
+
 static double cluster_cluster_similarity(const struct json_object *val, const struct json_object *val2) {
     double total_similarity = 0;
     double jaroW_conf = 0;
@@ -571,7 +1068,6 @@ static const char *get_conflict_json_id(char *conflict, char *resolution) {
 
     struct json_object *obj;
     const char *jconf;
-    const char *jresol;
     int arraylen;
 
     double total_similarity = 0;
@@ -584,14 +1080,6 @@ static const char *get_conflict_json_id(char *conflict, char *resolution) {
         	for (int i = 0; i < arraylen; i++) {
             		obj = json_object_array_get_idx(val, i);
             		jconf = json_object_get_string(json_object_object_get(obj, "conflict"));
-            		jresol = json_object_get_string(json_object_object_get(obj, "resolution"));
-			
-            			if (resolution) {
-                			if (strcmp(conflict, jconf) == 0 && strcmp(resolution, jresol) == 0) {
-                    				json_object_put(file_json);
-                    				return NULL;
-                			}
-            			}	
 
             			jaroW = jaro_winkler_distance(conflict, jconf);
             			total_similarity += jaroW;
@@ -1185,12 +1673,6 @@ static const char *get_conflict_json_id_enhanced(struct json_object *file_json,
             jconf = json_object_get_string(json_object_object_get(obj, "conflict"));
             jresol = json_object_get_string(json_object_object_get(obj, "resolution"));
 
-            if (resolution) {
-                if (strcmp(conflict, jconf) == 0 && strcmp(resolution, jresol) == 0) {
-                    return NULL;
-                }
-            }
-
             jaroW = jaro_winkler_distance(conflict, jconf);
             total_similarity += jaroW;
             if (resolution) {
@@ -1432,9 +1914,8 @@ static const char *get_conflict_json_id_enhanced_minimum(struct json_object *fil
 
 
 
-static int write_json_object(struct json_object *file_object, char *file_name, const char *group_id, char *conflict,
-                             char *resolution) {
-    printf("Login: write_json_object\n");
+static void add_json_pair(struct json_object *file_object, const char *group_id, char *conflict,
+                          char *resolution) {
     struct json_object *object = json_object_new_object();
     struct json_object *jarray = json_object_new_array();
 
@@ -1454,18 +1935,43 @@ static int write_json_object(struct json_object *file_object, char *file_name, c
         json_object_array_add(jarray, object);
         json_object_object_add(file_object, group_id, jarray);
     }
+}
+
+/*
+ * Write "content" next to "file_name", and rename it over the file.  The
+ * learning jars read the index while it is updated: it is never
+ * rewritten in place, so that they never see it half written.
+ */
+static int replace_file(const char *file_name, const char *content) {
+    char *tmp = concat(file_name, ".tmp");
+    FILE *fp = fopen(tmp, "w");
+    int ret = 0;
+
+    if (!fp || fputs(content, fp) == EOF)
+        ret = -1;
+    if (fp && fclose(fp))
+        ret = -1;
+    if (!ret && rename(tmp, file_name))
+        ret = -1;
+    if (ret) {
+        printf("Could not write %s: %s\n", file_name, strerror(errno));
+        unlink(tmp);
+    }
+    free(tmp);
+    return ret;
+}
+
+static int write_json_object(struct json_object *file_object, char *file_name, const char *group_id, char *conflict,
+                             char *resolution) {
+    printf("Login: write_json_object\n");
+    add_json_pair(file_object, group_id, conflict, resolution);
 
-    FILE *fp = fopen(file_name, "w");
-    if (!fp) {
-        perror("Error");
-        printf("Value of errno: %d(%s)\n", errno, strerror(errno));
+    //update or add groupid to file
+    if (replace_file(file_name, json_object_to_json_string_ext(file_object, 2))) {
         printf("Exit: write_json_object: not open FILE conflict_index\n");
         exit(-666);
         return 0;
     }
-    //update or add groupid to file
-    fprintf(fp, "%s", json_object_to_json_string_ext(file_object, 2));
-    fclose(fp);
     //free(object);
     //free(jarray);
     printf("Exit: write_json_object\n");
@@ -1516,13 +2022,13 @@ static struct json_object *hierarchical_clustering2(const struct json_object *js
     //json_object_put(json_conflict);
 
     for (int i = 0; i < cl; i++) {
-        char array[3];
-        sprintf(array, "%d", (i + 1));
+        char array[16];
+        snprintf(array, sizeof(array), "%d", (i + 1));
         struct json_object *returnObjX = json_object_object_get(file_json, array);
         for (int j = 0; j < cl; j++) {
             if (j > i) {
-                char array2[3];
-                sprintf(array2, "%d", (j + 1));
+                char array2[16];
+                snprintf(array2, sizeof(array2), "%d", (j + 1));
                 struct json_object *returnObjY = json_object_object_get(file_json, array2);
                 cluster_weights[i][j] = cluster_cluster_similarity(returnObjX, returnObjY);
             }
@@ -1826,194 +2332,244 @@ static struct json_object *recluster(const struct json_object *file_json) {
     return hierarchical_clustering2(jarray);
 }
 
-static void move_file(int b) {
+/*
+ * Reclustering the whole index takes long, so it runs on a thread of
+ * its own, against the copy of the index that was read when the
+ * clusters were found to have degraded.  The conflicts recorded in the
+ * meantime keep landing on the live index, and are remembered: once the
+ * thread is done, and if its clusters are better, they get these
+ * conflicts too, and replace the index with a single rename().
+ */
+struct recluster_job {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    int running;                    /* started, and not joined yet */
+    int done;                       /* under "lock" */
+    struct json_object *snapshot;   /* only the thread uses it */
+    struct json_object *result;
+    double similarity;              /* of the snapshot */
+    double result_similarity;
+    int conflict_number;            /* when the snapshot was read */
+    struct json_object *inserts;    /* recorded since */
+};
+
+static struct recluster_job reclustering = { .lock = PTHREAD_MUTEX_INITIALIZER };
+static int background_recluster = 0;
+
+#define COPY_BUFFER_SIZE 65536
+
+static int copy_file(const char *source_name, const char *target_name) {
     FILE *source, *target;
-    char ch;
-    source = fopen(file_names[CONFLICT_INDEX], "r");
-    if (source == NULL) {
-        return;
-    }
-    char str[100];
-    sprintf(str, "%s%d", "conflict_index", b);
-    sprintf(str, "%s%s", str, ".json");
-    target = fopen(str, "w");
+    char buf[COPY_BUFFER_SIZE];
+    size_t len;
+    int ret = 0;
+
+    source = fopen(source_name, "r");
+    if (source == NULL)
+        return -1;
+    target = fopen(target_name, "w");
     if (target == NULL) {
         fclose(source);
-        return;
+        return -1;
     }
-    while ((ch = fgetc(source)) != EOF)
-        fputc(ch, target);
-
-    printf("File copied successfully.\n");
-
+    while ((len = fread(buf, 1, sizeof(buf), source)) > 0)
+        if (fwrite(buf, 1, len, target) != len) {
+            ret = -1;
+            break;
+        }
+    if (ferror(source))
+        ret = -1;
     fclose(source);
-    fclose(target);
+    if (fclose(target))
+        ret = -1;
+    return ret;
 }
 
-static void move_file2() {
-    FILE *source, *target;
-    char ch;
-    source = fopen(file_names[CONFLICT_INDEX], "r");
-    if (source == NULL) {
-        return;
-    }
-    char str[100];
-    sprintf(str, "%s", file_names[CONFLICT_INDEX_RECLUSTER]);
-    //sprintf(str, "%s%s", str, ".json");
-    target = fopen(str, "w");
-    if (target == NULL) {
-        fclose(source);
+static void *recluster_thread(void *arg) {
+    struct recluster_job *job = arg;
+    struct json_object *result = recluster(job->snapshot);
+    double similarity = average_intrasimilarity(result);
+
+    json_object_put(job->snapshot);
+    job->snapshot = NULL;
+    pthread_mutex_lock(&job->lock);
+    job->result = result;
+    job->result_similarity = similarity;
+    job->done = 1;
+    pthread_mutex_unlock(&job->lock);
+    return NULL;
+}
+
+/* recluster "file_json" in the background, taking ownership of it */
+static void start_recluster(struct json_object *file_json, double similarity, int conflict_number) {
+    struct recluster_job *job = &reclustering;
+
+    job->snapshot = file_json;
+    job->result = NULL;
+    job->similarity = similarity;
+    job->conflict_number = conflict_number;
+    job->inserts = json_object_new_array();
+    job->done = 0;
+    if (pthread_create(&job->thread, NULL, recluster_thread, job)) {
+        printf("Could not start reclustering\n");
+        json_object_put(job->snapshot);
+        json_object_put(job->inserts);
+        job->snapshot = job->inserts = NULL;
         return;
     }
-    while ((ch = fgetc(source)) != EOF)
-        fputc(ch, target);
+    job->running = 1;
+}
 
-    printf("File copied successfully.\n");
+static void remember_recluster_insert(char *conflict, char *resolution) {
+    struct json_object *object;
 
-    fclose(source);
-    fclose(target);
+    if (!reclustering.running)
+        return;
+    object = json_object_new_object();
+    json_object_object_add(object, "conflict", json_object_new_string(conflict));
+    json_object_object_add(object, "resolution", json_object_new_string(resolution));
+    json_object_array_add(reclustering.inserts, object);
 }
 
+/*
+ * Swap the new clusters in once the thread is done, waiting for it with
+ * "block", and queue their rules to be learned.  Return how many
+ * clusters they have, 0 if the index was left as it was.
+ */
+static int finish_recluster(int block) {
+    struct recluster_job *job = &reclustering;
+    struct json_object *result;
+    int done, number_keys = 0;
 
+    if (!job->running)
+        return 0;
+    pthread_mutex_lock(&job->lock);
+    done = job->done;
+    pthread_mutex_unlock(&job->lock);
+    if (!done && !block)
+        return 0;
+    pthread_join(job->thread, NULL);
+    job->running = 0;
+    result = job->result;
+
+    printf("Average Intrasimilarity after reclustering: %f\n", job->result_similarity);
+    if (job->result_similarity > job->similarity) {
+        const char *content;
+        char backup[100];
+
+        printf("Recluster improved, applying changes...\n");
+        for (size_t i = 0; i < json_object_array_length(job->inserts); i++) {
+            struct json_object *obj = json_object_array_get_idx(job->inserts, i);
+            char *conflict = (char *) json_object_get_string(json_object_object_get(obj, "conflict"));
+            char *resolution = (char *) json_object_get_string(json_object_object_get(obj, "resolution"));
+            const char *group_id = get_conflict_json_id_enhanced(result, conflict, resolution);
+
+            add_json_pair(result, group_id, conflict, resolution);
+        }
+        printf("Replayed %zu conflicts recorded while reclustering\n", json_object_array_length(job->inserts));
+
+        // backup the old conflict index file
+        snprintf(backup, sizeof(backup), "conflict_index%d.json", job->conflict_number);
+        if (copy_file(file_names[CONFLICT_INDEX], backup))
+            printf("Could not back %s up\n", file_names[CONFLICT_INDEX]);
+
+        content = json_object_to_json_string_ext(result, 2);
+        if (!replace_file(file_names[CONFLICT_INDEX], content) &&
+            !replace_file(file_names[CONFLICT_INDEX_RECLUSTER], content)) {
+            compute_conflict_digests();
+            reset_synth_jobs();
+            json_object_object_foreach(result, key, val) {
+                schedule_synthesis(key, json_object_array_length(val));
+                number_keys++;
+            }
+        }
+        printf("Reclustering finished...\n");
+    } else {
+        printf("Recluster NOT improved...\n");
+    }
+    json_object_put(result);
+    json_object_put(job->inserts);
+    job->result = job->inserts = NULL;
+    return number_keys;
+}
+
+/*
+ * Swap in the clusters of the reclustering that finished, if any, or
+ * start one in the background when the clusters degraded.  Return how
+ * many clusters were swapped in, 0 if none.
+ */
 static int check_for_recluster(int conflict_number) {
     printf("Log: check if clustering is required...\n");
+    int id = finish_recluster(0);
+
+    if (id || reclustering.running)
+        return id;
     struct json_object *file_json = json_object_from_file(file_names[CONFLICT_INDEX]);
     double intracluster_similarity = average_intrasimilarity(file_json);
     printf("Average Intrasimilarity: %f\n", intracluster_similarity);
-    int id = 0;
     //id = (char*) json_object_to_json_string(json_object_new_int(0));
-    if (intracluster_similarity <= intrasimilarity_th) { //check intrasimilatiry threshold
-        if (intracluster_similarity > 0) {
-            int cluster_count = 0;
-            int clusters_lenght_1 = 0;
-            int x1 = 0;
-            json_object_object_foreach(file_json, key, val) {
-                cluster_count += 1;
-                int arraylen1 = json_object_array_length(val);
-                x1 = x1 + arraylen1;
-                if (arraylen1 < 2) {
-                    clusters_lenght_1 += 1;
-                }
-            }
-            double percentage_of_singleclusters = (double) clusters_lenght_1 / cluster_count;
-            double percentage_wrt_last = 0;
-            int diff_first_time = 0;
-            if (cluster_population != 0) {
-                percentage_wrt_last = (double) (((x1 - cluster_population) * 100) / cluster_population);
-            } else {
-                diff_first_time = (x1 - cluster_population);
-            }
-            //printf("Clusters: %d - 1-elementcluster: %d - Percentage: %f\n",cluster_count,clusters_lenght_1,percentage_of_singleclusters);
-            printf("Clusters: %d - 1-elementcluster: %d - Percentage: %f - Conflicts in Cluster: %d - Diff from last: %d - change percentage: %f \n",
-                   cluster_count, clusters_lenght_1, percentage_of_singleclusters, x1, (x1 - cluster_population),
-                   percentage_wrt_last);
-            //if(percentage_of_singleclusters < valid_cluster_th){//Start reclustering
-            if (percentage_of_singleclusters < valid_cluster_th && (percentage_wrt_last >= 10 || diff_first_time >=
-                                                                                                 250)/*(x1-cluster_population)>250*/) {//Start reclustering
-                cluster_population = x1;
-                diff_first_time = 0;
-                printf("Start reclustering...\n");
-                struct json_object *file_json_reclustered = recluster(file_json);
-
-                json_object_put(file_json); //close original json object
-                int total = 0;
-                int number_keys = 0;
-                //char ids[256];
-                json_object_object_foreach(file_json_reclustered, key,
-                                           val) {//simple check for number of conflicts parity
-                    //obj1 = NULL;
-                    //jarray = json_object_new_array();
-                    int arraylen = json_object_array_length(val);
-                    //printf("cluster %d: %d \n",key,arraylen);
-                    total = total + arraylen;
-                    number_keys++;
-                }
-                //printf("Conflict extraction size: %d\n",total);
-                double intracluster_similarity_after = average_intrasimilarity(file_json_reclustered);
-                printf("Average Intrasimilarity after reclustering: %f - %d\n", intracluster_similarity_after, total);
-                if (intracluster_similarity_after >/*.87*/intracluster_similarity) {
-                    printf("Recluster improved, applying changes...\n");
-                    move_file(conflict_number);// backup the old conflict index file
-
-                    FILE *fp = fopen(file_names[CONFLICT_INDEX], "w");//write the new recluster index file
-                    if (!fp) {
-                        printf("Exit: write_json_object: not open FILE conflict_index\n");
-                        //return 0;
-                    }
-                    fprintf(fp, "%s", json_object_to_json_string_ext(file_json_reclustered, 2));
-                    fclose(fp);
-                    json_object_put(file_json_reclustered);
-                    move_file2();
-                    /*Prepare to call the regex generator*/
-                    int ids_size = 0;
-                    if (number_keys <= 9) {
-                        ids_size = 2 * number_keys;
-                    } else if (number_keys >= 10 && number_keys <= 99) {
-                        ids_size = 18 + (number_keys - 9) * 3;
-                    } else {
-                        ids_size = 18 + 270 + (number_keys - 99) * 4;
-                    }
-
-                    char ids[ids_size];
-                    ids[0] = '\0';
-                    for (int l = 1; l <= number_keys; l++) {
-                        char array[3] = {'\0'};
-                        sprintf(array, "%d", l);
-                        //printf( "%s\n", array );
-                        strcat(ids, array);
-                        strcat(ids, " ");
-                    }
-                    printf("IDS for regex: %s \n", ids);
-                    //char * id_param = malloc(sizeof(char*));
-                    //memcpy(id_param,ids, strlen(ids)+1);
-                    //executeRegexJarOnline(ids);
-
-                    //json_object_put(file_json_reclustered);
-                    //for(int l = 1; l <= number_keys; l++){
-                    //char array[3]= {'\0'};
-                    //sprintf(array, "%d", l);
-                    //executeRegexJar(array);
-                    //sleep(10);
-                    //}
-                    printf("Reclustering finished...\n");
-                    // return id_param;
-                    return number_keys;
-                } else {
-                    printf("Recluster NOT improved...\n");
-                    json_object_put(file_json_reclustered);
-                    //json_object_put(file_json);
-                    return id;
-                }
-            } else {
-                json_object_put(file_json);
-                return id;
+    if (intracluster_similarity <= intrasimilarity_th && intracluster_similarity > 0) { //check intrasimilatiry threshold
+        int cluster_count = 0;
+        int clusters_lenght_1 = 0;
+        int x1 = 0;
+        json_object_object_foreach(file_json, key, val) {
+            cluster_count += 1;
+            int arraylen1 = json_object_array_length(val);
+            x1 = x1 + arraylen1;
+            if (arraylen1 < 2) {
+                clusters_lenght_1 += 1;
             }
+        }
+        double percentage_of_singleclusters = (double) clusters_lenght_1 / cluster_count;
+        double percentage_wrt_last = 0;
+        int diff_first_time = 0;
+        if (cluster_population != 0) {
+            percentage_wrt_last = (double) (((x1 - cluster_population) * 100) / cluster_population);
         } else {
-            json_object_put(file_json);
+            diff_first_time = (x1 - cluster_population);
+        }
+        printf("Clusters: %d - 1-elementcluster: %d - Percentage: %f - Conflicts in Cluster: %d - Diff from last: %d - change percentage: %f \n",
+               cluster_count, clusters_lenght_1, percentage_of_singleclusters, x1, (x1 - cluster_population),
+               percentage_wrt_last);
+        if (percentage_of_singleclusters < valid_cluster_th && (percentage_wrt_last >= 10 || diff_first_time >=
+                                                                                             250)/*(x1-cluster_population)>250*/) {//Start reclustering
+            cluster_population = x1;
+            printf("Start reclustering in the background...\n");
+            start_recluster(file_json, intracluster_similarity, conflict_number);
             return id;
         }
-    } else {
-        json_object_put(file_json);
-        return id;
     }
-
+    json_object_put(file_json);
+    return id;
 }
 
 static void append_stats(const char *group_id, double intrasimilarity, double largest_distance,double intrasimilarity_conflict,double intrasimilarity_resolution,double longest_distance_conflict, double longest_distance_resolution,
 			 double avg_distance_to_latest_conf, double avg_distance_to_latest_resol){
-    FILE *fp1;
-    //char buf[100];
-    fp1 = fopen(file_names[CLUSTER_STATISTICS], "a+");
-    if (fp1 == NULL)
-        exit(EXIT_FAILURE);
-    //snprintf(buf, 12, "\"%s\",\"%f\",\"%f\"\n", group_id, intrasimilarity, largest_distance); // puts string into buffer
-    fprintf(fp1, "\"%s\", \"%d\",\"%f\",\"%f\",\"%f\",\"%f\",\"%f\",\"%f\",\"%f\",\"%f\"\n", group_id,conf_ID, intrasimilarity, largest_distance,intrasimilarity_conflict,intrasimilarity_resolution,longest_distance_conflict, longest_distance_resolution,avg_distance_to_latest_conf, avg_distance_to_latest_resol);
-    //printf("%s\n", buf);
-    fclose(fp1);
+    struct sink_row row = { 0 };
+
+    sink_add_string(&row, group_id);
+    sink_add_int(&row, conf_ID);
+    sink_add_double(&row, intrasimilarity);
+    sink_add_double(&row, largest_distance);
+    sink_add_double(&row, intrasimilarity_conflict);
+    sink_add_double(&row, intrasimilarity_resolution);
+    sink_add_double(&row, longest_distance_conflict);
+    sink_add_double(&row, longest_distance_resolution);
+    sink_add_double(&row, avg_distance_to_latest_conf);
+    sink_add_double(&row, avg_distance_to_latest_resol);
+    sink_write_row(SINK_STATISTICS, &row);
+    sink_release(&row);
 }
 
 static int write_json_conflict_index(char *conflict, char *resolution, int conflict_number) {
     printf("Login: write_json_conflict_index\n");
+    uint64_t digest = conflict_digest(conflict, resolution);
+
+    if (digest_set_contains(&conflict_digests, digest)) {
+        printf("Exit: write_json_conflict_index: conflict and resolution already present\n");
+        return 0;
+    }
+
     struct json_object *file_json = json_object_from_file(file_names[CONFLICT_INDEX]);
     size_t cluster_size = 0;
 
@@ -2036,6 +2592,9 @@ static int write_json_conflict_index(char *conflict, char *resolution, int confl
         json_object_put(file_json);
         return 0;
     }
+    digest_set_insert(&conflict_digests, digest);
+    append_digest(digest);
+    remember_recluster_insert(conflict, resolution);
 
     /**
      * ---------------------------------------------------------------------
@@ -2065,31 +2624,21 @@ static int write_json_conflict_index(char *conflict, char *resolution, int confl
 
     //printf("\n groupid: %s\n",group_id);
     //const char* ids=check_for_recluster(conflict_number);
-    //Uncomment to test without recluster
-    int ids = 0;//check_for_recluster(conflict_number);
-    //uncomment to test with reclustering
-    //int ids=check_for_recluster(conflict_number);
+    //with --recluster, the clusters are checked and rebuilt in the background
+    int ids = background_recluster ? check_for_recluster(conflict_number) : 0;
 
     //printf("ids=%s, strcmp=%d",ids,strcmp(ids, "0"));
     //if(strcmp(ids, "0")==0){ //Check if reclustering is needed.
     if (ids == 0) {
         json_object_put(file_json);
-        printf("Starting 'executeRegexJar' with cluster of size %zu\n", cluster_size);
-        executeRegexJar(group_id, 0, cluster_size);
+        printf("Scheduling 'executeRegexJar' with cluster of size %zu\n", cluster_size);
+        schedule_synthesis(group_id, cluster_size);
         //json_object_put(file_json);
     } else {
+        // the clusters were renumbered, finish_recluster() scheduled all of them
         json_object_put(file_json);
-        for (int l = 1; l <= ids; l++) {
-            //char array[3]= {'\0'};
-            //sprintf(array, "%d", l);
-            char *array = malloc(sizeof(char *));
-            array = (char *) json_object_to_json_string(json_object_new_int(l));
-            executeRegexJar(array, l, cluster_size);
-            //sleep(10);
-        }
 
         //executeRegexJar(ids);
-        printf("Waiting for REGEXJAR...\n");
         //json_object_put(file_json);
         //sleep(1200);
     }
@@ -2167,12 +2716,16 @@ static void regex_replace_suggestion(char *conflict, char *resolution, int jid,
         printf("RegexReplacement executed in %.f sec\n", difftime(regex_replacement_end, regex_replacement_start));
         if (!status) {
             FILE *fp = fopen(file_names[STRING_REPLACE], "r");
-            if (!fp)
+            if (!fp) {
+                json_object_put(file_json);
                 return;
+            }
 
             fseek(fp, 0, SEEK_END); // goto end of file
             if (ftell(fp) == 0) {
                 printf("file is empty\n");
+                fclose(fp);
+                json_object_put(file_json);
                 unlink(file_names[STRING_REPLACE]);
                 printf("Exit: regex_replace_suggestion\n");
                 return;
@@ -2180,7 +2733,8 @@ static void regex_replace_suggestion(char *conflict, char *resolution, int jid,
             fseek(fp, 0, SEEK_SET);
 
             char buffer1[500], buffer2[500], buffer3[500];
-            char *regex1 = NULL, *regex2 = NULL, *replace1 = NULL, *replace2 = NULL, *res1 = NULL, *res2 = NULL, *cluster = NULL;
+            char buffer4[500], buffer5[500], buffer6[500];
+            char *regex1 = NULL, *regex2 = NULL, *replace1 = NULL, *replace2 = NULL, *res1 = NULL, *res2 = NULL;
             // read first resolution
 
             if (fgets(buffer1, 500, fp) && fgets(buffer2, 500, fp) && fgets(buffer3, 500, fp)) {
@@ -2194,10 +2748,10 @@ static void regex_replace_suggestion(char *conflict, char *resolution, int jid,
             }
 
             // read second resolution
-            if (fgets(buffer1, 500, fp) && fgets(buffer2, 500, fp) && fgets(buffer3, 500, fp)) {
-                regex2 = buffer1;
-                replace2 = buffer2;
-                res2 = buffer3;
+            if (fgets(buffer4, 500, fp) && fgets(buffer5, 500, fp) && fgets(buffer6, 500, fp)) {
+                regex2 = buffer4;
+                replace2 = buffer5;
+                res2 = buffer6;
                 //fprintf_ln(stderr, _("Regex: %s"), buf.buf);
                 printf("Regex2: %s\n", regex2);
                 printf("Repla2: %s\n", replace2);
@@ -2205,67 +2759,41 @@ static void regex_replace_suggestion(char *conflict, char *resolution, int jid,
             }
             fclose(fp);
 
-            fp = fopen(file_names[STRING_REPLACE_RESULT], "a+");
-            conflict = escapeCSV(conflict);
-            jv2 = escapeCSV(jv2);
-            //jv1= escapeCSV(jv1);
-            cluster = escapeCSV(json_object_get_string(cluster_object));
-            if (res1 && res2) {
-                double jw1 = jaro_winkler_distance(resolution, res1);
-                double jw2 = jaro_winkler_distance(resolution, res2);
-                if (jw1 >= jw2) {
-                    regex1[strcspn(regex1, "\n")] = 0;
-                    replace1[strcspn(replace1, "\n")] = 0;
-                    res1[strcspn(res1, "\n")] = 0;
-                    regex1 = escapeCSV(regex1);
-                    replace1 = escapeCSV(replace1);
-                    res1 = escapeCSV(res1);
-                    resolution = escapeCSV(resolution);
-                    //fprintf(fp,"\"%s\",\"%s\",\"%f\",\"%s\",\"%s\",\"%s\",\"%s\",\"%s\",\"%s\",\"%s\",\"%d\"\n",conflict,groupId,jw1,regex1,replace1,resolution,res1,jv1,jv2,jdec,jid);
-                    fprintf(fp, "\"%s\",\"%s\",\"%f\",\"%s\",\"%s\",\"%s\",\"%s\",\"%s\",\"%s\",\"%d\",\"%s\"\n", conflict,
-                            groupId, jw1, regex1, replace1, resolution, res1, jv2, jdec, jid, cluster);
-                    free(conflict);
-                    free(regex1);
-                    free(replace1);
-                    free(res1);
-                    free(cluster);
-                } else {
-                    regex2 = escapeCSV(regex2);
-                    replace2 = escapeCSV(replace2);
-                    res2 = escapeCSV(res2);
-                    regex2[strcspn(regex2, "\n")] = 0;
-                    replace2[strcspn(replace2, "\n")] = 0;
-                    res2[strcspn(res2, "\n")] = 0;
-                    resolution = escapeCSV(resolution);
-                    //fprintf(fp,"\"%s\",\"%s\",\"%f\",\"%s\",\"%s\",\"%s\",\"%s\",\"%s\",\"%s\",\"%s\",\"%d\"\n",conflict,groupId,jw2,regex2,replace2,resolution,res2,jv1,jv2,jdec,jid);
-                    fprintf(fp, "\"%s\",\"%s\",\"%f\",\"%s\",\"%s\",\"%s\",\"%s\",\"%s\",\"%s\",\"%d\",\"%s\"\n", conflict,
-                            groupId, jw2, regex2, replace2, resolution, res2, jv2, jdec, jid, cluster);
-                    free(conflict);
-                    free(regex2);
-                    free(replace2);
-                    free(res2);
-                    free(cluster);
-                }
-            } else {
-                double jw1 = jaro_winkler_distance(resolution, res1);
-                regex1 = escapeCSV(regex1);
-                replace1 = escapeCSV(replace1);
-                res1 = escapeCSV(res1);
-                regex1[strcspn(regex1, "\n")] = 0;
-                replace1[strcspn(replace1, "\n")] = 0;
-                res1[strcspn(res1, "\n")] = 0;
-                resolution = escapeCSV(resolution);
-
-                fprintf(fp, "\"%s\",\"%s\",\"%f\",\"%s\",\"%s\",\"%s\",\"%s\",\"%s\",\"%s\",\"%d\",\"%s\"\n", conflict,
-                        groupId, jw1, regex1, replace1, resolution, res1, jv2, jdec, jid, cluster);
-                free(conflict);
-                free(regex1);
-                free(replace1);
-                free(res1);
-                free(cluster);
+            if (!res1) {
+                printf("Exit: regex replace jar gave no resolution\n");
+                json_object_put(file_json);
+                unlink(file_names[STRING_REPLACE]);
+                return;
             }
-            fclose(fp);
-            json_object_put(cluster_object);
+
+            struct sink_row row = { 0 };
+            double jw = jaro_winkler_distance(resolution, res1);
+
+            if (res2 && jaro_winkler_distance(resolution, res2) > jw) {
+                jw = jaro_winkler_distance(resolution, res2);
+                regex1 = regex2;
+                replace1 = replace2;
+                res1 = res2;
+            }
+            regex1[strcspn(regex1, "\n")] = 0;
+            replace1[strcspn(replace1, "\n")] = 0;
+            res1[strcspn(res1, "\n")] = 0;
+
+            //Version 1, Cluster Id, Similarity, Regex, Replace exp, Developer Resolution, Automatic Resolution, Version 2, Developer Decision, Conflict ID, Cluster
+            sink_add_string(&row, conflict);
+            sink_add_string(&row, groupId);
+            sink_add_double(&row, jw);
+            sink_add_string(&row, regex1);
+            sink_add_string(&row, replace1);
+            sink_add_string(&row, resolution);
+            sink_add_string(&row, res1);
+            sink_add_string(&row, jv2);
+            sink_add_string(&row, jdec);
+            sink_add_int(&row, jid);
+            sink_add_string(&row, json_object_get_string(cluster_object));
+            sink_write_row(SINK_RESULT, &row);
+            sink_release(&row);
+            json_object_put(file_json);
             unlink(file_names[STRING_REPLACE]);
         } else {
             printf("Exit: regex replace jar end with error %d\n", status);
@@ -2275,14 +2803,6 @@ static void regex_replace_suggestion(char *conflict, char *resolution, int jid,
     printf("Exit: regex_replace_suggestion\n");
 }
 
-static void init_performance_file() {
-    FILE *performance_log = fopen(file_names[PERFORMANCE], "w");
-    if (performance_log == NULL)
-        exit(EXIT_FAILURE);
-    fprintf(performance_log, "\"%s\",\"%s\",\"%s\"\n", "Cluster", "Cluster Size", "Execution time [s]");
-    fclose(performance_log);
-}
-
 static void init_similarity_stats_file() {
     printf("Statistics file \"%s\" :\n", file_names[CLUSTER_STATISTICS]);
     FILE *performance_log = fopen(file_names[CLUSTER_STATISTICS], "w");
@@ -2325,6 +2845,9 @@ static int init_properties() {
         file_names[STRING_REPLACE_RESULT] = build_filename(STRING_REPLACE_RESULT_FILENAME);
         file_names[PERFORMANCE] = build_filename(PERFORMANCE_FILENAME);
 	file_names[CLUSTER_STATISTICS] = build_filename(CLUSTER_STATISTICS_FILENAME);
+        file_names[CONFLICT_DIGEST] = build_filename(CONFLICT_DIGEST_FILENAME);
+        file_names[RESULTS_BINARY] = build_filename(RESULTS_BINARY_FILENAME);
+        file_names[SWEEP] = build_filename(SWEEP_FILENAME);
 
         return 0;
     }
@@ -2333,6 +2856,610 @@ static int init_properties() {
     return 1;
 }
 
+/*
+ * The dataset is {"<project>": [ {record}, ... ], ...}, and it is read
+ * one record at a time: the braces, keys and commas around the records
+ * are skipped by hand, and each record is handed to a json_tokener
+ * chunk after chunk, so that only the record being replayed is
+ * resident.
+ *
+ * With --cache, the records are also written to "<dataset>.cache", and
+ * the next runs on the same (unchanged) dataset map that file instead
+ * of parsing the JSON again.  The cache holds, after a header with the
+ * size and the modification time of the dataset, the index and the id
+ * of each record and its strings as a length (DATASET_CACHE_NULL for a
+ * missing one) followed by the NUL terminated bytes; it is only meant
+ * for the machine that wrote it.
+ */
+#define DATASET_CHUNK 65536
+#define DATASET_CACHE_MAGIC "ARRC"
+#define DATASET_CACHE_VERSION 1
+#define DATASET_CACHE_NULL UINT32_MAX
+
+enum dataset_state {
+    DATASET_START,
+    DATASET_PROJECTS,
+    DATASET_RECORDS,
+    DATASET_END
+};
+
+struct dataset_record {
+    int index;          /* in the conflicts of its project, from 0 */
+    int id;
+    char *conflict;
+    char *resolution;
+    char *v1;
+    char *v2;
+    char *devdecision;
+};
+
+struct dataset_reader {
+    /* the JSON dataset */
+    FILE *fp;
+    char buf[DATASET_CHUNK];
+    size_t len;
+    size_t pos;
+    enum dataset_state state;
+    int index;
+    struct json_tokener *tok;
+    struct json_object *current;    /* owns the strings of the last record */
+
+    /* the cache being replayed */
+    char *map;
+    size_t map_len;
+    size_t map_pos;
+
+    /* the cache being written */
+    FILE *cache_out;
+    char *cache_path;
+    char *cache_tmp;
+};
+
+struct dataset_cache_header {
+    char magic[4];
+    uint32_t version;
+    uint64_t size;
+    int64_t mtime;
+};
+
+static void dataset_cache_header(struct dataset_cache_header *header, const struct stat *st) {
+    memset(header, 0, sizeof(*header));
+    memcpy(header->magic, DATASET_CACHE_MAGIC, sizeof(header->magic));
+    header->version = DATASET_CACHE_VERSION;
+    header->size = st->st_size;
+    header->mtime = st->st_mtime;
+}
+
+/* map the cache of the dataset, if there is one and it is still valid */
+static int dataset_map_cache(struct dataset_reader *r, const struct stat *st) {
+    struct dataset_cache_header header, expect;
+    struct stat cache_st;
+    int fd = open(r->cache_path, O_RDONLY);
+
+    if (fd < 0)
+        return -1;
+    dataset_cache_header(&expect, st);
+    if (fstat(fd, &cache_st) || cache_st.st_size < (off_t) sizeof(header) ||
+        read(fd, &header, sizeof(header)) != sizeof(header) ||
+        memcmp(&header, &expect, sizeof(header))) {
+        close(fd);
+        return -1;
+    }
+    r->map_len = cache_st.st_size;
+    /* private and writable, the replay may scribble on the strings */
+    r->map = mmap(NULL, r->map_len, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (r->map == MAP_FAILED) {
+        r->map = NULL;
+        return -1;
+    }
+    r->map_pos = sizeof(header);
+    return 0;
+}
+
+static int dataset_open(struct dataset_reader *r, const char *path, int use_cache) {
+    struct stat st;
+
+    memset(r, 0, sizeof(*r));
+    if (stat(path, &st))
+        return -1;
+    if (use_cache) {
+        r->cache_path = concat(path, ".cache");
+        if (!dataset_map_cache(r, &st)) {
+            printf("Replaying the dataset cache %s\n", r->cache_path);
+            return 0;
+        }
+    }
+
+    r->fp = fopen(path, "r");
+    if (!r->fp)
+        return -1;
+    r->tok = json_tokener_new();
+    r->state = DATASET_START;
+    if (use_cache) {
+        struct dataset_cache_header header;
+
+        r->cache_tmp = concat(r->cache_path, ".tmp");
+        r->cache_out = fopen(r->cache_tmp, "wb");
+        dataset_cache_header(&header, &st);
+        if (r->cache_out && fwrite(&header, sizeof(header), 1, r->cache_out) != 1) {
+            fclose(r->cache_out);
+            r->cache_out = NULL;
+        }
+        if (!r->cache_out)
+            printf("Could not write the dataset cache %s\n", r->cache_tmp);
+    }
+    return 0;
+}
+
+static int dataset_fill(struct dataset_reader *r) {
+    if (r->pos < r->len)
+        return 1;
+    r->len = fread(r->buf, 1, sizeof(r->buf), r->fp);
+    r->pos = 0;
+    return r->len > 0;
+}
+
+/* the next character that is not white space, left unread; EOF at the end */
+static int dataset_peek(struct dataset_reader *r) {
+    while (dataset_fill(r)) {
+        char c = r->buf[r->pos];
+
+        if (c != ' ' && c != '\t' && c != '\n' && c != '\r')
+            return (unsigned char) c;
+        r->pos++;
+    }
+    return EOF;
+}
+
+/* skip the key the reader is at, and the ':' after it */
+static int dataset_skip_key(struct dataset_reader *r) {
+    int escaped = 0;
+
+    r->pos++; /* the opening quote */
+    while (dataset_fill(r)) {
+        char c = r->buf[r->pos++];
+
+        if (escaped) {
+            escaped = 0;
+        } else if (c == '\\') {
+            escaped = 1;
+        } else if (c == '"') {
+            if (dataset_peek(r) != ':')
+                return -1;
+            r->pos++;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static struct json_object *dataset_parse_record(struct dataset_reader *r) {
+    json_tokener_reset(r->tok);
+    while (dataset_fill(r)) {
+        struct json_object *obj = json_tokener_parse_ex(r->tok, r->buf + r->pos, (int) (r->len - r->pos));
+
+        if (obj) {
+            r->pos += json_tokener_get_parse_end(r->tok);
+            return obj;
+        }
+        if (json_tokener_get_error(r->tok) != json_tokener_continue)
+            return NULL;
+        r->pos = r->len;
+    }
+    return NULL;
+}
+
+static void dataset_cache_write_string(FILE *fp, const char *s) {
+    uint32_t len = s ? (uint32_t) strlen(s) : DATASET_CACHE_NULL;
+
+    fwrite(&len, sizeof(len), 1, fp);
+    if (s)
+        fwrite(s, 1, len + 1, fp);
+}
+
+static void dataset_cache_write(struct dataset_reader *r, const struct dataset_record *record) {
+    int32_t fields[2] = { record->index, record->id };
+
+    fwrite(fields, sizeof(fields), 1, r->cache_out);
+    dataset_cache_write_string(r->cache_out, record->conflict);
+    dataset_cache_write_string(r->cache_out, record->resolution);
+    dataset_cache_write_string(r->cache_out, record->v1);
+    dataset_cache_write_string(r->cache_out, record->v2);
+    dataset_cache_write_string(r->cache_out, record->devdecision);
+}
+
+static int dataset_cache_read_string(struct dataset_reader *r, char **s) {
+    uint32_t len;
+
+    if (r->map_len - r->map_pos < sizeof(len))
+        return -1;
+    memcpy(&len, r->map + r->map_pos, sizeof(len));
+    r->map_pos += sizeof(len);
+    if (len == DATASET_CACHE_NULL) {
+        *s = NULL;
+        return 0;
+    }
+    if (r->map_len - r->map_pos <= len || r->map[r->map_pos + len])
+        return -1;
+    *s = r->map + r->map_pos;
+    r->map_pos += len + 1;
+    return 0;
+}
+
+static int dataset_cache_read(struct dataset_reader *r, struct dataset_record *record) {
+    int32_t fields[2];
+
+    if (r->map_pos == r->map_len)
+        return 0;
+    if (r->map_len - r->map_pos < sizeof(fields))
+        return -1;
+    memcpy(fields, r->map + r->map_pos, sizeof(fields));
+    r->map_pos += sizeof(fields);
+    record->index = fields[0];
+    record->id = fields[1];
+    if (dataset_cache_read_string(r, &record->conflict) ||
+        dataset_cache_read_string(r, &record->resolution) ||
+        dataset_cache_read_string(r, &record->v1) ||
+        dataset_cache_read_string(r, &record->v2) ||
+        dataset_cache_read_string(r, &record->devdecision))
+        return -1;
+    return 1;
+}
+
+static char *dataset_field(struct json_object *obj, const char *key) {
+    return (char *) json_object_get_string(json_object_object_get(obj, key));
+}
+
+/*
+ * Read the next record; its strings are valid until the next call.
+ * Return 1 for a record, 0 at the end of the dataset and -1 when it is
+ * not valid.
+ */
+static int dataset_next(struct dataset_reader *r, struct dataset_record *record) {
+    struct json_object *obj;
+
+    if (r->map)
+        return dataset_cache_read(r, record);
+
+    for (;;) {
+        int c = dataset_peek(r);
+
+        switch (r->state) {
+            case DATASET_START:
+                if (c != '{')
+                    return -1;
+                r->pos++;
+                r->state = DATASET_PROJECTS;
+                break;
+            case DATASET_PROJECTS:
+                if (c == ',') {
+                    r->pos++;
+                } else if (c == '}') {
+                    r->pos++;
+                    r->state = DATASET_END;
+                } else if (c != '"' || dataset_skip_key(r) || dataset_peek(r) != '[') {
+                    return -1;
+                } else {
+                    r->pos++;
+                    r->index = 0;
+                    r->state = DATASET_RECORDS;
+                }
+                break;
+            case DATASET_RECORDS:
+                if (c == ',') {
+                    r->pos++;
+                    break;
+                }
+                if (c == ']') {
+                    r->pos++;
+                    r->state = DATASET_PROJECTS;
+                    break;
+                }
+                obj = c == EOF ? NULL : dataset_parse_record(r);
+                if (!obj)
+                    return -1;
+                if (r->current)
+                    json_object_put(r->current);
+                r->current = obj;
+
+                record->index = r->index++;
+                record->id = json_object_get_int(json_object_object_get(obj, "id"));
+                record->conflict = dataset_field(obj, "conflict");
+                record->resolution = dataset_field(obj, "resolution");
+                record->v1 = dataset_field(obj, "v1");
+                record->v2 = dataset_field(obj, "v2");
+                record->devdecision = dataset_field(obj, "devdecision");
+                if (r->cache_out)
+                    dataset_cache_write(r, record);
+                return 1;
+            case DATASET_END:
+                return 0;
+        }
+    }
+}
+
+static void dataset_close(struct dataset_reader *r) {
+    if (r->map)
+        munmap(r->map, r->map_len);
+    if (r->fp)
+        fclose(r->fp);
+    if (r->tok)
+        json_tokener_free(r->tok);
+    if (r->current)
+        json_object_put(r->current);
+    if (r->cache_out) {
+        int failed = ferror(r->cache_out);
+
+        /* only a cache of the whole dataset is worth keeping */
+        if (fclose(r->cache_out) || failed || r->state != DATASET_END ||
+            rename(r->cache_tmp, r->cache_path))
+            unlink(r->cache_tmp);
+        else
+            printf("Wrote the dataset cache %s\n", r->cache_path);
+    }
+    free(r->cache_path);
+    free(r->cache_tmp);
+}
+
+/*
+ * "--sweep" replays the clustering of the dataset for several threshold
+ * settings in one pass, without running the jars: the Jaro-Winkler
+ * similarities of a new conflict (and of its resolution) with every
+ * conflict before it are computed once, in one row reused for every
+ * conflict, and every setting places the conflict in its own set of
+ * clusters from them, as get_conflict_json_id_enhanced() does.  The
+ * average intrasimilarity of each cluster is summed up from the same
+ * row as members join it, so that each setting can also tell how often
+ * check_for_recluster() would have started reclustering.
+ *
+ * A setting is "similarity[:intrasimilarity[:valid_cluster]]", and
+ * the settings are separated by commas.
+ */
+struct sweep_cluster {
+    int *members;
+    int nr;
+    int alloc;
+    double pair_similarity; /* summed over the pairs of members */
+};
+
+struct sweep_setting {
+    double similarity;
+    double intrasimilarity;
+    double valid_cluster;
+    struct sweep_cluster *clusters;
+    int nr_clusters;
+    int alloc_clusters;
+    int population;         /* cluster_population, for the recluster check */
+    int reclusters;
+};
+
+struct sweep_pair {
+    char *conflict;
+    char *resolution;
+};
+
+struct sweep_similarity {
+    double conflict;
+    double resolution;
+};
+
+struct sweep {
+    struct sweep_setting *settings;
+    int nr_settings;
+    struct sweep_pair *pairs;   /* placed so far */
+    int nr;
+    int alloc;
+    struct sweep_similarity *row; /* of the conflict placed now with those before it */
+    int row_alloc;
+    size_t comparisons;
+};
+
+static void *sweep_grow(void *buf, size_t size, int *alloc, int need) {
+    if (need <= *alloc)
+        return buf;
+    *alloc = need > 2 * *alloc ? need : 2 * *alloc;
+    buf = realloc(buf, size * *alloc);
+    if (!buf)
+        exit(EXIT_FAILURE);
+    return buf;
+}
+
+static int sweep_parse(struct sweep *sweep, const char *list) {
+    char *copy = strdup(list), *save_ptr = NULL;
+    int alloc = 0;
+
+    memset(sweep, 0, sizeof(*sweep));
+    for (char *tok = strtok_r(copy, ",", &save_ptr); tok; tok = strtok_r(NULL, ",", &save_ptr)) {
+        struct sweep_setting *setting;
+        char *end;
+
+        sweep->settings = sweep_grow(sweep->settings, sizeof(*sweep->settings), &alloc, sweep->nr_settings + 1);
+        setting = &sweep->settings[sweep->nr_settings++];
+        memset(setting, 0, sizeof(*setting));
+        setting->intrasimilarity = intrasimilarity_th;
+        setting->valid_cluster = valid_cluster_th;
+        setting->population = 1;
+        setting->similarity = strtod(tok, &end);
+        if (*end == ':')
+            setting->intrasimilarity = strtod(end + 1, &end);
+        if (*end == ':')
+            setting->valid_cluster = strtod(end + 1, &end);
+        if (*end || end == tok) {
+            printf("Invalid sweep setting '%s'\n", tok);
+            free(copy);
+            return -1;
+        }
+    }
+    free(copy);
+    return sweep->nr_settings ? 0 : -1;
+}
+
+/* the similarities of conflict "i" with the conflicts before it */
+static void sweep_compare(struct sweep *sweep, int i) {
+    sweep->row = sweep_grow(sweep->row, sizeof(*sweep->row), &sweep->row_alloc, i);
+    for (int j = 0; j < i; j++) {
+        sweep->row[j].conflict = jaro_winkler_distance(sweep->pairs[i].conflict, sweep->pairs[j].conflict);
+        sweep->row[j].resolution = jaro_winkler_distance(sweep->pairs[i].resolution,
+                                                         sweep->pairs[j].resolution);
+    }
+    sweep->comparisons += i;
+}
+
+static double sweep_average_intrasimilarity(const struct sweep_setting *setting) {
+    double total = 0;
+    int valid = 0;
+
+    for (int c = 0; c < setting->nr_clusters; c++) {
+        const struct sweep_cluster *cluster = &setting->clusters[c];
+
+        if (cluster->nr > 1) {
+            total += cluster->pair_similarity / ((double) cluster->nr * (cluster->nr - 1) / 2);
+            valid++;
+        }
+    }
+    return valid ? total / valid : 0;
+}
+
+/* the conditions check_for_recluster() starts reclustering under */
+static void sweep_check_recluster(struct sweep_setting *setting, int population) {
+    double intrasimilarity = sweep_average_intrasimilarity(setting);
+    int singles = 0;
+
+    if (intrasimilarity > setting->intrasimilarity || intrasimilarity <= 0)
+        return;
+    for (int c = 0; c < setting->nr_clusters; c++)
+        if (setting->clusters[c].nr < 2)
+            singles++;
+    double percentage_of_singleclusters = (double) singles / setting->nr_clusters;
+    double percentage_wrt_last = (double) (((population - setting->population) * 100) / setting->population);
+    if (percentage_of_singleclusters < setting->valid_cluster && percentage_wrt_last >= 10) {
+        setting->population = population;
+        setting->reclusters++;
+    }
+}
+
+/* place conflict "i", whose similarities are in the row of the sweep */
+static void sweep_place(struct sweep *sweep, struct sweep_setting *setting, int i) {
+    const struct sweep_similarity *row = sweep->row;
+    double max_sim = setting->similarity, max_sim_resol = setting->similarity, best_pairs = 0;
+    int best = -1;
+
+    for (int c = 0; c < setting->nr_clusters; c++) {
+        struct sweep_cluster *cluster = &setting->clusters[c];
+        double total = 0, total_resol = 0;
+
+        for (int m = 0; m < cluster->nr; m++) {
+            total += row[cluster->members[m]].conflict;
+            total_resol += row[cluster->members[m]].resolution;
+        }
+        double avg = total / cluster->nr;
+        double avg_resol = total_resol / cluster->nr;
+        if (avg >= max_sim && avg_resol >= max_sim_resol) {
+            max_sim = avg;
+            max_sim_resol = avg_resol;
+            best = c;
+            best_pairs = (total + total_resol) / 2;
+        }
+    }
+    if (best < 0) {
+        setting->clusters = sweep_grow(setting->clusters, sizeof(*setting->clusters),
+                                       &setting->alloc_clusters, setting->nr_clusters + 1);
+        best = setting->nr_clusters++;
+        memset(&setting->clusters[best], 0, sizeof(*setting->clusters));
+    }
+
+    struct sweep_cluster *cluster = &setting->clusters[best];
+    cluster->members = sweep_grow(cluster->members, sizeof(*cluster->members), &cluster->alloc, cluster->nr + 1);
+    cluster->members[cluster->nr++] = i;
+    cluster->pair_similarity += best_pairs;
+    sweep_check_recluster(setting, i + 1);
+}
+
+static void sweep_write(struct sweep *sweep) {
+    struct sink_row row = { 0 };
+
+    sink_add_string(&row, "similarity_th");
+    sink_add_string(&row, "intrasimilarity_th");
+    sink_add_string(&row, "valid_cluster_th");
+    sink_add_string(&row, "Clusters");
+    sink_add_string(&row, "Single clusters");
+    sink_add_string(&row, "AVG Intrasimilarity");
+    sink_add_string(&row, "Reclusters");
+    sink_write_row(SINK_SWEEP, &row);
+
+    for (int k = 0; k < sweep->nr_settings; k++) {
+        struct sweep_setting *setting = &sweep->settings[k];
+        int singles = 0;
+
+        for (int c = 0; c < setting->nr_clusters; c++)
+            if (setting->clusters[c].nr < 2)
+                singles++;
+        sink_reset(&row);
+        sink_add_double(&row, setting->similarity);
+        sink_add_double(&row, setting->intrasimilarity);
+        sink_add_double(&row, setting->valid_cluster);
+        sink_add_int(&row, setting->nr_clusters);
+        sink_add_int(&row, singles);
+        sink_add_double(&row, sweep_average_intrasimilarity(setting));
+        sink_add_int(&row, setting->reclusters);
+        sink_write_row(SINK_SWEEP, &row);
+        printf("similarity_th %f: %d clusters, %d single, %d reclusters\n", setting->similarity,
+               setting->nr_clusters, singles, setting->reclusters);
+    }
+    sink_release(&row);
+}
+
+static void sweep_clear(struct sweep *sweep) {
+    for (int k = 0; k < sweep->nr_settings; k++) {
+        for (int c = 0; c < sweep->settings[k].nr_clusters; c++)
+            free(sweep->settings[k].clusters[c].members);
+        free(sweep->settings[k].clusters);
+    }
+    for (int i = 0; i < sweep->nr; i++) {
+        free(sweep->pairs[i].conflict);
+        free(sweep->pairs[i].resolution);
+    }
+    free(sweep->settings);
+    free(sweep->pairs);
+    free(sweep->row);
+}
+
+static int run_sweep(struct dataset_reader *dataset, const char *list) {
+    struct digest_set seen = {NULL, 0, 0};
+    struct dataset_record record;
+    struct sweep sweep;
+    int ret;
+
+    if (sweep_parse(&sweep, list))
+        return -1;
+    while ((ret = dataset_next(dataset, &record)) > 0) {
+        const char *conflict = record.conflict ? record.conflict : "";
+        const char *resolution = record.resolution ? record.resolution : "";
+        int i = sweep.nr;
+
+        /* write_json_conflict_index() skips pairs it has seen already */
+        if (!digest_set_insert(&seen, conflict_digest(conflict, resolution)))
+            continue;
+        sweep.pairs = sweep_grow(sweep.pairs, sizeof(*sweep.pairs), &sweep.alloc, i + 1);
+        sweep.pairs[i].conflict = strdup(conflict);
+        sweep.pairs[i].resolution = strdup(resolution);
+        sweep.nr++;
+
+        sweep_compare(&sweep, i);
+        for (int k = 0; k < sweep.nr_settings; k++)
+            sweep_place(&sweep, &sweep.settings[k], i);
+    }
+    if (ret == 0) {
+        printf("Sweep: %d conflicts, %zu comparisons for %d settings\n", sweep.nr, sweep.comparisons,
+               sweep.nr_settings);
+        sweep_write(&sweep);
+    }
+    sweep_clear(&sweep);
+    free(seen.slots);
+    return ret;
+}
+
 int main(int argc, char *argv[]) {
     printf("starting...\n");
 
@@ -2340,64 +3467,80 @@ int main(int argc, char *argv[]) {
         printf("Something went wrong when loading properties of %s, exit...", CONFIG_FILE_PATH);
         return 0;
     }
-    init_performance_file();
 
     if (argc == 1) {
         printf("No dataset file has been provided\n");
         return 0;
     }
+    if (!strcmp(argv[1], "--convert")) {
+        if (sink_convert())
+            printf("Could not convert %s\n", file_names[RESULTS_BINARY]);
+        return 0;
+    }
     if (argc >= 2) {
         printf("Dataset: %s\n", argv[1]);
     }
 
-
-    struct json_object *file_json = json_object_from_file(argv[1]);
-
-
-    printf("file read...\n");
-    if (!file_json) { // if file is empty
-        printf("The file does not exist, it is empty or is not in a valid Json format\n");
+    struct dataset_reader dataset;
+    struct dataset_record record;
+    int use_cache = 0, binary = 0;
+    const char *sweep = NULL;
+    int ret;
+
+    for (int i = 2; i < argc; i++) {
+        if (!strcmp(argv[i], "--cache"))
+            use_cache = 1;
+        else if (!strcmp(argv[i], "--binary"))
+            binary = 1;
+        else if (!strcmp(argv[i], "--sweep") && i + 1 < argc)
+            sweep = argv[++i];
+        else if (!strcmp(argv[i], "--recluster"))
+            background_recluster = 1;
+        else
+            printf("Unknown option %s\n", argv[i]);
+    }
+    if (sink_open(binary, sweep != NULL)) {
+        printf("Could not open the result files\n");
         return 0;
     }
-    struct json_object *obj;
-    char *jconf = NULL;
-    char *jresol = NULL;
-    char *jv2 = NULL;
-    char *jv1 = NULL;
-    char *jdec = NULL;
-    int jid = 0;
-    int arraylen;
+    if (dataset_open(&dataset, argv[1], use_cache)) {
+        printf("The file does not exist or can not be read\n");
+        return 0;
+    }
+    if (sweep) {
+        if (run_sweep(&dataset, sweep))
+            printf("The sweep settings or the dataset are not valid\n");
+        dataset_close(&dataset);
+        sink_close();
+        for (int i = 0; i < FILE_NAMES; i++)
+            free(file_names[i]);
+        return 0;
+    }
+    sink_performance_header();
+    init_conflict_digests();
 
     cluster_population = 1;
     printf("processing...");
-    json_object_object_foreach(file_json, key, val) {
-        obj = NULL;
-        arraylen = json_object_array_length(val);
-        printf("arraylen: %d\n", arraylen);
-        //for (int i = 0; i < arraylen; i++) {
-        for (int i = 0; i < arraylen; i++) {
-            printf("i = %d\n", i + 1);
-            obj = json_object_array_get_idx(val, i);
-            jid = json_object_get_int(json_object_object_get(obj, "id"));
-	        conf_ID = jid;
-            jconf = (char *) json_object_get_string(json_object_object_get(obj, "conflict"));
-            jresol = (char *) json_object_get_string(json_object_object_get(obj, "resolution"));
-            jv2 = (char *) json_object_get_string(json_object_object_get(obj, "v2"));
-            jv1 = (char *) json_object_get_string(json_object_object_get(obj, "v1"));
-            jdec = (char *) json_object_get_string(json_object_object_get(obj, "devdecision"));
+    while ((ret = dataset_next(&dataset, &record)) > 0) {
+        printf("i = %d\n", record.index + 1);
+        conf_ID = record.id;
 
-            printf("jid: %d\n", jid);
-            printf("jconf: %s\n", jconf);
-            printf("jresol: %s\n", jresol);
+        printf("jid: %d\n", record.id);
+        printf("jconf: %s\n", record.conflict);
+        printf("jresol: %s\n", record.resolution);
 
-            regex_replace_suggestion(jconf, jresol, jid, jv2, jdec);
-            write_json_conflict_index(jconf, jresol, i + 1);
-        }
+        regex_replace_suggestion(record.conflict, record.resolution, record.id, record.v2, record.devdecision);
+        write_json_conflict_index(record.conflict, record.resolution, record.index + 1);
     }
-    json_object_put(file_json);
+    if (ret < 0)
+        printf("The file is empty or is not in a valid Json format\n");
+    dataset_close(&dataset);
+    finish_recluster(1);
+    wait_for_synth_jobs();
+    sink_close();
 
     //free file name strings
-    for(int i = 0; i < 5; i++)
+    for(int i = 0; i < FILE_NAMES; i++)
         free(file_names[i]);
 
     return 0;